@@ -32,6 +32,10 @@
 #include <particle/geometry/box.hpp>
 #include <particle/geometry/position.hpp>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace cafes
 {
   namespace algorithm
@@ -60,6 +64,63 @@ namespace cafes
       typename Box::position_type pos;
       iterate_impl(b, f, pos, std::integral_constant<std::size_t,Box::dimensions>{});
     }
+
+    template<typename Box, typename Function, typename Position>
+    void iterate_colored_impl(Box const& b, Function&& f, Position& p, std::size_t color, std::integral_constant<std::size_t,0> const&)
+    {
+      std::forward<Function>(f)(p);
+    }
+
+    template<typename Box, typename Function, typename Position, typename Index>
+    void iterate_colored_impl(Box const& b, Function&& f, Position& p, std::size_t color, Index const&)
+    {
+      static constexpr std::size_t n = Index::value-1;
+
+      for( p[n] = b.bottom_left[n] + ((color>>n)&1); p[n] < b.upper_right[n]; p[n] += 2 )
+      {
+        iterate_colored_impl(b, std::forward<Function>(f), p, color, std::integral_constant<std::size_t,n>{});
+      }
+    }
+
+    //! Iterates over the box with 2^Dimensions colors: two positions of the
+    //! same color are at least 2 apart in each direction, so the Q1 elements
+    //! (and the 4Q1 patches of the pressure elements) of a color don't share
+    //! any node and can be treated concurrently. The planes of the outermost
+    //! direction are distributed over the threads with a static schedule.
+    template<typename Box, typename Function>
+    void iterate_colored(Box const& b, Function&& f)
+    {
+      static constexpr std::size_t n = Box::dimensions-1;
+
+      for(std::size_t color=0; color<(1u<<Box::dimensions); ++color)
+      {
+        int const first = b.bottom_left[n] + ((color>>n)&1);
+        int const nplanes = (b.upper_right[n] - first + 1)/2;
+
+        #pragma omp parallel for schedule(static)
+        for(int plane=0; plane<nplanes; ++plane)
+        {
+          typename Box::position_type pos;
+          pos[n] = first + 2*plane;
+          iterate_colored_impl(b, f, pos, color, std::integral_constant<std::size_t,n>{});
+        }
+      }
+    }
+
+    //! Uses iterate_colored when several threads are available and the
+    //! plain lexicographic iterate otherwise.
+    template<typename Box, typename Function>
+    void iterate_parallel(Box const& b, Function&& f)
+    {
+#ifdef _OPENMP
+      if (omp_get_max_threads() > 1)
+      {
+        iterate_colored(b, f);
+        return;
+      }
+#endif
+      iterate(b, f);
+    }
   }
 }
 
@@ -34,6 +34,7 @@
 #include<problem/sem.hpp>
 #include<problem/dton.hpp>
 #include<problem/ntod.hpp>
+#include<problem/monolithic.hpp>
 #include<fem/bc.hpp>
 #include<fem/rhs.hpp>
 #include<particle/particle.hpp>
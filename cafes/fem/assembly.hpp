@@ -0,0 +1,333 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef CAFES_FEM_ASSEMBLY_HPP_INCLUDED
+#define CAFES_FEM_ASSEMBLY_HPP_INCLUDED
+
+#include <algorithm/iterate.hpp>
+#include <fem/bc.hpp>
+#include <fem/matElem.hpp>
+#include <fem/mesh.hpp>
+#include <fem/quadrature.hpp>
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <petsc.h>
+
+namespace cafes
+{
+  namespace fem
+  {
+    //! Global indices of the dof of the local (ghosted) nodes of one or two
+    //! DMDA (velocity and pressure) used to assemble the elementary matrices.
+    template<std::size_t Dimensions>
+    struct assembler{
+      Mat A;
+      std::vector<DM> dm;
+      std::vector<DMDALocalInfo> info;
+      std::vector<ISLocalToGlobalMapping> ltog;
+      std::vector<PetscInt const*> indices;
+
+      PetscInt local_node(DMDALocalInfo const& i, std::array<int, 2> const& pos) const
+      {
+        return (pos[0] - i.gxs) + i.gxm*(pos[1] - i.gys);
+      }
+
+      PetscInt local_node(DMDALocalInfo const& i, std::array<int, 3> const& pos) const
+      {
+        return (pos[0] - i.gxs) + i.gxm*((pos[1] - i.gys) + i.gym*(pos[2] - i.gzs));
+      }
+
+      PetscInt local_node(DMDALocalInfo const& i, geometry::position<int, Dimensions> const& pos) const
+      {
+        std::array<int, Dimensions> p;
+        for(std::size_t d=0; d<Dimensions; ++d)
+          p[d] = pos[d];
+        return local_node(i, p);
+      }
+
+      //! global index of the dof d of the node pos of the field
+      template<typename Position>
+      PetscInt index(std::size_t field, Position const& pos, int d) const
+      {
+        return indices[field][local_node(info[field], pos)*info[field].dof + d];
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "add_field"
+      PetscErrorCode add_field(DM dmda, ISLocalToGlobalMapping mapping)
+      {
+        PetscErrorCode ierr;
+        PetscInt const* idx;
+        DMDALocalInfo i;
+        PetscFunctionBeginUser;
+
+        ierr = DMDAGetLocalInfo(dmda, &i);CHKERRQ(ierr);
+        ierr = ISLocalToGlobalMappingGetIndices(mapping, &idx);CHKERRQ(ierr);
+
+        dm.push_back(dmda);
+        info.push_back(i);
+        ltog.push_back(mapping);
+        indices.push_back(idx);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "restore"
+      PetscErrorCode restore()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        for(std::size_t i=0; i<ltog.size(); ++i){
+          ierr = ISLocalToGlobalMappingRestoreIndices(ltog[i], &indices[i]);CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+    };
+
+    auto const kernel_assembly_diag_block = [](auto& a, std::size_t field, auto const& matelem){
+      auto const kernel_pos = [&, field](auto const& pos){
+        auto const ielem = get_element(pos);
+        constexpr std::size_t nbasis = std::tuple_size<decltype(ielem)>::value;
+
+        std::array<PetscInt, nbasis> rows;
+        std::array<PetscScalar, nbasis*nbasis> values;
+
+        for(std::size_t k1=0; k1<nbasis; ++k1)
+          for(std::size_t k2=0; k2<nbasis; ++k2)
+            values[k1*nbasis + k2] = matelem[k1][k2];
+
+        for(int d=0; d<a.info[field].dof; ++d){
+          for(std::size_t k=0; k<nbasis; ++k)
+            rows[k] = a.index(field, ielem[k], d);
+          MatSetValues(a.A, nbasis, rows.data(), nbasis, rows.data(), values.data(), ADD_VALUES);
+        }
+      };
+      return kernel_pos;
+    };
+
+    auto const kernel_assembly_tensor_block = [](auto& a, std::size_t field, auto const& matelem){
+      auto const kernel_pos = [&, field](auto const& pos){
+        auto const ielem = get_element(pos);
+        constexpr std::size_t nbasis = std::tuple_size<decltype(ielem)>::value;
+        constexpr std::size_t dof = std::decay_t<decltype(pos)>::dimensions;
+        constexpr std::size_t n = nbasis*dof;
+
+        std::array<PetscInt, n> rows;
+        std::array<PetscScalar, n*n> values;
+
+        for(std::size_t k1=0; k1<nbasis; ++k1)
+          for(std::size_t d1=0; d1<dof; ++d1)
+            for(std::size_t k2=0; k2<nbasis; ++k2)
+              for(std::size_t d2=0; d2<dof; ++d2)
+                values[(k1*dof + d1)*n + k2*dof + d2] = matelem[k1][k2][d1][d2];
+
+        // one block per velocity of a batch (see kernel_batch_tensor_block)
+        for(int b=0; b<a.info[field].dof/static_cast<int>(dof); ++b){
+          for(std::size_t k1=0; k1<nbasis; ++k1)
+            for(std::size_t d1=0; d1<dof; ++d1)
+              rows[k1*dof + d1] = a.index(field, ielem[k1], b*dof + d1);
+          MatSetValues(a.A, n, rows.data(), n, rows.data(), values.data(), ADD_VALUES);
+        }
+      };
+      return kernel_pos;
+    };
+
+    //! B and B^T blocks as in kernel_off_diag_block: field 0 is the
+    //! velocity and field 1 the pressure, pos is a pressure element.
+    auto const kernel_assembly_off_diag_block = [](auto& a, auto const& matelem){
+      auto const kernel_pos = [&](auto const& pos){
+        auto const ielem_p = get_element(pos);
+        auto const ielem_v = get_element_4Q1(pos);
+        constexpr std::size_t nbasis_p = std::tuple_size<decltype(ielem_p)>::value;
+        constexpr std::size_t nbasis_v = std::tuple_size<decltype(ielem_v)>::value;
+        constexpr std::size_t dof = std::decay_t<decltype(pos)>::dimensions;
+        constexpr std::size_t n = nbasis_v*dof;
+
+        std::array<PetscInt, nbasis_p> rows_p;
+        std::array<PetscInt, n> rows_v;
+        std::array<PetscScalar, nbasis_p*n> B, BT;
+
+        for(std::size_t ie_p=0; ie_p<nbasis_p; ++ie_p)
+          rows_p[ie_p] = a.index(1, ielem_p[ie_p], 0);
+
+        for(std::size_t ie_v=0; ie_v<nbasis_v; ++ie_v)
+          for(std::size_t d=0; d<dof; ++d){
+            rows_v[ie_v*dof + d] = a.index(0, ielem_v[ie_v], d);
+            for(std::size_t ie_p=0; ie_p<nbasis_p; ++ie_p){
+              B[ie_p*n + ie_v*dof + d] = matelem[ie_p][ie_v][d];
+              BT[(ie_v*dof + d)*nbasis_p + ie_p] = -matelem[ie_p][ie_v][d];
+            }
+          }
+
+        MatSetValues(a.A, nbasis_p, rows_p.data(), n, rows_v.data(), B.data(), ADD_VALUES);
+        MatSetValues(a.A, n, rows_v.data(), nbasis_p, rows_p.data(), BT.data(), ADD_VALUES);
+      };
+      return kernel_pos;
+    };
+
+    auto const kernel_rows_on_bc = [](auto& a, auto& rows, auto const& bc_conditions){
+      auto const kernel_pos = [&](auto const& pos){
+        for(int dof=0; dof<a.info[0].dof; ++dof)
+          if (bc_conditions[dof%pos.dimensions])
+            rows.push_back(a.index(0, pos, dof));
+      };
+      return kernel_pos;
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_dirichlet_rows"
+    //! Replaces the rows of the Dirichlet dof of the field 0 by the rows of
+    //! the identity like SetDirichletOnVec does on the matrix-free products.
+    template<std::size_t Dimensions>
+    PetscErrorCode set_dirichlet_rows(assembler<Dimensions>& a, dirichlet_conditions<Dimensions> const& bc)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      std::vector<PetscInt> rows;
+      for(auto const& face: get_dirichlet_boxes<Dimensions>(a.dm[0]))
+        algorithm::iterate(face.first, kernel_rows_on_bc(a, rows, bc.conditions_[face.second]));
+
+      ierr = MatZeroRows(a.A, rows.size(), rows.data(), 1., nullptr, nullptr);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "assemble_diag_block_matrix"
+    //! Assembles the operator of the kernel kernel_assembly_diag_block or
+    //! kernel_assembly_tensor_block on a DMDA in a matrix of type mat_type
+    //! (MATAIJ or MATBAIJ).
+    template<std::size_t Dimensions, typename MatElem, typename Function>
+    PetscErrorCode assemble_diag_block_matrix(DM dm, MatType mat_type, MatElem const& matelem, Function&& kernel,
+                                              dirichlet_conditions<Dimensions> const* bc, Mat* A)
+    {
+      PetscErrorCode ierr;
+      ISLocalToGlobalMapping ltog;
+      assembler<Dimensions> a;
+      PetscFunctionBeginUser;
+
+      ierr = DMSetMatType(dm, mat_type);CHKERRQ(ierr);
+      ierr = DMCreateMatrix(dm, A);CHKERRQ(ierr);
+      ierr = MatSetOption(*A, MAT_NEW_NONZERO_ALLOCATION_ERR, PETSC_FALSE);CHKERRQ(ierr);
+
+      ierr = DMGetLocalToGlobalMapping(dm, &ltog);CHKERRQ(ierr);
+      a.A = *A;
+      ierr = a.add_field(dm, ltog);CHKERRQ(ierr);
+
+      auto box = get_DM_bounds<Dimensions>(dm);
+      algorithm::iterate(box, kernel(a, 0, matelem));
+
+      ierr = MatAssemblyBegin(*A, MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+      ierr = MatAssemblyEnd(*A, MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+
+      if (bc){
+        ierr = set_dirichlet_rows(a, *bc);CHKERRQ(ierr);
+      }
+
+      ierr = a.restore();CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "assemble_stokes_matrix"
+    //! Assembles the Stokes matrix on the composite DM (velocity, pressure)
+    //! in a MATAIJ matrix: the viscous block given by the kernel and the
+    //! elementary matrix matelem_u, and the B and B^T blocks.
+    template<std::size_t Dimensions, typename MatElem, typename Function>
+    PetscErrorCode assemble_stokes_matrix(DM dm, MatElem const& matelem_u, Function&& kernel,
+                                          std::array<double, Dimensions> const& h,
+                                          dirichlet_conditions<Dimensions> const* bc, Mat* A)
+    {
+      PetscErrorCode ierr;
+      ISLocalToGlobalMapping *ltogs;
+      DM dav, dap;
+      DMDALocalInfo infov, infop;
+      int localsize, totalsize;
+      assembler<Dimensions> a;
+      PetscFunctionBeginUser;
+
+      ierr = DMCompositeGetEntries(dm, &dav, &dap);CHKERRQ(ierr);
+      ierr = DMDAGetLocalInfo(dav, &infov);CHKERRQ(ierr);
+      ierr = DMDAGetLocalInfo(dap, &infop);CHKERRQ(ierr);
+      ierr = get_DM_sizes(dm, localsize, totalsize);CHKERRQ(ierr);
+
+      // upper bounds of the number of non zeros per row:
+      // a velocity node is coupled with 3^d velocity and 3^d pressure nodes,
+      // a pressure node with 5^d velocity nodes.
+      PetscInt n3 = 1, n5 = 1;
+      for(std::size_t d=0; d<Dimensions; ++d){
+        n3 *= 3;
+        n5 *= 5;
+      }
+      PetscInt const nvel = infov.dof*infov.xm*infov.ym*infov.zm;
+      std::vector<PetscInt> nnz(localsize);
+      std::fill(nnz.begin(), nnz.begin() + nvel, Dimensions*n3 + n3);
+      std::fill(nnz.begin() + nvel, nnz.end(), Dimensions*n5);
+
+      ierr = MatCreate(PETSC_COMM_WORLD, A);CHKERRQ(ierr);
+      ierr = MatSetSizes(*A, localsize, localsize, totalsize, totalsize);CHKERRQ(ierr);
+      ierr = MatSetType(*A, MATAIJ);CHKERRQ(ierr);
+      ierr = MatXAIJSetPreallocation(*A, 1, nnz.data(), nnz.data(), nullptr, nullptr);CHKERRQ(ierr);
+      ierr = MatSetOption(*A, MAT_NEW_NONZERO_ALLOCATION_ERR, PETSC_FALSE);CHKERRQ(ierr);
+
+      ierr = DMCompositeGetISLocalToGlobalMappings(dm, &ltogs);CHKERRQ(ierr);
+      a.A = *A;
+      ierr = a.add_field(dav, ltogs[0]);CHKERRQ(ierr);
+      ierr = a.add_field(dap, ltogs[1]);CHKERRQ(ierr);
+
+      auto box_u = get_DM_bounds<Dimensions>(dav);
+      algorithm::iterate(box_u, kernel(a, 0, matelem_u));
+
+      auto box_p = get_DM_bounds<Dimensions>(dap);
+      algorithm::iterate(box_p, kernel_assembly_off_diag_block(a, getMatElemPressure(h)));
+
+      ierr = MatAssemblyBegin(*A, MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+      ierr = MatAssemblyEnd(*A, MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+
+      if (bc){
+        ierr = set_dirichlet_rows(a, *bc);CHKERRQ(ierr);
+      }
+
+      ierr = a.restore();CHKERRQ(ierr);
+      for(std::size_t i=0; i<2; ++i){
+        ierr = ISLocalToGlobalMappingDestroy(&ltogs[i]);CHKERRQ(ierr);
+      }
+      ierr = PetscFree(ltogs);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+  }
+}
+#endif
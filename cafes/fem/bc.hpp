@@ -34,6 +34,8 @@
 #include <petsc/vec.hpp>
 
 #include <array>
+#include <utility>
+#include <vector>
 
 namespace cafes
 {
@@ -58,12 +60,14 @@ namespace cafes
 
     };
 
+    //! The conditions are given per velocity component: when the dof of y
+    //! are a batch of interleaved velocities, they apply to each of them.
     auto const kernel_vec_on_bc = [](auto const& x, auto& y, auto const& bc_conditions, auto const& h){
       auto const kernel_pos = [&](auto const& pos){
         auto ux = x.at_g(pos);
         auto uy = y.at_g(pos);
         for(std::size_t dof=0; dof<y.dof_; ++dof)
-          if (bc_conditions[dof])
+          if (bc_conditions[dof%pos.dimensions])
             uy[dof] = ux[dof];
       };
       return kernel_pos;
@@ -73,7 +77,7 @@ namespace cafes
       auto const kernel_pos = [&](auto const& pos){
         auto uy = y.at_g(pos);
         for(std::size_t dof=0; dof<y.dof_; ++dof)
-          if (bc_conditions[dof])
+          if (bc_conditions[dof%pos.dimensions])
             uy[dof] = x;
       };
       return kernel_pos;
@@ -88,27 +92,22 @@ namespace cafes
           coord[i] = pos[i]*h[i];
 
         for(std::size_t dof=0; dof<y.dof_; ++dof)
-          if (bc_conditions[dof])
-            bc_conditions[dof](coord, &uy[dof]);
+          if (bc_conditions[dof%pos.dimensions])
+            bc_conditions[dof%pos.dimensions](coord, &uy[dof]);
       };
       return kernel_pos;
     };
 
-    #undef __FUNCT__
-    #define __FUNCT__ "set_dirichlet_impl"
-    template<std::size_t Dimensions, typename Function, typename x_type, typename h_type>
-    PetscErrorCode set_dirichlet_impl(x_type&& x, 
-                                      petsc::petsc_vec<Dimensions>& y,
-                                      dirichlet_conditions<Dimensions> bc,
-                                      h_type&& h,
-                                      Function&& kernel)
+    //! The owned nodes of each non periodic boundary face with the index
+    //! of the face in dirichlet_conditions::conditions_.
+    template<std::size_t Dimensions>
+    auto get_dirichlet_boxes(DM dm)
     {
-      PetscErrorCode ierr;
-      PetscFunctionBeginUser;
+      std::vector<std::pair<geometry::box<int, Dimensions>, std::size_t>> faces;
 
-      auto bd_type = get_boundary_type<Dimensions>(y.dm_);
-      auto gbounds = get_global_bounds<Dimensions>(y.dm_);
-      auto box = get_DM_bounds<Dimensions>(y.dm_, false);
+      auto bd_type = get_boundary_type<Dimensions>(dm);
+      auto gbounds = get_global_bounds<Dimensions>(dm);
+      auto box = get_DM_bounds<Dimensions>(dm, false);
 
       for(std::size_t d=0; d<Dimensions; ++d)
       {
@@ -118,18 +117,36 @@ namespace cafes
           {
             auto new_box = box;
             new_box.upper_right[d] = 1;
-            algorithm::iterate(new_box, kernel(x, y, bc.conditions_[2*d], h));
+            faces.push_back({new_box, 2*d});
           }
 
           if (box.upper_right[d] == gbounds[d])
           {
             auto new_box = box;
             new_box.bottom_left[d] = gbounds[d]-1;
-            algorithm::iterate(new_box, kernel(x, y, bc.conditions_[2*d+1], h));
+            faces.push_back({new_box, 2*d+1});
           }
 
         }
       }
+      return faces;
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_dirichlet_impl"
+    template<std::size_t Dimensions, typename Function, typename x_type, typename h_type>
+    PetscErrorCode set_dirichlet_impl(x_type&& x, 
+                                      petsc::petsc_vec<Dimensions>& y,
+                                      dirichlet_conditions<Dimensions> bc,
+                                      h_type&& h,
+                                      Function&& kernel)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      for(auto const& face: get_dirichlet_boxes<Dimensions>(y.dm_))
+        algorithm::iterate(face.first, kernel(x, y, bc.conditions_[face.second], h));
+
       PetscFunctionReturn(0);
     }
 
@@ -176,6 +193,21 @@ namespace cafes
 
       PetscFunctionReturn(0);
     }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "SetDirichletOnDiag"
+    //! The Dirichlet rows of the operators are rows of the identity.
+    template<std::size_t Dimensions>
+    PetscErrorCode SetDirichletOnDiag(petsc::petsc_vec<Dimensions>& x,
+                                      dirichlet_conditions<Dimensions> bc)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      set_dirichlet_impl(1., x, bc, nullptr, kernel_const_on_bc);
+
+      PetscFunctionReturn(0);
+    }
   }
   template<std::size_t Dimensions>
   fem::dirichlet_conditions<Dimensions> make_bc(std::initializer_list<std::array<condition_fn, Dimensions>> il){
@@ -0,0 +1,357 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef CAFES_FEM_FAST_DIAGONALIZATION_HPP_INCLUDED
+#define CAFES_FEM_FAST_DIAGONALIZATION_HPP_INCLUDED
+
+#include <fem/bc.hpp>
+#include <petsc/vec.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include <fftw3.h>
+#include <petsc.h>
+
+namespace cafes
+{
+  namespace fem
+  {
+    //! Fast diagonalization of the velocity block on a box with Dirichlet
+    //! walls. On the interior nodes of the uniform grid, the Q1 Laplacian is
+    //! the sum over the directions d of K_d x (M_e for e != d) where K and
+    //! M are the 1D stiffness and mass matrices, which are diagonalized by
+    //! the sine transform (DST-I). The transform is applied direction by
+    //! direction on pencils: the values are scattered so that each process
+    //! owns complete lines in the direction d.
+    //!
+    //! The layout of the pencil d is ((line*dof + c)*n[d] + i) where line
+    //! is the natural index of the other directions.
+    template<std::size_t Dimensions>
+    struct fast_diagonalization_context{
+      Mat A;
+      DM dm;
+      dirichlet_conditions<Dimensions> bc;
+      int dof;
+      std::array<PetscInt, Dimensions> n;
+      std::array<Vec, Dimensions> pencil;
+      //! scatter[0]: DMDA to pencil 0, scatter[d]: pencil d-1 to pencil d
+      std::array<VecScatter, Dimensions> scatter;
+      std::array<fftw_plan, Dimensions> plan;
+      //! scaled inverse of the eigenvalues in the layout of the last pencil
+      Vec inv_eigenvalues;
+      Vec w, t;
+    };
+
+    template<std::size_t Dimensions>
+    PetscInt pencil_lines(std::array<PetscInt, Dimensions> const& n, std::size_t dir)
+    {
+      PetscInt lines = 1;
+      for(std::size_t d=0; d<Dimensions; ++d)
+        if (d != dir)
+          lines *= n[d];
+      return lines;
+    }
+
+    template<std::size_t Dimensions>
+    std::array<PetscInt, Dimensions> pencil_position(std::array<PetscInt, Dimensions> const& n, std::size_t dir,
+                                                     PetscInt line, PetscInt i)
+    {
+      std::array<PetscInt, Dimensions> pos;
+      for(std::size_t d=0; d<Dimensions; ++d)
+        if (d != dir){
+          pos[d] = line%n[d];
+          line /= n[d];
+        }
+      pos[dir] = i;
+      return pos;
+    }
+
+    template<std::size_t Dimensions>
+    PetscInt pencil_index(std::array<PetscInt, Dimensions> const& n, std::size_t dir,
+                          std::array<PetscInt, Dimensions> const& pos, int c, int dof)
+    {
+      PetscInt line = 0;
+      for(std::size_t d=Dimensions; d-- > 0;)
+        if (d != dir)
+          line = line*n[d] + pos[d];
+      return (line*dof + c)*n[dir] + pos[dir];
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "sine_transform"
+    template<std::size_t Dimensions>
+    PetscErrorCode sine_transform(fast_diagonalization_context<Dimensions>& s, std::size_t dir)
+    {
+      PetscErrorCode ierr;
+      PetscScalar *array;
+      PetscFunctionBeginUser;
+
+      if (s.plan[dir]){
+        ierr = VecGetArray(s.pencil[dir], &array);CHKERRQ(ierr);
+        fftw_execute_r2r(s.plan[dir], array, array);
+        ierr = VecRestoreArray(s.pencil[dir], &array);CHKERRQ(ierr);
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "fast_diagonalization_apply"
+    //! z = A^{-1} r: the Dirichlet rows of A are the identity, so the
+    //! Dirichlet values of r are moved to the right hand side of the
+    //! interior nodes before the transforms.
+    template<std::size_t Dimensions>
+    PetscErrorCode fast_diagonalization_apply(PC pc, Vec r, Vec z)
+    {
+      PetscErrorCode ierr;
+      fast_diagonalization_context<Dimensions> *s;
+      PetscReal norm;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+
+      ierr = VecSet(s->w, 0.);CHKERRQ(ierr);
+      {
+        auto rpetsc = petsc::petsc_vec<Dimensions>(s->dm, r, 0);
+        auto wpetsc = petsc::petsc_vec<Dimensions>(s->dm, s->w, 0, false);
+        ierr = SetDirichletOnVec(rpetsc, wpetsc, s->bc);CHKERRQ(ierr);
+      }
+      ierr = VecNorm(s->w, NORM_INFINITY, &norm);CHKERRQ(ierr);
+
+      if (norm > 0){
+        ierr = MatMult(s->A, s->w, s->t);CHKERRQ(ierr);
+        ierr = VecWAXPY(z, -1., s->t, r);CHKERRQ(ierr);
+      }
+      else{
+        ierr = VecCopy(r, z);CHKERRQ(ierr);
+      }
+
+      ierr = VecScatterBegin(s->scatter[0], z, s->pencil[0], INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+      ierr = VecScatterEnd(s->scatter[0], z, s->pencil[0], INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+      ierr = sine_transform(*s, 0);CHKERRQ(ierr);
+      for(std::size_t d=1; d<Dimensions; ++d){
+        ierr = VecScatterBegin(s->scatter[d], s->pencil[d-1], s->pencil[d], INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+        ierr = VecScatterEnd(s->scatter[d], s->pencil[d-1], s->pencil[d], INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+        ierr = sine_transform(*s, d);CHKERRQ(ierr);
+      }
+
+      ierr = VecPointwiseMult(s->pencil[Dimensions-1], s->pencil[Dimensions-1], s->inv_eigenvalues);CHKERRQ(ierr);
+
+      // the DST-I is its own inverse up to the scaling in inv_eigenvalues
+      ierr = sine_transform(*s, Dimensions-1);CHKERRQ(ierr);
+      for(std::size_t d=Dimensions-1; d>0; --d){
+        ierr = VecScatterBegin(s->scatter[d], s->pencil[d], s->pencil[d-1], INSERT_VALUES, SCATTER_REVERSE);CHKERRQ(ierr);
+        ierr = VecScatterEnd(s->scatter[d], s->pencil[d], s->pencil[d-1], INSERT_VALUES, SCATTER_REVERSE);CHKERRQ(ierr);
+        ierr = sine_transform(*s, d-1);CHKERRQ(ierr);
+      }
+      ierr = VecScatterBegin(s->scatter[0], s->pencil[0], z, INSERT_VALUES, SCATTER_REVERSE);CHKERRQ(ierr);
+      ierr = VecScatterEnd(s->scatter[0], s->pencil[0], z, INSERT_VALUES, SCATTER_REVERSE);CHKERRQ(ierr);
+
+      {
+        auto rpetsc = petsc::petsc_vec<Dimensions>(s->dm, r, 0);
+        auto zpetsc = petsc::petsc_vec<Dimensions>(s->dm, z, 0, false);
+        ierr = SetDirichletOnVec(rpetsc, zpetsc, s->bc);CHKERRQ(ierr);
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "fast_diagonalization_destroy"
+    template<std::size_t Dimensions>
+    PetscErrorCode fast_diagonalization_destroy(PC pc)
+    {
+      PetscErrorCode ierr;
+      fast_diagonalization_context<Dimensions> *s;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+      for(std::size_t d=0; d<Dimensions; ++d){
+        ierr = VecDestroy(&s->pencil[d]);CHKERRQ(ierr);
+        ierr = VecScatterDestroy(&s->scatter[d]);CHKERRQ(ierr);
+        if (s->plan[d])
+          fftw_destroy_plan(s->plan[d]);
+      }
+      ierr = VecDestroy(&s->inv_eigenvalues);CHKERRQ(ierr);
+      ierr = VecDestroy(&s->w);CHKERRQ(ierr);
+      ierr = VecDestroy(&s->t);CHKERRQ(ierr);
+      ierr = MatDestroy(&s->A);CHKERRQ(ierr);
+      delete s;
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_fast_diagonalization"
+    //! Sets on pc the fast diagonalization of the velocity block A on the
+    //! DMDA dm with the step h. It is the exact inverse of the Laplacian.
+    //! For the strain tensor (strain set), the inverse of the diagonal
+    //! blocks is used: the component c has the coefficient 2 on the
+    //! direction c.
+    template<std::size_t Dimensions>
+    PetscErrorCode set_fast_diagonalization(PC pc, Mat A, DM dm, std::array<double, Dimensions> const& h,
+                                            dirichlet_conditions<Dimensions> const& bc, PetscBool strain)
+    {
+      PetscErrorCode ierr;
+      PetscInt M[3], dof;
+      DMBoundaryType bd[3];
+      AO ao;
+      PetscMPIInt rank, size;
+      PetscFunctionBeginUser;
+
+      ierr = DMDAGetInfo(dm, nullptr, &M[0], &M[1], &M[2], nullptr, nullptr, nullptr,
+                         &dof, nullptr, &bd[0], &bd[1], &bd[2], nullptr);CHKERRQ(ierr);
+
+      for(std::size_t d=0; d<Dimensions; ++d){
+        if (bd[d] == DM_BOUNDARY_PERIODIC || M[d] < 3)
+          SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_ARG_WRONG, "the fast diagonalization needs Dirichlet walls and interior nodes in each direction");
+        for(std::size_t f=2*d; f<2*d+2; ++f)
+          for(std::size_t c=0; c<Dimensions; ++c)
+            if (!bc.conditions_[f][c])
+              SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_ARG_WRONG, "the fast diagonalization needs a Dirichlet condition on each wall");
+      }
+
+      auto *s = new fast_diagonalization_context<Dimensions>{A, dm, bc, static_cast<int>(dof)};
+      ierr = PetscObjectReference((PetscObject)A);CHKERRQ(ierr);
+      for(std::size_t d=0; d<Dimensions; ++d)
+        s->n[d] = M[d] - 2;
+      auto const& n = s->n;
+
+      MPI_Comm comm = PetscObjectComm((PetscObject)dm);
+      ierr = MPI_Comm_rank(comm, &rank);CHKERRQ(ierr);
+      ierr = MPI_Comm_size(comm, &size);CHKERRQ(ierr);
+      ierr = DMDAGetAO(dm, &ao);CHKERRQ(ierr);
+
+      std::array<PetscInt, Dimensions> start, end;
+      for(std::size_t dir=0; dir<Dimensions; ++dir){
+        PetscInt lines = pencil_lines(n, dir);
+        start[dir] = rank*(lines/size) + std::min<PetscInt>(rank, lines%size);
+        end[dir] = start[dir] + lines/size + ((rank < lines%size)? 1: 0);
+        PetscInt const nlocal = (end[dir] - start[dir])*dof*n[dir];
+
+        ierr = VecCreateMPI(comm, nlocal, PETSC_DETERMINE, &s->pencil[dir]);CHKERRQ(ierr);
+
+        std::vector<PetscInt> from, to;
+        from.reserve(nlocal);
+        to.reserve(nlocal);
+        for(PetscInt line=start[dir]; line<end[dir]; ++line)
+          for(int c=0; c<dof; ++c)
+            for(PetscInt i=0; i<n[dir]; ++i){
+              auto pos = pencil_position(n, dir, line, i);
+              to.push_back((line*dof + c)*n[dir] + i);
+              if (dir == 0){
+                // natural index of the node on the whole grid
+                PetscInt node = 0;
+                for(std::size_t d=Dimensions; d-- > 0;)
+                  node = node*M[d] + pos[d] + 1;
+                from.push_back(dof*node + c);
+              }
+              else
+                from.push_back(pencil_index(n, dir-1, pos, c, dof));
+            }
+
+        Vec v;
+        IS is_from, is_to;
+        if (dir == 0){
+          ierr = AOApplicationToPetsc(ao, from.size(), from.data());CHKERRQ(ierr);
+          ierr = DMGetGlobalVector(dm, &v);CHKERRQ(ierr);
+        }
+        else
+          v = s->pencil[dir-1];
+
+        ierr = ISCreateGeneral(comm, from.size(), from.data(), PETSC_COPY_VALUES, &is_from);CHKERRQ(ierr);
+        ierr = ISCreateGeneral(comm, to.size(), to.data(), PETSC_COPY_VALUES, &is_to);CHKERRQ(ierr);
+        ierr = VecScatterCreate(v, is_from, s->pencil[dir], is_to, &s->scatter[dir]);CHKERRQ(ierr);
+        ierr = ISDestroy(&is_from);CHKERRQ(ierr);
+        ierr = ISDestroy(&is_to);CHKERRQ(ierr);
+
+        if (dir == 0){
+          ierr = DMRestoreGlobalVector(dm, &v);CHKERRQ(ierr);
+        }
+
+        // one DST-I per local line
+        s->plan[dir] = nullptr;
+        int const howmany = (end[dir] - start[dir])*dof;
+        if (howmany > 0){
+          int const length = n[dir];
+          fftw_r2r_kind const kind = FFTW_RODFT00;
+          std::vector<double> tmp(nlocal);
+          s->plan[dir] = fftw_plan_many_r2r(1, &length, howmany, tmp.data(), nullptr, 1, length,
+                                            tmp.data(), nullptr, 1, length, &kind, FFTW_ESTIMATE | FFTW_UNALIGNED);
+        }
+      }
+
+      // eigenvalues of the 1D stiffness and mass matrices for the sine modes
+      double const pi = std::acos(-1.);
+      double scale = 1.;
+      std::array<std::vector<double>, Dimensions> eig_k, eig_m;
+      for(std::size_t d=0; d<Dimensions; ++d){
+        scale *= 2*(n[d] + 1);
+        eig_k[d].resize(n[d]);
+        eig_m[d].resize(n[d]);
+        for(PetscInt k=0; k<n[d]; ++k){
+          double const c = std::cos(pi*(k + 1)/(n[d] + 1));
+          eig_k[d][k] = 2*(1 - c)/h[d];
+          eig_m[d][k] = h[d]*(2 + c)/3;
+        }
+      }
+
+      std::size_t const last = Dimensions - 1;
+      PetscScalar *array;
+      ierr = VecDuplicate(s->pencil[last], &s->inv_eigenvalues);CHKERRQ(ierr);
+      ierr = VecGetArray(s->inv_eigenvalues, &array);CHKERRQ(ierr);
+      for(PetscInt line=start[last], j=0; line<end[last]; ++line)
+        for(int c=0; c<dof; ++c)
+          for(PetscInt i=0; i<n[last]; ++i, ++j){
+            auto pos = pencil_position(n, last, line, i);
+            double lambda = 0;
+            for(std::size_t d=0; d<Dimensions; ++d){
+              double term = (strain && d == c%Dimensions)? 2*eig_k[d][pos[d]]: eig_k[d][pos[d]];
+              for(std::size_t e=0; e<Dimensions; ++e)
+                if (e != d)
+                  term *= eig_m[e][pos[e]];
+              lambda += term;
+            }
+            array[j] = 1./(scale*lambda);
+          }
+      ierr = VecRestoreArray(s->inv_eigenvalues, &array);CHKERRQ(ierr);
+
+      ierr = MatCreateVecs(A, &s->w, &s->t);CHKERRQ(ierr);
+
+      ierr = PCSetType(pc, PCSHELL);CHKERRQ(ierr);
+      ierr = PCShellSetContext(pc, s);CHKERRQ(ierr);
+      ierr = PCShellSetApply(pc, fast_diagonalization_apply<Dimensions>);CHKERRQ(ierr);
+      ierr = PCShellSetDestroy(pc, fast_diagonalization_destroy<Dimensions>);CHKERRQ(ierr);
+      ierr = PCShellSetName(pc, "fast diagonalization");CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+  }
+}
+#endif
@@ -320,4 +320,73 @@ auto getMatElemMass(std::array<double, 3> const& h){
 
   return MatElem;
 }
+// Sum-factorized form of the elementary matrices of the Laplacian and of the
+// strain tensor. In the basis (u_0+u_1, u_0-u_1) of each direction, the 1D
+// mass and stiffness matrices of Q1 are diagonal and the 1D mixed matrix only
+// maps the difference to the sum. The mode m = mx + 2*my + 4*mz has the same
+// ordering as the nodes of get_element and the weights include the factor
+// 1/2^Dimensions of the inverse transform.
+template<std::size_t Dimensions>
+auto getModeStiffness(std::array<double, Dimensions> const& h){
+  constexpr std::size_t nmodes = 1<<Dimensions;
+  std::array<std::array<double, nmodes>, Dimensions> Modes;
+
+  for(std::size_t d=0; d<Dimensions; ++d)
+    for(std::size_t m=0; m<nmodes; ++m)
+    {
+      double w = ((m>>d)&1)? 2./h[d]: 0.;
+      for(std::size_t e=0; e<Dimensions; ++e)
+        if (e != d)
+          w *= h[e]*(((m>>e)&1)? 1./6: .5);
+      Modes[d][m] = w/nmodes;
+    }
+
+  return Modes;
+}
+
+template<std::size_t Dimensions>
+auto getModeLaplacian(std::array<double, Dimensions> const& h){
+  constexpr std::size_t nmodes = 1<<Dimensions;
+  std::array<double, nmodes> Modes;
+  auto stiffness = getModeStiffness(h);
+
+  for(std::size_t m=0; m<nmodes; ++m)
+  {
+    Modes[m] = 0.;
+    for(std::size_t d=0; d<Dimensions; ++d)
+      Modes[m] += stiffness[d][m];
+  }
+
+  return Modes;
+}
+
+// Modes[d1][d2][m] is the weight of the mode m ^ (2^d1 | 2^d2) of the
+// component d2 in the mode m of the component d1.
+template<std::size_t Dimensions>
+auto getModeStrainTensor(std::array<double, Dimensions> const& h){
+  constexpr std::size_t nmodes = 1<<Dimensions;
+  std::array<std::array<std::array<double, nmodes>, Dimensions>, Dimensions> Modes;
+  auto stiffness = getModeStiffness(h);
+  auto laplacian = getModeLaplacian(h);
+
+  for(std::size_t d1=0; d1<Dimensions; ++d1)
+    for(std::size_t d2=0; d2<Dimensions; ++d2)
+      for(std::size_t m=0; m<nmodes; ++m)
+      {
+        if (d1 == d2)
+          Modes[d1][d2][m] = laplacian[m] + stiffness[d1][m];
+        else if (((m>>d1)&1) == 0 && ((m>>d2)&1) == 1)
+        {
+          double w = 1./nmodes;
+          for(std::size_t e=0; e<Dimensions; ++e)
+            if (e != d1 && e != d2)
+              w *= h[e]*(((m>>e)&1)? 1./6: .5);
+          Modes[d1][d2][m] = w;
+        }
+        else
+          Modes[d1][d2][m] = 0.;
+      }
+
+  return Modes;
+}
 #endif
\ No newline at end of file
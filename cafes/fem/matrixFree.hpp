@@ -39,6 +39,131 @@ namespace cafes
 {
   namespace fem
   {
+    #undef __FUNCT__
+    #define __FUNCT__ "set_operator"
+    //! Dispatch layer: sets ctx.op and ctx.stokes_op to the versions of
+    //! ctx.apply and ctx.apply_stokes specialized on the number of dof, with
+    //! the elementary matrices scaled once for ctx.h. The operators without
+    //! specialization are still called through ctx.apply.
+    template<typename CTX, typename Dimensions = typename CTX::dimension_type>
+    typename std::enable_if<CTX::ndm_type::value==1, PetscErrorCode>::type
+    set_operator(CTX& ctx)
+    {
+      constexpr std::size_t dim = Dimensions::value;
+      using velocity_dof = std::integral_constant<std::size_t, dim>;
+      PetscErrorCode ierr;
+      PetscBool iscomposite;
+      PetscFunctionBeginUser;
+
+      auto const& h = ctx.h;
+      ctx.op = nullptr;
+      ctx.stokes_op = nullptr;
+
+      if (ctx.apply_stokes == &stokes_laplacian_mult<dim>)
+        ctx.stokes_op = make_stokes_operator<dim>(getMatElemLaplacian(h), getMatElemPressure(h), kernel_diag_block_dof(velocity_dof{}));
+      else if (ctx.apply_stokes == &stokes_strain_tensor_mult<dim>)
+        ctx.stokes_op = make_stokes_operator<dim>(getMatElemStrainTensor(h), getMatElemPressure(h), kernel_tensor_block);
+      else if (ctx.apply_stokes == &stokes_laplacian_sumfact_mult<dim>)
+        ctx.stokes_op = make_stokes_operator<dim>(getModeLaplacian(h), getMatElemPressure(h), kernel_sumfact_diag_block);
+      else if (ctx.apply_stokes == &stokes_strain_tensor_sumfact_mult<dim>)
+        ctx.stokes_op = make_stokes_operator<dim>(getModeStrainTensor(h), getMatElemPressure(h), kernel_sumfact_tensor_block);
+
+      // apply acts on the velocity of a Stokes context
+      ierr = PetscObjectTypeCompare((PetscObject)ctx.dm, DMCOMPOSITE, &iscomposite);CHKERRQ(ierr);
+      if (iscomposite)
+        PetscFunctionReturn(0);
+
+      int dof = get_dof(ctx.dm);
+
+      if (ctx.apply == &laplacian_mult<dim>)
+        ctx.op = make_diag_block_operator<dim>(dof, getMatElemLaplacian(h));
+      else if (ctx.apply == &mass_mult<dim>)
+        ctx.op = make_diag_block_operator<dim>(dof, getMatElemMass(h));
+      else if (ctx.apply == &laplacian_line_mult<dim>)
+        ctx.op = make_operator<dim>(getMatElemLaplacian(h), line_block_mult_with(kernel_line_block));
+      else if (ctx.apply == &mass_line_mult<dim>)
+        ctx.op = make_operator<dim>(getMatElemMass(h), line_block_mult_with(kernel_line_block));
+      else if (ctx.apply == &strain_tensor_mult<dim>)
+        ctx.op = make_operator<dim>(getMatElemStrainTensor(h), diag_block_mult_with(kernel_tensor_block));
+      else if (ctx.apply == &laplacian_sumfact_mult<dim>)
+        ctx.op = make_operator<dim>(getModeLaplacian(h), diag_block_mult_with(kernel_sumfact_diag_block));
+      else if (ctx.apply == &strain_tensor_sumfact_mult<dim>)
+        ctx.op = make_operator<dim>(getModeStrainTensor(h), diag_block_mult_with(kernel_sumfact_tensor_block));
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_operator"
+    template<typename CTX, typename Dimensions = typename CTX::dimension_type>
+    typename std::enable_if<(CTX::ndm_type::value>1), PetscErrorCode>::type
+    set_operator(CTX& ctx)
+    {
+      PetscFunctionBeginUser;
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "apply_operator"
+    template<typename CTX, std::size_t Dimensions>
+    PetscErrorCode apply_operator(CTX *ctx, petsc::petsc_vec<Dimensions>& x, petsc::petsc_vec<Dimensions>& y,
+                                  std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      if (ctx->op){
+        ierr = ctx->op(x, y);CHKERRQ(ierr);
+      }
+      else{
+        ierr = ctx->apply(x, y, h);CHKERRQ(ierr);
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "apply_overlapped"
+    //! Applies ctx->apply and overlaps the ghost exchanges with the
+    //! interior elements, which are computed on the global arrays:
+    //!
+    //!   x.global_to_local_begin (done by the caller)
+    //!   first half of the interior
+    //!   x.global_to_local_end
+    //!   boundary layer on the local arrays
+    //!   y.local_to_global_begin(ADD_VALUES)
+    //!   second half of the interior
+    //!   y.local_to_global_end(ADD_VALUES)
+    //!
+    //! The global part of y must be zero and its local part filled with zero.
+    template<typename CTX, std::size_t Dimensions>
+    PetscErrorCode apply_overlapped(CTX *ctx, petsc::petsc_vec<Dimensions>& x, petsc::petsc_vec<Dimensions>& y,
+                                    std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      x.set_region(element_region::interior_low);
+      y.set_region(element_region::interior_low);
+      ierr = apply_operator(ctx, x, y, h);CHKERRQ(ierr);
+
+      x.set_region(element_region::boundary);
+      y.set_region(element_region::boundary);
+      ierr = x.global_to_local_end(INSERT_VALUES);CHKERRQ(ierr);
+      ierr = apply_operator(ctx, x, y, h);CHKERRQ(ierr);
+
+      x.set_region(element_region::interior_high);
+      y.set_region(element_region::interior_high);
+      ierr = y.local_to_global_begin(ADD_VALUES);CHKERRQ(ierr);
+      ierr = apply_operator(ctx, x, y, h);CHKERRQ(ierr);
+
+      x.set_region(element_region::all);
+      y.set_region(element_region::all);
+      ierr = y.local_to_global_end(ADD_VALUES);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
     #undef __FUNCT__
     #define __FUNCT__ "diag_block_matrix"
     template<typename CTX, typename Dimensions = typename CTX::dimension_type>
@@ -52,20 +177,23 @@ namespace cafes
       ierr = MatShellGetContext(A, &ctx);CHKERRQ(ierr);
       ierr = VecSet(y, 0.);CHKERRQ(ierr);
 
-      auto xpetsc = petsc::petsc_vec<Dimensions::value>(ctx->dm, x, 0);
-      auto ypetsc = petsc::petsc_vec<Dimensions::value>(ctx->dm, y, 0, false);
-
-      ierr = xpetsc.global_to_local(INSERT_VALUES);CHKERRQ(ierr);
-      ierr = ypetsc.fill(0.);CHKERRQ(ierr);
+      auto& xpetsc = ctx->views->get(ctx->dm, 0);
+      auto& ypetsc = ctx->views->get(ctx->dm, 0, false);
+      ierr = xpetsc.attach(x);CHKERRQ(ierr);
+      ierr = ypetsc.attach(y);CHKERRQ(ierr);
 
-      ierr = ctx->apply(xpetsc, ypetsc, ctx->h);CHKERRQ(ierr);
+      ierr = xpetsc.global_to_local_begin(INSERT_VALUES);CHKERRQ(ierr);
 
-      ierr = ypetsc.local_to_global(ADD_VALUES);CHKERRQ(ierr);
+      ierr = apply_overlapped(ctx, xpetsc, ypetsc, ctx->h);CHKERRQ(ierr);
+      ierr = ypetsc.clear_local();CHKERRQ(ierr);
 
       if(ctx->set_bc_){
          ierr = SetDirichletOnVec(xpetsc, ypetsc, ctx->bc_);CHKERRQ(ierr);
       }
 
+      ierr = xpetsc.detach();CHKERRQ(ierr);
+      ierr = ypetsc.detach();CHKERRQ(ierr);
+
       PetscFunctionReturn(0);
     }
 
@@ -86,15 +214,18 @@ namespace cafes
       ierr = DMCompositeGetNumberDM(ctx->dm, &ndm);CHKERRQ(ierr);
 
       for(std::size_t i=0; i<ndm; ++i){
-        auto xpetsc = petsc::petsc_vec<Dimensions::value>(ctx->dm, x, i);
-        auto ypetsc = petsc::petsc_vec<Dimensions::value>(ctx->dm, y, i, false);
+        auto& xpetsc = ctx->views->get(ctx->dm, i);
+        auto& ypetsc = ctx->views->get(ctx->dm, i, false);
+        ierr = xpetsc.attach(x);CHKERRQ(ierr);
+        ierr = ypetsc.attach(y);CHKERRQ(ierr);
 
-        ierr = xpetsc.global_to_local(INSERT_VALUES);CHKERRQ(ierr);
-        ierr = ypetsc.fill(0.);CHKERRQ(ierr);
+        ierr = xpetsc.global_to_local_begin(INSERT_VALUES);CHKERRQ(ierr);
 
-        ierr = ctx->apply(xpetsc, ypetsc, ctx->h[i]);CHKERRQ(ierr);
+        ierr = apply_overlapped(ctx, xpetsc, ypetsc, ctx->h[i]);CHKERRQ(ierr);
+        ierr = ypetsc.clear_local();CHKERRQ(ierr);
 
-        ierr = ypetsc.local_to_global(ADD_VALUES);CHKERRQ(ierr);
+        ierr = xpetsc.detach();CHKERRQ(ierr);
+        ierr = ypetsc.detach();CHKERRQ(ierr);
       }
 
       PetscFunctionReturn(0);
@@ -113,13 +244,37 @@ namespace cafes
 
       ierr = MatShellGetContext(A, &ctx);CHKERRQ(ierr);
 
-      auto xpetsc = petsc::petsc_vec<Dimensions::value>(ctx->dm, x, 0, false);
-      ierr = xpetsc.fill(0.);CHKERRQ(ierr);
+      if (ctx->diag_->matches(*ctx)){
+        ierr = VecCopy(ctx->diag_->diag, x);CHKERRQ(ierr);
+        PetscFunctionReturn(0);
+      }
+
+      {
+        auto xpetsc = petsc::petsc_vec<Dimensions::value>(ctx->dm, x, 0, false);
+
+        // the diagonal of a single precision level is the one of its operator
+        if (ctx->single_ && ctx->single_->diag){
+          ctx->single_->y.fill(0.f);
+          ctx->single_->diag(ctx->single_->y);
+          ctx->single_->y.copy_to(xpetsc);
+        }
+        else{
+          ierr = xpetsc.fill(0.);CHKERRQ(ierr);
+          ierr = ctx->apply_diag(xpetsc, ctx->h);CHKERRQ(ierr);
+        }
+
+        ierr = xpetsc.fill_global(0.);CHKERRQ(ierr);
+        ierr = xpetsc.local_to_global(ADD_VALUES);CHKERRQ(ierr);
 
-      ierr = ctx->apply_diag(xpetsc, ctx->h);CHKERRQ(ierr);
+        if (ctx->set_bc_){
+          ierr = SetDirichletOnDiag(xpetsc, ctx->bc_);CHKERRQ(ierr);
+        }
+      }
 
-      ierr = xpetsc.fill_global(0.);CHKERRQ(ierr);
-      ierr = xpetsc.local_to_global(ADD_VALUES);CHKERRQ(ierr);
+      ierr = VecDestroy(&ctx->diag_->diag);CHKERRQ(ierr);
+      ierr = VecDuplicate(x, &ctx->diag_->diag);CHKERRQ(ierr);
+      ierr = VecCopy(x, ctx->diag_->diag);CHKERRQ(ierr);
+      ctx->diag_->set_key(*ctx);
 
       PetscFunctionReturn(0);
     }
@@ -167,28 +322,80 @@ namespace cafes
 
       using petsc_type = petsc::petsc_vec<Dimensions::value>;
 
-      std::array<petsc_type, 2> xpetsc{petsc_type(ctx->dm, x, 0),
-                                       petsc_type(ctx->dm, x, 1)};
+      std::array<petsc_type*, 2> xpetsc{{&ctx->views->get(ctx->dm, 0),
+                                        &ctx->views->get(ctx->dm, 1)}};
 
-      std::array<petsc_type, 2> ypetsc{petsc_type(ctx->dm, y, 0, false),
-                                       petsc_type(ctx->dm, y, 1, false)};
+      std::array<petsc_type*, 2> ypetsc{{&ctx->views->get(ctx->dm, 0, false),
+                                        &ctx->views->get(ctx->dm, 1, false)}};
+
+      for(std::size_t i=0; i<xpetsc.size(); ++i)
+      {
+        ierr = xpetsc[i]->attach(x);CHKERRQ(ierr);
+        ierr = ypetsc[i]->attach(y);CHKERRQ(ierr);
+        ierr = xpetsc[i]->global_to_local_begin(INSERT_VALUES);CHKERRQ(ierr);
+      }
 
+      auto apply = [&](){
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+        if (ctx->stokes_op){
+          ierr = ctx->stokes_op(*xpetsc[0], *xpetsc[1], *ypetsc[0], *ypetsc[1]);CHKERRQ(ierr);
+        }
+        else if (ctx->apply_stokes){
+          ierr = ctx->apply_stokes(*xpetsc[0], *xpetsc[1], *ypetsc[0], *ypetsc[1], ctx->h);CHKERRQ(ierr);
+        }
+        else{
+          ierr = apply_operator(ctx, *xpetsc[0], *ypetsc[0], ctx->h);CHKERRQ(ierr);
+          ierr = B_and_BT_mult(*xpetsc[0], *xpetsc[1], *ypetsc[0], *ypetsc[1], ctx->h);CHKERRQ(ierr);
+        }
+        PetscFunctionReturn(0);
+      };
+
+      auto set_region = [&](element_region region){
+        for(std::size_t i=0; i<xpetsc.size(); ++i)
+        {
+          xpetsc[i]->set_region(region);
+          ypetsc[i]->set_region(region);
+        }
+      };
+
+      // same sequence as apply_overlapped for the two fields
+      set_region(element_region::interior_low);
+      ierr = apply();CHKERRQ(ierr);
+
+      set_region(element_region::boundary);
       for(std::size_t i=0; i<xpetsc.size(); ++i)
       {
-        ierr = xpetsc[i].global_to_local(INSERT_VALUES);CHKERRQ(ierr);
-        ierr = ypetsc[i].fill(0.);CHKERRQ(ierr);
+        ierr = xpetsc[i]->global_to_local_end(INSERT_VALUES);CHKERRQ(ierr);
       }
+      ierr = apply();CHKERRQ(ierr);
 
-      ierr = ctx->apply(xpetsc[0], ypetsc[0], ctx->h);CHKERRQ(ierr);
-      ierr = B_and_BT_mult(xpetsc[0], xpetsc[1], ypetsc[0], ypetsc[1], ctx->h);CHKERRQ(ierr);
+      set_region(element_region::interior_high);
+      for(std::size_t i=0; i<xpetsc.size(); ++i)
+      {
+        ierr = ypetsc[i]->local_to_global_begin(ADD_VALUES);CHKERRQ(ierr);
+      }
+      ierr = apply();CHKERRQ(ierr);
 
+      set_region(element_region::all);
       for(std::size_t i=0; i<xpetsc.size(); ++i)
       {
-        ierr = ypetsc[i].local_to_global(ADD_VALUES);CHKERRQ(ierr);
+        ierr = ypetsc[i]->local_to_global_end(ADD_VALUES);CHKERRQ(ierr);
+      }
+
+      for(std::size_t i=0; i<ypetsc.size(); ++i)
+      {
+        ierr = ypetsc[i]->clear_local();CHKERRQ(ierr);
       }
 
       if (ctx->set_bc_){
-        ierr = SetDirichletOnVec(xpetsc[0], ypetsc[0], ctx->bc_);CHKERRQ(ierr);
+        ierr = SetDirichletOnVec(*xpetsc[0], *ypetsc[0], ctx->bc_);CHKERRQ(ierr);
+      }
+
+      for(std::size_t i=0; i<xpetsc.size(); ++i)
+      {
+        ierr = xpetsc[i]->detach();CHKERRQ(ierr);
+        ierr = ypetsc[i]->detach();CHKERRQ(ierr);
       }
 
       PetscFunctionReturn(0);
@@ -202,6 +409,7 @@ namespace cafes
       Mat A;
       int localsize, totalsize;
     
+      set_operator(*ctx);
       get_DM_sizes(ctx->dm, localsize, totalsize);
       MatCreateShell(PETSC_COMM_WORLD, localsize, localsize, totalsize, totalsize, ctx, &A);
       MatShellSetOperation(A, MATOP_MULT, (void(*)())(*method));
@@ -34,6 +34,7 @@
 #include <iostream>
 #include <array>
 #include <algorithm>
+#include <vector>
 
 namespace cafes
 {
@@ -104,6 +105,62 @@ namespace cafes
       return get_DM_bounds_(dmc[i], std::integral_constant<int, Dimensions>{}, remove_final_points);
     }
 
+    //! Parts of the local elements used to overlap the ghost exchanges
+    //! with the computation:
+    //!
+    //! - interior_low and interior_high: the two halves along the outermost
+    //!   direction of the elements which only touch owned nodes,
+    //! - boundary: the layer of elements which touch a ghost node.
+    enum class element_region { all, interior_low, interior_high, boundary };
+
+    bool is_interior(element_region region)
+    {
+      return region == element_region::interior_low || region == element_region::interior_high;
+    }
+
+    template<int Dimensions>
+    std::vector<geometry::box<int, Dimensions>> get_element_boxes(DM const& dm, element_region region)
+    {
+      auto box = get_DM_bounds<Dimensions>(dm);
+
+      if (region == element_region::all)
+        return {box};
+
+      DMDALocalInfo info;
+      DMDAGetLocalInfo(dm, &info);
+      std::array<int, 3> owned_end{{info.xs + info.xm, info.ys + info.ym, info.zs + info.zm}};
+
+      // the element i uses the nodes i and i+1
+      auto interior = box;
+      for(std::size_t d=0; d<Dimensions; ++d)
+        interior.upper_right[d] = std::max(box.bottom_left[d], std::min(box.upper_right[d], owned_end[d] - 1));
+
+      std::vector<geometry::box<int, Dimensions>> boxes;
+      std::size_t const n = Dimensions - 1;
+
+      if (region == element_region::boundary){
+        // slab d: outside of the interior in the direction d,
+        // inside in the directions > d
+        for(std::size_t d=0; d<Dimensions; ++d){
+          auto slab = box;
+          slab.bottom_left[d] = interior.upper_right[d];
+          for(std::size_t e=d+1; e<Dimensions; ++e)
+            slab.upper_right[e] = interior.upper_right[e];
+          boxes.push_back(slab);
+        }
+        return boxes;
+      }
+
+      int const middle = interior.bottom_left[n] + (interior.upper_right[n] - interior.bottom_left[n])/2;
+      if (region == element_region::interior_low)
+        interior.upper_right[n] = middle;
+      else
+        interior.bottom_left[n] = middle;
+      boxes.push_back(interior);
+
+      return boxes;
+    }
+
     std::array<int, 2> get_global_bounds_(DM const& dm, std::integral_constant<int, 2>)
     {
       DMDALocalInfo info;
@@ -0,0 +1,363 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef CAFES_FEM_MIXED_PRECISION_HPP_INCLUDED
+#define CAFES_FEM_MIXED_PRECISION_HPP_INCLUDED
+
+#include <algorithm/iterate.hpp>
+#include <fem/bc.hpp>
+#include <fem/matElem.hpp>
+#include <fem/mesh.hpp>
+#include <fem/operator.hpp>
+#include <petsc/vec.hpp>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include <petsc.h>
+
+namespace cafes
+{
+  namespace fem
+  {
+    inline float to_single(double a)
+    {
+      return static_cast<float>(a);
+    }
+
+    //! Elementary matrix in single precision.
+    template<typename T, std::size_t N>
+    auto to_single(std::array<T, N> const& a)
+    {
+      std::array<decltype(to_single(a[0])), N> b;
+      for(std::size_t i=0; i<N; ++i)
+        b[i] = to_single(a[i]);
+      return b;
+    }
+
+    //! Exchange in float of the ghost nodes of a local_array: the owned
+    //! slabs are sent to the neighbours of the DMDA and the ghost slabs
+    //! are received from them. The DMDA is a product of one dimensional
+    //! partitions, so a slab and the ghost slab which receives it have
+    //! the same shape and are iterated in the same order.
+    template<std::size_t Dimensions>
+    struct float_halo{
+      struct message{
+        PetscMPIInt rank;
+        int send_tag, recv_tag;
+        geometry::box<int, Dimensions> send, recv;
+        std::vector<float> send_buffer, recv_buffer;
+      };
+
+      MPI_Comm comm;
+      int dof;
+      std::vector<message> messages;
+
+      float_halo(DM dm)
+      {
+        DMDALocalInfo info;
+        PetscMPIInt const* ranks;
+        PetscObjectGetComm((PetscObject)dm, &comm);
+        DMDAGetLocalInfo(dm, &info);
+        DMDAGetNeighbors(dm, &ranks);
+        dof = info.dof;
+
+        std::array<int, 3> start{{info.xs, info.ys, info.zs}};
+        std::array<int, 3> end{{info.xs + info.xm, info.ys + info.ym, info.zs + info.zm}};
+        int const nneighbours = (Dimensions == 2)? 9: 27;
+
+        // the neighbour k is at the offset o with k = sum (o_d + 1) 3^d,
+        // it sends to us the message it tags with the offset -o
+        for(int k=0; k<nneighbours; ++k){
+          if (k == nneighbours/2 || ranks[k] < 0)
+            continue;
+
+          message m;
+          m.rank = ranks[k];
+          m.send_tag = k;
+          m.recv_tag = nneighbours - 1 - k;
+          int size = dof;
+          for(std::size_t d=0, k_d=k; d<Dimensions; ++d, k_d/=3){
+            switch(static_cast<int>(k_d%3) - 1){
+              case -1:
+                m.send.bottom_left[d] = start[d];     m.send.upper_right[d] = start[d] + info.sw;
+                m.recv.bottom_left[d] = start[d] - info.sw; m.recv.upper_right[d] = start[d];
+                break;
+              case 0:
+                m.send.bottom_left[d] = start[d]; m.send.upper_right[d] = end[d];
+                m.recv.bottom_left[d] = start[d]; m.recv.upper_right[d] = end[d];
+                break;
+              case 1:
+                m.send.bottom_left[d] = end[d] - info.sw; m.send.upper_right[d] = end[d];
+                m.recv.bottom_left[d] = end[d];     m.recv.upper_right[d] = end[d] + info.sw;
+                break;
+            }
+            size *= m.send.upper_right[d] - m.send.bottom_left[d];
+          }
+          m.send_buffer.resize(size);
+          m.recv_buffer.resize(size);
+          messages.push_back(std::move(m));
+        }
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "float_halo::exchange"
+      PetscErrorCode exchange(petsc::local_array<Dimensions, float>& x)
+      {
+        PetscErrorCode ierr;
+        std::vector<MPI_Request> requests(2*messages.size());
+        PetscFunctionBeginUser;
+
+        for(std::size_t i=0; i<messages.size(); ++i){
+          auto& m = messages[i];
+          ierr = MPI_Irecv(m.recv_buffer.data(), m.recv_buffer.size(), MPI_FLOAT, m.rank, m.recv_tag, comm, &requests[i]);CHKERRQ(ierr);
+        }
+
+        for(std::size_t i=0; i<messages.size(); ++i){
+          auto& m = messages[i];
+          auto p = m.send_buffer.data();
+          algorithm::iterate(m.send, [&](auto const& pos){
+            p = std::copy(x.at(pos), x.at(pos) + dof, p);
+          });
+          ierr = MPI_Isend(m.send_buffer.data(), m.send_buffer.size(), MPI_FLOAT, m.rank, m.send_tag, comm, &requests[messages.size() + i]);CHKERRQ(ierr);
+        }
+
+        ierr = MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);CHKERRQ(ierr);
+
+        for(auto& m: messages){
+          auto p = m.recv_buffer.data();
+          algorithm::iterate(m.recv, [&](auto const& pos){
+            std::copy(p, p + dof, x.at(pos));
+            p += dof;
+          });
+        }
+
+        PetscFunctionReturn(0);
+      }
+    };
+
+    //! Elements of the local part of a DMDA which touch an owned node,
+    //! including the ones of the ghost layer: the element loops of a
+    //! single precision level compute the owned values of y without any
+    //! reverse exchange.
+    template<std::size_t Dimensions>
+    auto get_owner_element_box(DM dm)
+    {
+      DMDALocalInfo info;
+      DMDAGetLocalInfo(dm, &info);
+      std::array<int, 3> start{{info.xs, info.ys, info.zs}};
+      std::array<int, 3> end{{info.xs + info.xm, info.ys + info.ym, info.zs + info.zm}};
+      std::array<int, 3> gstart{{info.gxs, info.gys, info.gzs}};
+      std::array<int, 3> gend{{info.gxs + info.gxm, info.gys + info.gym, info.gzs + info.gzm}};
+
+      // the element i uses the nodes i and i+1
+      geometry::box<int, Dimensions> box;
+      for(std::size_t d=0; d<Dimensions; ++d){
+        box.bottom_left[d] = std::max(start[d] - 1, gstart[d]);
+        box.upper_right[d] = std::min(end[d], gend[d] - 1);
+      }
+      return box;
+    }
+
+    //! Single precision part of a multigrid level: the ghosted local
+    //! vectors in float, their ghost exchange in float and the operator
+    //! and its diagonal applied on them with the elementary matrices in
+    //! float (see set_single_precision).
+    template<std::size_t Dimensions>
+    struct single_precision_level{
+      using array_type = petsc::local_array<Dimensions, float>;
+
+      array_type x, y;
+      float_halo<Dimensions> halo;
+      std::function<void(array_type const&, array_type&)> op;
+      std::function<void(array_type&)> diag;
+      dirichlet_conditions<Dimensions> bc_{};
+      bool set_bc_ = false;
+
+      single_precision_level(DM dm): x{dm}, y{dm}, halo{dm}
+      {}
+
+      #undef __FUNCT__
+      #define __FUNCT__ "single_precision_level::mult"
+      //! y = A x on the owned nodes, x being given on the owned nodes.
+      //! The Dirichlet rows are rows of the identity.
+      PetscErrorCode mult()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        ierr = halo.exchange(x);CHKERRQ(ierr);
+        y.fill(0.f);
+        op(x, y);
+
+        if (set_bc_){
+          for(auto const& face: get_dirichlet_boxes<Dimensions>(x.dm_)){
+            auto const& conditions = bc_.conditions_[face.second];
+            algorithm::iterate(face.first, [&](auto const& pos){
+              auto ux = x.at(pos);
+              auto uy = y.at(pos);
+              for(int i=0; i<x.dof_; ++i)
+                if (conditions[i%Dimensions])
+                  uy[i] = ux[i];
+            });
+          }
+        }
+
+        PetscFunctionReturn(0);
+      }
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "copy_owned"
+    //! Copies the owned values of a global vector of the DMDA of a to a,
+    //! or of a to the global vector if to_vec is set.
+    template<std::size_t Dimensions>
+    PetscErrorCode copy_owned(Vec v, petsc::local_array<Dimensions, float>& a, bool to_vec=false)
+    {
+      PetscErrorCode ierr;
+      DMDALocalInfo info;
+      petsc::strided_array<Dimensions> av;
+      PetscFunctionBeginUser;
+
+      ierr = DMDAGetLocalInfo(a.dm_, &info);CHKERRQ(ierr);
+      av.set_layout({{info.xs, info.ys, info.zs}}, {{info.xm, info.ym, info.zm}}, info.dof);
+      ierr = VecGetArray(v, &av.data_);CHKERRQ(ierr);
+
+      int const dof = info.dof;
+      auto box = get_DM_bounds<Dimensions>(a.dm_, false);
+      if (to_vec)
+        algorithm::iterate(box, [&](auto const& pos){
+          std::copy(a.at(pos), a.at(pos) + dof, av.at(pos));
+        });
+      else
+        algorithm::iterate(box, [&](auto const& pos){
+          std::transform(av.at(pos), av.at(pos) + dof, a.at(pos), [](PetscScalar u){return static_cast<float>(u);});
+        });
+
+      ierr = VecRestoreArray(v, &av.data_);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    template<std::size_t Dimensions, typename MatElem, typename Function>
+    auto make_single_operator(MatElem const& matelem, Function&& kernel)
+    {
+      using array_type = typename single_precision_level<Dimensions>::array_type;
+      auto m = to_single(matelem);
+      return [m, kernel](array_type const& x, array_type& y){
+        algorithm::iterate_parallel(get_owner_element_box<Dimensions>(x.dm_), kernel(x, y, m));
+      };
+    }
+
+    template<std::size_t Dimensions, typename MatElem>
+    auto make_single_diag(MatElem const& matelem)
+    {
+      using array_type = typename single_precision_level<Dimensions>::array_type;
+      auto m = to_single(matelem);
+      return [m](array_type& x){
+        for(auto const& box: get_element_boxes<Dimensions>(x.dm_, x.region_))
+          algorithm::iterate_parallel(box, kernel_diag_diag_block(x, m));
+      };
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_single_precision"
+    //! Creates ctx.single_ on ctx.dm with the single precision version of
+    //! ctx.apply and ctx.apply_diag. The line and sum-factorized variants
+    //! use the element by element kernels, which only need at() on the
+    //! vectors.
+    template<typename CTX, typename Dimensions = typename CTX::dimension_type>
+    PetscErrorCode set_single_precision(CTX& ctx)
+    {
+      constexpr std::size_t dim = Dimensions::value;
+      using velocity_dof = std::integral_constant<std::size_t, dim>;
+      PetscFunctionBeginUser;
+
+      auto const& h = ctx.h;
+      auto level = std::make_shared<single_precision_level<dim>>(ctx.dm);
+
+      // a batch of velocities has a multiple of dim dof
+      bool const batched = get_dof(ctx.dm) != dim;
+
+      if ((ctx.apply == &laplacian_mult<dim> ||
+           ctx.apply == &laplacian_line_mult<dim> ||
+           ctx.apply == &laplacian_sumfact_mult<dim>) && batched)
+        level->op = make_single_operator<dim>(getMatElemLaplacian(h), kernel_diag_block);
+      else if (ctx.apply == &laplacian_mult<dim> ||
+               ctx.apply == &laplacian_line_mult<dim> ||
+               ctx.apply == &laplacian_sumfact_mult<dim>)
+        level->op = make_single_operator<dim>(getMatElemLaplacian(h), kernel_diag_block_dof(velocity_dof{}));
+      else if (ctx.apply == &strain_tensor_mult<dim> ||
+               ctx.apply == &strain_tensor_sumfact_mult<dim>)
+        level->op = make_single_operator<dim>(getMatElemStrainTensor(h), kernel_tensor_block);
+      else if (ctx.apply == &batch_strain_tensor_mult<dim>)
+        level->op = make_single_operator<dim>(getMatElemStrainTensor(h), kernel_batch_tensor_block);
+      else if (ctx.apply == &mass_mult<dim> ||
+               ctx.apply == &mass_line_mult<dim>)
+        level->op = make_single_operator<dim>(getMatElemMass(h), kernel_diag_block);
+      else
+        SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_SUP, "no single precision version of this operator");
+
+      if (ctx.apply_diag == &diag_laplacian_mult<dim>)
+        level->diag = make_single_diag<dim>(getMatElemLaplacian(h));
+      else if (ctx.apply_diag == &diag_mass_mult<dim>)
+        level->diag = make_single_diag<dim>(getMatElemMass(h));
+
+      level->bc_ = ctx.bc_;
+      level->set_bc_ = ctx.set_bc_;
+      ctx.single_ = level;
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "single_precision_matrix"
+    //! MATOP_MULT of a single precision level: the owned values of x are
+    //! converted once to float, the ghost exchange and the element loops
+    //! are done in float and the owned values of y are written back. No
+    //! local vector in double is used.
+    template<typename CTX, typename Dimensions = typename CTX::dimension_type>
+    PetscErrorCode single_precision_matrix(Mat A, Vec x, Vec y)
+    {
+      CTX *ctx;
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = MatShellGetContext(A, &ctx);CHKERRQ(ierr);
+
+      auto& level = *ctx->single_;
+      ierr = copy_owned(x, level.x);CHKERRQ(ierr);
+      ierr = level.mult();CHKERRQ(ierr);
+      ierr = copy_owned(y, level.y, true);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+  }
+}
+#endif
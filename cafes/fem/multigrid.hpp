@@ -0,0 +1,397 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef CAFES_FEM_MULTIGRID_HPP_INCLUDED
+#define CAFES_FEM_MULTIGRID_HPP_INCLUDED
+
+#include <problem/context.hpp>
+#include <fem/assembly.hpp>
+#include <fem/matrixFree.hpp>
+#include <fem/mixed_precision.hpp>
+#include <fem/smoother.hpp>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+#include <petsc.h>
+
+namespace cafes
+{
+  namespace fem
+  {
+    //! Number of elements of a DMDA in each direction.
+    template<std::size_t Dimensions>
+    std::array<PetscInt, Dimensions> get_nelem(DM dm)
+    {
+      PetscInt M[3];
+      DMBoundaryType bd[3];
+
+      DMDAGetInfo(dm, nullptr, &M[0], &M[1], &M[2], nullptr, nullptr, nullptr,
+                  nullptr, nullptr, &bd[0], &bd[1], &bd[2], nullptr);
+
+      std::array<PetscInt, Dimensions> nelem;
+      for(std::size_t d=0; d<Dimensions; ++d)
+        nelem[d] = (bd[d] == DM_BOUNDARY_PERIODIC)? M[d]: M[d] - 1;
+      return nelem;
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "get_mg_levels"
+    //! Number of levels of the geometric hierarchy built on the pressure
+    //! DMDA: the number of elements is halved, rounded up, while the coarse
+    //! grid keeps at least 2 elements per process in each direction. The
+    //! velocity grid has twice as many elements, so it can be coarsened as
+    //! many times.
+    template<std::size_t Dimensions>
+    PetscErrorCode get_mg_levels(DM dap, PetscInt& nlevels)
+    {
+      PetscErrorCode ierr;
+      PetscInt procs[3];
+      PetscFunctionBeginUser;
+
+      ierr = DMDAGetInfo(dap, nullptr, nullptr, nullptr, nullptr, &procs[0], &procs[1], &procs[2],
+                         nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);CHKERRQ(ierr);
+
+      auto nelem = get_nelem<Dimensions>(dap);
+
+      nlevels = 1;
+      while(true){
+        bool coarsen = true;
+        for(std::size_t d=0; d<Dimensions; ++d)
+          coarsen = coarsen && (nelem[d] + 1)/2 >= 2*procs[d];
+        if (!coarsen)
+          break;
+        for(auto& n: nelem)
+          n = (n + 1)/2;
+        nlevels++;
+      }
+
+      if (nlevels == 1){
+        ierr = PetscInfo(dap, "The grid is too small to be coarsened: one multigrid level\n");CHKERRQ(ierr);
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    //! Geometric hierarchy of a field: the DMDA of each level (0 is the
+    //! coarsest), the Q1 interpolation from the level l-1 to the level l
+    //! and the ratio between the step of the level and the fine step.
+    template<std::size_t Dimensions>
+    struct mg_hierarchy{
+      std::vector<DM> dm;
+      std::vector<Mat> interpolation;
+      std::vector<std::array<double, Dimensions>> scale;
+    };
+
+    //! Ownership ranges of the coarse grid: a process owns the coarse nodes
+    //! whose position is in the range of its fine nodes, so that the
+    //! coarse nodes used to interpolate its fine nodes are local or ghost.
+    inline std::vector<PetscInt> coarse_ownership_ranges(PetscInt const* lf, PetscInt nprocs,
+                                                         PetscInt nelem_f, PetscInt nelem_c, PetscInt Mc)
+    {
+      std::vector<PetscInt> lc(nprocs);
+      PetscInt start_f = 0, start_c = 0;
+      for(PetscInt p=0; p<nprocs; ++p){
+        start_f += lf[p];
+        PetscInt end_c = (p == nprocs-1)? Mc: (start_f*nelem_c + nelem_f - 1)/nelem_f;
+        lc[p] = end_c - start_c;
+        start_c = end_c;
+      }
+      return lc;
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "create_coarse_dmda"
+    //! Coarse DMDA with (n+1)/2 elements in each direction for n elements
+    //! on fine. The grids are not nested when n is odd.
+    template<std::size_t Dimensions>
+    PetscErrorCode create_coarse_dmda(DM fine, DM* coarse)
+    {
+      PetscErrorCode ierr;
+      PetscInt M[3], procs[3], dof, sw;
+      DMBoundaryType bd[3];
+      DMDAStencilType st;
+      PetscInt const *lf[3] = {nullptr, nullptr, nullptr};
+      PetscFunctionBeginUser;
+
+      ierr = DMDAGetInfo(fine, nullptr, &M[0], &M[1], &M[2], &procs[0], &procs[1], &procs[2],
+                         &dof, &sw, &bd[0], &bd[1], &bd[2], &st);CHKERRQ(ierr);
+      ierr = DMDAGetOwnershipRanges(fine, &lf[0], &lf[1], &lf[2]);CHKERRQ(ierr);
+
+      auto nelem = get_nelem<Dimensions>(fine);
+      std::array<PetscInt, Dimensions> Mc;
+      std::array<std::vector<PetscInt>, Dimensions> lc;
+      for(std::size_t d=0; d<Dimensions; ++d){
+        PetscInt nelem_c = (nelem[d] + 1)/2;
+        Mc[d] = (bd[d] == DM_BOUNDARY_PERIODIC)? nelem_c: nelem_c + 1;
+        lc[d] = coarse_ownership_ranges(lf[d], procs[d], nelem[d], nelem_c, Mc[d]);
+        for(auto n: lc[d])
+          if (n < 1)
+            SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_ARG_OUTOFRANGE, "A process has no node on the coarse grid");
+      }
+
+      if (Dimensions == 2){
+        ierr = DMDACreate2d(PetscObjectComm((PetscObject)fine), bd[0], bd[1], st,
+                            Mc[0], Mc[1], procs[0], procs[1],
+                            dof, sw, lc[0].data(), lc[1].data(), coarse);CHKERRQ(ierr);
+      }
+      else{
+        ierr = DMDACreate3d(PetscObjectComm((PetscObject)fine), bd[0], bd[1], bd[2], st,
+                            Mc[0], Mc[1], Mc[Dimensions-1], procs[0], procs[1], procs[2],
+                            dof, sw, lc[0].data(), lc[1].data(), lc[Dimensions-1].data(), coarse);CHKERRQ(ierr);
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "create_q1_interpolation"
+    //! Q1 interpolation from coarse to fine when the grids are not nested:
+    //! the fine node i is at i nc/nf in the coarse nodes, nc and nf being
+    //! the numbers of elements, and takes the values of the corners of the
+    //! coarse element around it with the Q1 weights.
+    template<std::size_t Dimensions>
+    PetscErrorCode create_q1_interpolation(DM coarse, DM fine, Mat* P)
+    {
+      PetscErrorCode ierr;
+      ISLocalToGlobalMapping ltog_c, ltog_f;
+      assembler<Dimensions> a;
+      DMDALocalInfo info_f, info_c;
+      PetscFunctionBeginUser;
+
+      ierr = DMDAGetLocalInfo(fine, &info_f);CHKERRQ(ierr);
+      ierr = DMDAGetLocalInfo(coarse, &info_c);CHKERRQ(ierr);
+
+      PetscInt const nrows = info_f.dof*info_f.xm*info_f.ym*info_f.zm;
+      PetscInt const ncols = info_c.dof*info_c.xm*info_c.ym*info_c.zm;
+      ierr = MatCreateAIJ(PetscObjectComm((PetscObject)fine), nrows, ncols, PETSC_DETERMINE, PETSC_DETERMINE,
+                          1<<Dimensions, nullptr, 1<<Dimensions, nullptr, P);CHKERRQ(ierr);
+
+      ierr = DMGetLocalToGlobalMapping(fine, &ltog_f);CHKERRQ(ierr);
+      ierr = DMGetLocalToGlobalMapping(coarse, &ltog_c);CHKERRQ(ierr);
+      ierr = a.add_field(fine, ltog_f);CHKERRQ(ierr);
+      ierr = a.add_field(coarse, ltog_c);CHKERRQ(ierr);
+
+      auto nelem_f = get_nelem<Dimensions>(fine);
+      auto nelem_c = get_nelem<Dimensions>(coarse);
+
+      auto box = get_DM_bounds<Dimensions>(fine, false);
+      algorithm::iterate(box, [&](auto const& pos){
+        std::array<PetscInt, Dimensions> j;
+        std::array<double, Dimensions> w;
+        for(std::size_t d=0; d<Dimensions; ++d){
+          j[d] = pos[d]*nelem_c[d]/nelem_f[d];
+          w[d] = static_cast<double>(pos[d]*nelem_c[d] - j[d]*nelem_f[d])/nelem_f[d];
+        }
+
+        for(std::size_t k=0; k<(1<<Dimensions); ++k){
+          geometry::position<int, Dimensions> corner;
+          double weight = 1.;
+          for(std::size_t d=0; d<Dimensions; ++d){
+            corner[d] = j[d] + ((k>>d)&1);
+            weight *= ((k>>d)&1)? w[d]: 1. - w[d];
+          }
+          if (weight == 0.)
+            continue;
+
+          for(int c=0; c<info_f.dof; ++c){
+            PetscInt row = a.index(0, pos, c);
+            PetscInt col = a.index(1, corner, c);
+            MatSetValues(*P, 1, &row, 1, &col, &weight, INSERT_VALUES);
+          }
+        }
+      });
+
+      ierr = MatAssemblyBegin(*P, MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+      ierr = MatAssemblyEnd(*P, MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+      ierr = a.restore();CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "create_mg_hierarchy"
+    //! The levels where the number of elements is even in each direction
+    //! are built by DMCoarsen and DMCreateInterpolation, the others by
+    //! create_coarse_dmda and create_q1_interpolation.
+    template<std::size_t Dimensions>
+    PetscErrorCode create_mg_hierarchy(DM dm, PetscInt nlevels, mg_hierarchy<Dimensions>& hierarchy)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      hierarchy.dm.resize(nlevels);
+      hierarchy.interpolation.resize(nlevels, nullptr);
+      hierarchy.scale.resize(nlevels);
+
+      ierr = PetscObjectReference((PetscObject)dm);CHKERRQ(ierr);
+      hierarchy.dm[nlevels-1] = dm;
+      auto nelem_fine = get_nelem<Dimensions>(dm);
+
+      for(PetscInt l=nlevels-1; l>0; --l){
+        DM fine = hierarchy.dm[l];
+        auto nelem = get_nelem<Dimensions>(fine);
+        bool nested = std::all_of(nelem.begin(), nelem.end(), [](auto n){return n%2 == 0;});
+
+        if (nested){
+          ierr = DMCoarsen(fine, PetscObjectComm((PetscObject)fine), &hierarchy.dm[l-1]);CHKERRQ(ierr);
+          ierr = DMCreateInterpolation(hierarchy.dm[l-1], fine, &hierarchy.interpolation[l], nullptr);CHKERRQ(ierr);
+        }
+        else{
+          ierr = create_coarse_dmda<Dimensions>(fine, &hierarchy.dm[l-1]);CHKERRQ(ierr);
+          ierr = create_q1_interpolation<Dimensions>(hierarchy.dm[l-1], fine, &hierarchy.interpolation[l]);CHKERRQ(ierr);
+        }
+      }
+
+      for(PetscInt l=0; l<nlevels; ++l){
+        auto nelem = get_nelem<Dimensions>(hierarchy.dm[l]);
+        for(std::size_t d=0; d<Dimensions; ++d)
+          hierarchy.scale[l][d] = static_cast<double>(nelem_fine[d])/nelem[d];
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "destroy_mg_hierarchy"
+    template<std::size_t Dimensions>
+    PetscErrorCode destroy_mg_hierarchy(mg_hierarchy<Dimensions>& hierarchy)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      for(auto& dm: hierarchy.dm){
+        ierr = DMDestroy(&dm);CHKERRQ(ierr);
+      }
+      for(auto& P: hierarchy.interpolation){
+        ierr = MatDestroy(&P);CHKERRQ(ierr);
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "destroy_level_matrix"
+    //! The context of a multigrid level belongs to its operator.
+    template<typename CTX>
+    PetscErrorCode destroy_level_matrix(Mat A)
+    {
+      PetscErrorCode ierr;
+      CTX *ctx;
+      PetscFunctionBeginUser;
+
+      ierr = MatShellGetContext(A, &ctx);CHKERRQ(ierr);
+      delete ctx;
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_mg_hierarchy"
+    //! Sets a geometric multigrid on pc for the field of ctx built on dm:
+    //!  - the operator of each level is matrix-free with a copy of ctx
+    //!    (same operator and Dirichlet conditions) on the DMDA and the step
+    //!    of the level,
+    //!  - the coarsest level is assembled by assemble(dm, h, &A) and solved
+    //!    redundantly with LU,
+    //!  - if single_precision is set, the operators and the diagonals of the
+    //!    other levels are applied in float (see set_single_precision).
+    //! With one level the fine grid is not factorized: it is only smoothed
+    //! with its matrix-free operator.
+    template<typename CTX, typename Assemble>
+    PetscErrorCode set_mg_hierarchy(PC pc, DM dm, PetscInt nlevels, CTX const& ctx, Assemble&& assemble,
+                                    smoother_type smoother, PetscBool estimate,
+                                    PetscBool single_precision=PETSC_FALSE)
+    {
+      constexpr std::size_t dim = CTX::dimension_type::value;
+      PetscErrorCode ierr;
+      mg_hierarchy<dim> hierarchy;
+      KSP ksp;
+      PC pc_coarse;
+      Mat A;
+      PetscFunctionBeginUser;
+
+      ierr = create_mg_hierarchy(dm, nlevels, hierarchy);CHKERRQ(ierr);
+
+      ierr = PCSetType(pc, PCMG);CHKERRQ(ierr);
+      ierr = PCMGSetLevels(pc, nlevels, nullptr);CHKERRQ(ierr);
+
+      if (nlevels == 1){
+        ierr = PetscInfo(pc, "One multigrid level: the fine grid is smoothed, not factorized\n");CHKERRQ(ierr);
+      }
+
+      for(PetscInt l=0; l<nlevels; ++l){
+        auto h = ctx.h;
+        for(std::size_t d=0; d<dim; ++d)
+          h[d] *= hierarchy.scale[l][d];
+
+        if (l == 0 && nlevels > 1){
+          ierr = assemble(hierarchy.dm[0], h, &A);CHKERRQ(ierr);
+          ierr = PCMGGetCoarseSolve(pc, &ksp);CHKERRQ(ierr);
+          ierr = KSPSetOperators(ksp, A, A);CHKERRQ(ierr);
+          ierr = KSPSetType(ksp, KSPPREONLY);CHKERRQ(ierr);
+          ierr = KSPGetPC(ksp, &pc_coarse);CHKERRQ(ierr);
+          ierr = PCSetType(pc_coarse, PCREDUNDANT);CHKERRQ(ierr);
+        }
+        else{
+          auto *level_ctx = new CTX(ctx);
+          level_ctx->dm = hierarchy.dm[l];
+          level_ctx->h = h;
+          level_ctx->views = std::make_shared<petsc::petsc_vec_cache<dim>>();
+          level_ctx->diag_ = std::make_shared<problem::diagonal_cache>();
+          level_ctx->single_ = nullptr;
+
+          if (single_precision){
+            ierr = set_single_precision(*level_ctx);CHKERRQ(ierr);
+            A = make_matrix<CTX>(level_ctx, single_precision_matrix<CTX>);
+          }
+          else
+            A = make_matrix<CTX>(level_ctx);
+          ierr = MatShellSetOperation(A, MATOP_DESTROY, (void(*)())destroy_level_matrix<CTX>);CHKERRQ(ierr);
+          ierr = MatSetDM(A, hierarchy.dm[l]);CHKERRQ(ierr);
+
+          ierr = PCMGGetSmoother(pc, l, &ksp);CHKERRQ(ierr);
+          ierr = KSPSetOperators(ksp, A, A);CHKERRQ(ierr);
+          ierr = set_level_smoother(ksp, *level_ctx, smoother, estimate);CHKERRQ(ierr);
+          if (l > 0){
+            ierr = PCMGSetInterpolation(pc, l, hierarchy.interpolation[l]);CHKERRQ(ierr);
+          }
+        }
+
+        ierr = KSPSetDM(ksp, hierarchy.dm[l]);CHKERRQ(ierr);
+        ierr = KSPSetDMActive(ksp, PETSC_FALSE);CHKERRQ(ierr);
+        ierr = MatDestroy(&A);CHKERRQ(ierr);
+      }
+
+      ierr = destroy_mg_hierarchy(hierarchy);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+  }
+}
+#endif
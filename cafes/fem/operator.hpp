@@ -33,11 +33,15 @@
 #include <fem/matElem.hpp>
 #include <fem/mesh.hpp>
 #include <fem/quadrature.hpp>
+#include <fem/simd.hpp>
 #include <particle/geometry/position.hpp>
 #include <petsc/vec.hpp>
 #include <array>
 #include <cmath>
+#include <functional>
 #include <iostream>
+#include <tuple>
+#include <type_traits>
 #include <petsc.h>
 
 namespace cafes
@@ -62,10 +66,47 @@ namespace cafes
       return kernel_pos;
     };
 
+    //! kernel_diag_block for a number of dof known at compile time:
+    //! kernel_diag_block_dof(std::integral_constant<std::size_t, Dof>{})
+    //! has the same arguments as kernel_diag_block. The terms are added in
+    //! the same order, the values of y are only stored once per node.
+    auto const kernel_diag_block_dof = [](auto ndof){
+      return [](auto const& x, auto& y, auto const& matelem){
+        auto const kernel_pos = [&](auto const& pos){
+          auto const ielem = get_element(pos);
+          constexpr std::size_t nbasis = std::tuple_size<decltype(ielem)>::value;
+          constexpr std::size_t dof = decltype(ndof)::value;
+
+          std::array<std::array<double, dof>, nbasis> ux;
+          for(std::size_t k=0; k<nbasis; ++k){
+            auto u = x.at(ielem[k]);
+            for(std::size_t d=0; d<dof; ++d)
+              ux[k][d] = u[d];
+          }
+
+          for(std::size_t k1=0; k1<nbasis; ++k1){
+            auto uy = y.at(ielem[k1]);
+            std::array<double, dof> acc;
+            for(std::size_t d=0; d<dof; ++d)
+              acc[d] = uy[d];
+            for(std::size_t k2=0; k2<nbasis; ++k2)
+              for(std::size_t d=0; d<dof; ++d)
+                acc[d] += ux[k2][d]*matelem[k1][k2];
+            for(std::size_t d=0; d<dof; ++d)
+              uy[d] = acc[d];
+          }
+        };
+        return kernel_pos;
+      };
+    };
+
+    //! The velocity has one dof per dimension, the loops have compile
+    //! time bounds.
     auto const kernel_tensor_block = [](auto const& x, auto& y, auto const& matelem){
       auto const kernel_pos = [&](auto const& pos){
         auto const ielem = get_element(pos);
-        auto const nbasis = ielem.size();
+        constexpr std::size_t nbasis = std::tuple_size<decltype(ielem)>::value;
+        constexpr std::size_t dof = std::decay_t<decltype(pos)>::dimensions;
 
         for(std::size_t k1=0; k1<nbasis; ++k1)
         {
@@ -73,9 +114,9 @@ namespace cafes
           for(std::size_t k2=0; k2<nbasis; ++k2)
           {
             auto ux = x.at(ielem[k2]);
-            for(std::size_t d1=0; d1<x.dof_; ++d1)
+            for(std::size_t d1=0; d1<dof; ++d1)
             {
-              for(std::size_t d2=0; d2<x.dof_; ++d2)
+              for(std::size_t d2=0; d2<dof; ++d2)
               {
                 uy[d1] += ux[d2]*matelem[k1][k2][d1][d2];
               }
@@ -105,8 +146,9 @@ namespace cafes
       auto const kernel_pos = [&](auto const& pos){
         auto const ielem_p = get_element(pos);
         auto const ielem_v = get_element_4Q1(pos);
-        auto const nbasis_p = ielem_p.size();
-        auto const nbasis_v = ielem_v.size();
+        constexpr std::size_t nbasis_p = std::tuple_size<decltype(ielem_p)>::value;
+        constexpr std::size_t nbasis_v = std::tuple_size<decltype(ielem_v)>::value;
+        constexpr std::size_t dof = std::decay_t<decltype(pos)>::dimensions;
 
         for(std::size_t ie_v=0; ie_v<nbasis_v; ++ie_v){
           auto ux = x1.at(ielem_v[ie_v]);
@@ -114,7 +156,7 @@ namespace cafes
           for(std::size_t ie_p=0; ie_p<nbasis_p; ++ie_p){
             auto uxp = x2.at(ielem_p[ie_p]);
             auto uyp = y2.at(ielem_p[ie_p]);
-            for(std::size_t d=0; d<x1.dof_; ++d){
+            for(std::size_t d=0; d<dof; ++d){
               uyp[0] += ux[d]*matelem[ie_p][ie_v][d];
               uy[d] -= uxp[0]*matelem[ie_p][ie_v][d];
             }
@@ -124,6 +166,231 @@ namespace cafes
       return kernel_pos;
     };
 
+    //! In place transform of the values of the nodes of a Q1 element to
+    //! their sums and differences in each direction. It is its own inverse
+    //! up to a factor N.
+    template<std::size_t N>
+    void element_transform(std::array<double, N>& v)
+    {
+      for(std::size_t bit=1; bit<N; bit<<=1)
+        for(std::size_t m=0; m<N; ++m)
+          if (!(m & bit))
+          {
+            double const a = v[m], b = v[m|bit];
+            v[m] = a + b;
+            v[m|bit] = a - b;
+          }
+    }
+
+    //! Sum-factorized version of kernel_diag_block: the elementary matrix is
+    //! diagonal in the transformed basis (see getModeLaplacian).
+    auto const kernel_sumfact_diag_block = [](auto const& x, auto& y, auto const& modes){
+      auto const kernel_pos = [&](auto const& pos){
+        auto const ielem = get_element(pos);
+        constexpr std::size_t nbasis = std::tuple_size<decltype(ielem)>::value;
+
+        std::array<double const*, nbasis> ux;
+        std::array<double*, nbasis> uy;
+        for(std::size_t k=0; k<nbasis; ++k){
+          ux[k] = x.at(ielem[k]);
+          uy[k] = y.at(ielem[k]);
+        }
+
+        for(std::size_t d=0; d<x.dof_; ++d){
+          std::array<double, nbasis> v;
+          for(std::size_t k=0; k<nbasis; ++k)
+            v[k] = ux[k][d];
+          element_transform(v);
+          for(std::size_t k=0; k<nbasis; ++k)
+            v[k] *= modes[k];
+          element_transform(v);
+          for(std::size_t k=0; k<nbasis; ++k)
+            uy[k][d] += v[k];
+        }
+      };
+      return kernel_pos;
+    };
+
+    //! Sum-factorized version of kernel_tensor_block (see getModeStrainTensor).
+    auto const kernel_sumfact_tensor_block = [](auto const& x, auto& y, auto const& modes){
+      auto const kernel_pos = [&](auto const& pos){
+        auto const ielem = get_element(pos);
+        constexpr std::size_t nbasis = std::tuple_size<decltype(ielem)>::value;
+        constexpr std::size_t dim = std::decay_t<decltype(pos)>::dimensions;
+
+        std::array<std::array<double, nbasis>, dim> v, w;
+        for(std::size_t k=0; k<nbasis; ++k){
+          auto ux = x.at(ielem[k]);
+          for(std::size_t d=0; d<dim; ++d)
+            v[d][k] = ux[d];
+        }
+        for(std::size_t d=0; d<dim; ++d)
+          element_transform(v[d]);
+
+        for(std::size_t d1=0; d1<dim; ++d1){
+          for(std::size_t m=0; m<nbasis; ++m)
+            w[d1][m] = modes[d1][d1][m]*v[d1][m];
+          for(std::size_t d2=0; d2<dim; ++d2){
+            if (d2 == d1)
+              continue;
+            std::size_t const flip = (1<<d1) | (1<<d2);
+            for(std::size_t m=0; m<nbasis; ++m)
+              w[d1][m] += modes[d1][d2][m]*v[d2][m ^ flip];
+          }
+          element_transform(w[d1]);
+        }
+
+        for(std::size_t k=0; k<nbasis; ++k){
+          auto uy = y.at(ielem[k]);
+          for(std::size_t d=0; d<dim; ++d)
+            uy[d] += w[d][k];
+        }
+      };
+      return kernel_pos;
+    };
+
+    //! Fused Stokes kernel: pos is a pressure element. The viscous kernel
+    //! is applied on the 2^Dimensions velocity elements of the 4Q1 patch and
+    //! then the divergence and the gradient, so that the velocity values of
+    //! the patch are read only once.
+    auto const kernel_stokes_block = [](auto const& x1, auto const& x2, auto& y1, auto& y2,
+                                        auto const& matelem_u, auto const& matelem_p, auto const& kernel_u){
+      auto const kernel_u_pos = kernel_u(x1, y1, matelem_u);
+      auto const kernel_p_pos = kernel_off_diag_block(x1, x2, y1, y2, matelem_p);
+      auto const kernel_pos = [=](auto const& pos){
+        auto const ielem = get_element(pos);
+
+        for(std::size_t k=0; k<ielem.size(); ++k){
+          auto pos_u = pos;
+          for(std::size_t d=0; d<pos.dimensions; ++d)
+            pos_u[d] += ielem[k][d];
+          kernel_u_pos(pos_u);
+        }
+        kernel_p_pos(pos);
+      };
+      return kernel_pos;
+    };
+
+    //! Batched kernels: the dof of a node are the values of nbatch
+    //! interleaved vectors (Dimensions components for the velocity, one for
+    //! the pressure), so that the elementary matrices and the indices of an
+    //! element are shared by the nbatch products. kernel_diag_block and
+    //! kernel_sumfact_diag_block already loop over all the dof.
+    auto const kernel_batch_tensor_block = [](auto const& x, auto& y, auto const& matelem){
+      auto const kernel_pos = [&](auto const& pos){
+        auto const ielem = get_element(pos);
+        constexpr std::size_t nbasis = std::tuple_size<decltype(ielem)>::value;
+        constexpr std::size_t dof = std::decay_t<decltype(pos)>::dimensions;
+        std::size_t const nbatch = x.dof_/dof;
+
+        for(std::size_t k1=0; k1<nbasis; ++k1)
+        {
+          auto uy = y.at(ielem[k1]);
+          for(std::size_t k2=0; k2<nbasis; ++k2)
+          {
+            auto ux = x.at(ielem[k2]);
+            for(std::size_t b=0; b<nbatch; ++b)
+              for(std::size_t d1=0; d1<dof; ++d1)
+                for(std::size_t d2=0; d2<dof; ++d2)
+                  uy[b*dof + d1] += ux[b*dof + d2]*matelem[k1][k2][d1][d2];
+          }
+        }
+      };
+      return kernel_pos;
+    };
+
+    auto const kernel_batch_off_diag_block = [](auto const& x1, auto const& x2, auto& y1, auto& y2, auto const& matelem){
+      auto const kernel_pos = [&](auto const& pos){
+        auto const ielem_p = get_element(pos);
+        auto const ielem_v = get_element_4Q1(pos);
+        constexpr std::size_t nbasis_p = std::tuple_size<decltype(ielem_p)>::value;
+        constexpr std::size_t nbasis_v = std::tuple_size<decltype(ielem_v)>::value;
+        constexpr std::size_t dof = std::decay_t<decltype(pos)>::dimensions;
+        std::size_t const nbatch = x2.dof_;
+
+        for(std::size_t ie_v=0; ie_v<nbasis_v; ++ie_v){
+          auto ux = x1.at(ielem_v[ie_v]);
+          auto uy = y1.at(ielem_v[ie_v]);
+          for(std::size_t ie_p=0; ie_p<nbasis_p; ++ie_p){
+            auto uxp = x2.at(ielem_p[ie_p]);
+            auto uyp = y2.at(ielem_p[ie_p]);
+            for(std::size_t b=0; b<nbatch; ++b)
+              for(std::size_t d=0; d<dof; ++d){
+                uyp[b] += ux[b*dof + d]*matelem[ie_p][ie_v][d];
+                uy[b*dof + d] -= uxp[b]*matelem[ie_p][ie_v][d];
+              }
+          }
+        }
+      };
+      return kernel_pos;
+    };
+
+    //! kernel_stokes_block on batched vectors.
+    auto const kernel_batch_stokes_block = [](auto const& x1, auto const& x2, auto& y1, auto& y2,
+                                              auto const& matelem_u, auto const& matelem_p, auto const& kernel_u){
+      auto const kernel_u_pos = kernel_u(x1, y1, matelem_u);
+      auto const kernel_p_pos = kernel_batch_off_diag_block(x1, x2, y1, y2, matelem_p);
+      auto const kernel_pos = [=](auto const& pos){
+        auto const ielem = get_element(pos);
+
+        for(std::size_t k=0; k<ielem.size(); ++k){
+          auto pos_u = pos;
+          for(std::size_t d=0; d<pos.dimensions; ++d)
+            pos_u[d] += ielem[k][d];
+          kernel_u_pos(pos_u);
+        }
+        kernel_p_pos(pos);
+      };
+      return kernel_pos;
+    };
+
+    //! x-line version of kernel_diag_block: pos is the first element of a
+    //! line of nelem elements. For each output line of nodes, the
+    //! contributions of the left element and then of the right element are
+    //! accumulated in the same order as kernel_diag_block, which gives bit
+    //! identical results. The dof of a node are contiguous in the DMDA
+    //! local array so a line of nodes is a contiguous array of doubles.
+    auto const kernel_line_block = [](auto const& x, auto& y, auto const& matelem, std::size_t nelem){
+      auto const kernel_pos = [&, nelem](auto const& pos){
+        auto const ielem = get_element(pos);
+        constexpr std::size_t nbasis = std::tuple_size<decltype(ielem)>::value;
+        std::size_t const dof = x.dof_;
+
+        std::array<double const*, nbasis> xl;
+        for(std::size_t k=0; k<nbasis; ++k)
+          xl[k] = x.at(ielem[k]);
+
+        // ielem[2*r] and ielem[2*r+1] are the left and right nodes of the line r
+        for(std::size_t r=0; r<nbasis/2; ++r){
+          double* yl = y.at(ielem[2*r]);
+
+          std::array<double, nbasis> left_coef, right_coef;
+          std::array<double const*, nbasis> head_src, tail_src;
+          std::array<double, 2*nbasis> mid_coef;
+          std::array<double const*, 2*nbasis> mid_src;
+
+          for(std::size_t k2=0; k2<nbasis; ++k2){
+            left_coef[k2] = matelem[2*r+1][k2];
+            right_coef[k2] = matelem[2*r][k2];
+            head_src[k2] = xl[k2];
+            tail_src[k2] = xl[k2] + (nelem-1)*dof;
+            mid_coef[k2] = left_coef[k2];
+            mid_src[k2] = xl[k2];
+            mid_coef[nbasis + k2] = right_coef[k2];
+            mid_src[nbasis + k2] = xl[k2] + dof;
+          }
+
+          // first node: only the right element
+          simd::line_accumulate(yl, head_src, right_coef, dof);
+          // inner nodes: left then right element
+          simd::line_accumulate(yl + dof, mid_src, mid_coef, (nelem-1)*dof);
+          // last node: only the left element
+          simd::line_accumulate(yl + nelem*dof, tail_src, left_coef, dof);
+        }
+      };
+      return kernel_pos;
+    };
+
     #undef __FUNCT__
     #define __FUNCT__ "diag_block_mult"
     template<typename MatElem, typename Function, std::size_t Dimensions>
@@ -133,9 +400,8 @@ namespace cafes
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
-      auto box = get_DM_bounds<Dimensions>(x.dm_);
-
-      algorithm::iterate(box, kernel(x, y, matelem));
+      for(auto const& box: get_element_boxes<Dimensions>(x.dm_, x.region_))
+        algorithm::iterate_parallel(box, kernel(x, y, matelem));
 
       PetscFunctionReturn(0);
     }
@@ -149,9 +415,8 @@ namespace cafes
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
-      auto box = get_DM_bounds<Dimensions>(x.dm_);
-
-      algorithm::iterate(box, kernel(x, matelem));
+      for(auto const& box: get_element_boxes<Dimensions>(x.dm_, x.region_))
+        algorithm::iterate_parallel(box, kernel(x, matelem));
 
       PetscFunctionReturn(0);
     }
@@ -168,9 +433,50 @@ namespace cafes
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
-      auto box = get_DM_bounds<Dimensions>(x2.dm_);
+      for(auto const& box: get_element_boxes<Dimensions>(x2.dm_, x2.region_))
+        algorithm::iterate_parallel(box, kernel(x1, x2, y1, y2, matelem));
 
-      algorithm::iterate(box, kernel(x1, x2, y1, y2, matelem));
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "stokes_block_mult"
+    template<typename MatElemU, typename MatElemP, typename Function, std::size_t Dimensions>
+    PetscErrorCode stokes_block_mult(petsc::petsc_vec<Dimensions> const& x1,
+                                     petsc::petsc_vec<Dimensions> const& x2,
+                                     petsc::petsc_vec<Dimensions>& y1,
+                                     petsc::petsc_vec<Dimensions>& y2,
+                                     MatElemU const& matelem_u, MatElemP const& matelem_p,
+                                     Function&& kernel_u)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      for(auto const& box: get_element_boxes<Dimensions>(x2.dm_, x2.region_))
+        algorithm::iterate_parallel(box, kernel_stokes_block(x1, x2, y1, y2, matelem_u, matelem_p, kernel_u));
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "line_block_mult"
+    template<typename MatElem, typename Function, std::size_t Dimensions>
+    PetscErrorCode line_block_mult(petsc::petsc_vec<Dimensions>& x, petsc::petsc_vec<Dimensions>& y,
+                                   MatElem const& matelem, Function&& kernel)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      for(auto box: get_element_boxes<Dimensions>(x.dm_, x.region_)){
+        if (box.upper_right[0] <= box.bottom_left[0])
+          continue;
+
+        std::size_t nelem = box.upper_right[0] - box.bottom_left[0];
+
+        // only iterate over the first element of each x-line
+        box.upper_right[0] = box.bottom_left[0] + 1;
+        algorithm::iterate_parallel(box, kernel(x, y, matelem, nelem));
+      }
 
       PetscFunctionReturn(0);
     }
@@ -190,6 +496,21 @@ namespace cafes
       PetscFunctionReturn(0);
     }
 
+    #undef __FUNCT__
+    #define __FUNCT__ "laplacian_line_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode laplacian_line_mult(petsc::petsc_vec<Dimensions>& x, 
+                                       petsc::petsc_vec<Dimensions>& y, 
+                                       std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = line_block_mult(x, y, getMatElemLaplacian(h), kernel_line_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
     #undef __FUNCT__
     #define __FUNCT__ "diag_laplacian_mult"
     template<std::size_t Dimensions>
@@ -216,6 +537,19 @@ namespace cafes
       PetscFunctionReturn(0);
     }
 
+    #undef __FUNCT__
+    #define __FUNCT__ "mass_line_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode mass_line_mult(petsc::petsc_vec<Dimensions>& x, petsc::petsc_vec<Dimensions>& y, std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = line_block_mult(x, y, getMatElemMass(h), kernel_line_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
     #undef __FUNCT__
     #define __FUNCT__ "diag_mass_mult"
     template<std::size_t Dimensions>
@@ -258,6 +592,220 @@ namespace cafes
 
       PetscFunctionReturn(0);
     }
+    #undef __FUNCT__
+    #define __FUNCT__ "stokes_laplacian_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode stokes_laplacian_mult(petsc::petsc_vec<Dimensions> const& x1,
+                                         petsc::petsc_vec<Dimensions> const& x2,
+                                         petsc::petsc_vec<Dimensions>& y1,
+                                         petsc::petsc_vec<Dimensions>& y2,
+                                         std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = stokes_block_mult(x1, x2, y1, y2, getMatElemLaplacian(h), getMatElemPressure(h), kernel_diag_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "stokes_strain_tensor_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode stokes_strain_tensor_mult(petsc::petsc_vec<Dimensions> const& x1,
+                                             petsc::petsc_vec<Dimensions> const& x2,
+                                             petsc::petsc_vec<Dimensions>& y1,
+                                             petsc::petsc_vec<Dimensions>& y2,
+                                             std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = stokes_block_mult(x1, x2, y1, y2, getMatElemStrainTensor(h), getMatElemPressure(h), kernel_tensor_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "laplacian_sumfact_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode laplacian_sumfact_mult(petsc::petsc_vec<Dimensions>& x, petsc::petsc_vec<Dimensions>& y, std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = diag_block_mult(x, y, getModeLaplacian(h), kernel_sumfact_diag_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "strain_tensor_sumfact_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode strain_tensor_sumfact_mult(petsc::petsc_vec<Dimensions>& x, petsc::petsc_vec<Dimensions>& y, std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = diag_block_mult(x, y, getModeStrainTensor(h), kernel_sumfact_tensor_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "stokes_laplacian_sumfact_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode stokes_laplacian_sumfact_mult(petsc::petsc_vec<Dimensions> const& x1,
+                                                 petsc::petsc_vec<Dimensions> const& x2,
+                                                 petsc::petsc_vec<Dimensions>& y1,
+                                                 petsc::petsc_vec<Dimensions>& y2,
+                                                 std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = stokes_block_mult(x1, x2, y1, y2, getModeLaplacian(h), getMatElemPressure(h), kernel_sumfact_diag_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "stokes_strain_tensor_sumfact_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode stokes_strain_tensor_sumfact_mult(petsc::petsc_vec<Dimensions> const& x1,
+                                                     petsc::petsc_vec<Dimensions> const& x2,
+                                                     petsc::petsc_vec<Dimensions>& y1,
+                                                     petsc::petsc_vec<Dimensions>& y2,
+                                                     std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = stokes_block_mult(x1, x2, y1, y2, getModeStrainTensor(h), getMatElemPressure(h), kernel_sumfact_tensor_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "stokes_batch_block_mult"
+    template<typename MatElemU, typename MatElemP, typename Function, std::size_t Dimensions>
+    PetscErrorCode stokes_batch_block_mult(petsc::petsc_vec<Dimensions> const& x1,
+                                           petsc::petsc_vec<Dimensions> const& x2,
+                                           petsc::petsc_vec<Dimensions>& y1,
+                                           petsc::petsc_vec<Dimensions>& y2,
+                                           MatElemU const& matelem_u, MatElemP const& matelem_p,
+                                           Function&& kernel_u)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      for(auto const& box: get_element_boxes<Dimensions>(x2.dm_, x2.region_))
+        algorithm::iterate_parallel(box, kernel_batch_stokes_block(x1, x2, y1, y2, matelem_u, matelem_p, kernel_u));
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "batch_strain_tensor_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode batch_strain_tensor_mult(petsc::petsc_vec<Dimensions>& x, petsc::petsc_vec<Dimensions>& y, std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = diag_block_mult(x, y, getMatElemStrainTensor(h), kernel_batch_tensor_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "stokes_batch_laplacian_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode stokes_batch_laplacian_mult(petsc::petsc_vec<Dimensions> const& x1,
+                                               petsc::petsc_vec<Dimensions> const& x2,
+                                               petsc::petsc_vec<Dimensions>& y1,
+                                               petsc::petsc_vec<Dimensions>& y2,
+                                               std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = stokes_batch_block_mult(x1, x2, y1, y2, getMatElemLaplacian(h), getMatElemPressure(h), kernel_diag_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "stokes_batch_strain_tensor_mult"
+    template<std::size_t Dimensions>
+    PetscErrorCode stokes_batch_strain_tensor_mult(petsc::petsc_vec<Dimensions> const& x1,
+                                                   petsc::petsc_vec<Dimensions> const& x2,
+                                                   petsc::petsc_vec<Dimensions>& y1,
+                                                   petsc::petsc_vec<Dimensions>& y2,
+                                                   std::array<double, Dimensions> const& h)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      ierr = stokes_batch_block_mult(x1, x2, y1, y2, getMatElemStrainTensor(h), getMatElemPressure(h), kernel_batch_tensor_block);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    //! Operator applying mult with elementary matrices scaled once.
+    template<std::size_t Dimensions, typename MatElem, typename Mult>
+    auto make_operator(MatElem const& matelem, Mult const& mult)
+    {
+      using operator_type = std::function<PetscErrorCode(petsc::petsc_vec<Dimensions>&,
+                                                         petsc::petsc_vec<Dimensions>&)>;
+      return operator_type{[matelem, mult](petsc::petsc_vec<Dimensions>& x, petsc::petsc_vec<Dimensions>& y){
+        return mult(x, y, matelem);
+      }};
+    }
+
+    auto const diag_block_mult_with = [](auto const& kernel){
+      return [kernel](auto& x, auto& y, auto const& matelem){
+        return diag_block_mult(x, y, matelem, kernel);
+      };
+    };
+
+    auto const line_block_mult_with = [](auto const& kernel){
+      return [kernel](auto& x, auto& y, auto const& matelem){
+        return line_block_mult(x, y, matelem, kernel);
+      };
+    };
+
+    //! Operator of kernel_diag_block specialized on the number of dof.
+    template<std::size_t Dimensions, typename MatElem>
+    auto make_diag_block_operator(int dof, MatElem const& matelem)
+    {
+      switch(dof){
+        case 1:
+          return make_operator<Dimensions>(matelem, diag_block_mult_with(kernel_diag_block_dof(std::integral_constant<std::size_t, 1>{})));
+        case 2:
+          return make_operator<Dimensions>(matelem, diag_block_mult_with(kernel_diag_block_dof(std::integral_constant<std::size_t, 2>{})));
+        case 3:
+          return make_operator<Dimensions>(matelem, diag_block_mult_with(kernel_diag_block_dof(std::integral_constant<std::size_t, 3>{})));
+        default:
+          return make_operator<Dimensions>(matelem, diag_block_mult_with(kernel_diag_block));
+      }
+    }
+
+    //! Stokes operator of stokes_block_mult with elementary matrices scaled once.
+    template<std::size_t Dimensions, typename MatElemU, typename MatElemP, typename Function>
+    auto make_stokes_operator(MatElemU const& matelem_u, MatElemP const& matelem_p, Function const& kernel_u)
+    {
+      using operator_type = std::function<PetscErrorCode(petsc::petsc_vec<Dimensions> const&,
+                                                         petsc::petsc_vec<Dimensions> const&,
+                                                         petsc::petsc_vec<Dimensions>&,
+                                                         petsc::petsc_vec<Dimensions>&)>;
+      return operator_type{[matelem_u, matelem_p, kernel_u](petsc::petsc_vec<Dimensions> const& x1,
+                                                            petsc::petsc_vec<Dimensions> const& x2,
+                                                            petsc::petsc_vec<Dimensions>& y1,
+                                                            petsc::petsc_vec<Dimensions>& y2){
+        return stokes_block_mult(x1, x2, y1, y2, matelem_u, matelem_p, kernel_u);
+      }};
+    }
   }
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef CAFES_FEM_SIMD_HPP_INCLUDED
+#define CAFES_FEM_SIMD_HPP_INCLUDED
+
+#include <array>
+#include <cstddef>
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace cafes
+{
+  namespace fem
+  {
+    namespace simd
+    {
+      //! Computes on a contiguous line of n values
+      //!
+      //!   y[i] = (((y[i] + src[0][i]*coef[0]) + src[1][i]*coef[1]) + ...)
+      //!
+      //! The terms are added one by one in the order of src which is the
+      //! order used by the element by element kernels. Each lane is
+      //! independent so the result does not depend on the vector width.
+      //!
+      //! The results are bit identical to the element kernels as long as the
+      //! compiler does not contract a*b+c into an fma (-ffp-contract=off):
+      //! otherwise the scalar kernels themselves are contracted differently
+      //! depending on the optimization level.
+      template<std::size_t N>
+      inline void line_accumulate(double* y,
+                                  std::array<double const*, N> const& src,
+                                  std::array<double, N> const& coef,
+                                  std::size_t n)
+      {
+        std::size_t i = 0;
+
+#if defined(__AVX512F__)
+        __m512d c[N];
+        for(std::size_t t=0; t<N; ++t)
+          c[t] = _mm512_set1_pd(coef[t]);
+
+        for(; i+8<=n; i+=8){
+          __m512d acc = _mm512_loadu_pd(y + i);
+          for(std::size_t t=0; t<N; ++t)
+            acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_loadu_pd(src[t] + i), c[t]));
+          _mm512_storeu_pd(y + i, acc);
+        }
+#elif defined(__AVX__)
+        __m256d c[N];
+        for(std::size_t t=0; t<N; ++t)
+          c[t] = _mm256_set1_pd(coef[t]);
+
+        for(; i+4<=n; i+=4){
+          __m256d acc = _mm256_loadu_pd(y + i);
+          for(std::size_t t=0; t<N; ++t)
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(src[t] + i), c[t]));
+          _mm256_storeu_pd(y + i, acc);
+        }
+#endif
+
+        // portable path and remainder of the vector loops
+        #pragma omp simd
+        for(std::size_t j=i; j<n; ++j){
+          double acc = y[j];
+          for(std::size_t t=0; t<N; ++t)
+            acc += src[t][j]*coef[t];
+          y[j] = acc;
+        }
+      }
+    }
+  }
+}
+#endif
@@ -0,0 +1,573 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef CAFES_FEM_SMOOTHER_HPP_INCLUDED
+#define CAFES_FEM_SMOOTHER_HPP_INCLUDED
+
+#include <algorithm/iterate.hpp>
+#include <fem/bc.hpp>
+#include <fem/matElem.hpp>
+#include <fem/mesh.hpp>
+#include <fem/mixed_precision.hpp>
+#include <fem/operator.hpp>
+#include <petsc/vec.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <petsc.h>
+
+namespace cafes
+{
+  namespace fem
+  {
+    enum class smoother_type { cg, chebyshev, gauss_seidel };
+
+    //! Gershgorin bound of the spectrum of D^{-1}A for a Q1 operator given
+    //! by its elementary matrix. A row of the assembled matrix is the sum
+    //! of the rows of the elementary matrices of the elements around the
+    //! node, so sum_j |a_ij|/a_ii is bounded by the largest ratio of the
+    //! rows of the elementary matrix. The Dirichlet rows have a ratio of 1.
+    template<std::size_t N>
+    double gershgorin_bound(std::array<std::array<double, N>, N> const& matelem)
+    {
+      double bound = 1.;
+      for(std::size_t k1=0; k1<N; ++k1){
+        double sum = 0.;
+        for(std::size_t k2=0; k2<N; ++k2)
+          sum += std::abs(matelem[k1][k2]);
+        bound = std::max(bound, sum/matelem[k1][k1]);
+      }
+      return bound;
+    }
+
+    template<std::size_t N, std::size_t Dimensions>
+    double gershgorin_bound(std::array<std::array<std::array<std::array<double, Dimensions>, Dimensions>, N>, N> const& matelem)
+    {
+      double bound = 1.;
+      for(std::size_t k1=0; k1<N; ++k1)
+        for(std::size_t d1=0; d1<Dimensions; ++d1){
+          double sum = 0.;
+          for(std::size_t k2=0; k2<N; ++k2)
+            for(std::size_t d2=0; d2<Dimensions; ++d2)
+              sum += std::abs(matelem[k1][k2][d1][d2]);
+          bound = std::max(bound, sum/matelem[k1][k1][d1][d1]);
+        }
+      return bound;
+    }
+
+    //! Upper bound of the eigenvalues of D^{-1}A for the velocity operator
+    //! of a context.
+    template<typename CTX, typename Dimensions = typename CTX::dimension_type>
+    double eigenvalue_bound(CTX const& ctx)
+    {
+      constexpr std::size_t dim = Dimensions::value;
+
+      if (ctx.apply == &strain_tensor_mult<dim> || ctx.apply == &strain_tensor_sumfact_mult<dim>)
+        return gershgorin_bound(getMatElemStrainTensor(ctx.h));
+      if (ctx.apply == &mass_mult<dim> || ctx.apply == &mass_line_mult<dim>)
+        return gershgorin_bound(getMatElemMass(ctx.h));
+      return gershgorin_bound(getMatElemLaplacian(ctx.h));
+    }
+
+    //! Update of the nodes of one colour of the 2^Dimensions colouring of
+    //! the Q1 box stencil: x += omega D^{-1} r.
+    auto const kernel_colored_update = [](auto& x, auto const& r, auto const& invdiag, std::size_t colour, double omega, int dof){
+      auto const kernel_pos = [&, colour, omega, dof](auto const& pos){
+        std::size_t c = 0;
+        for(std::size_t d=0; d<pos.dimensions; ++d)
+          c |= (pos[d]&1)<<d;
+        if (c != colour)
+          return;
+
+        auto ux = x.at(pos);
+        auto ur = r.at(pos);
+        auto ud = invdiag.at(pos);
+        for(int i=0; i<dof; ++i)
+          ux[i] += omega*ud[i]*ur[i];
+      };
+      return kernel_pos;
+    };
+
+    //! acc -= m u for a term of the elementary matrix of the Laplacian or
+    //! of the mass, which acts on each dof.
+    inline void subtract_block(double* acc, double const* u, double m, int dof)
+    {
+      for(int i=0; i<dof; ++i)
+        acc[i] -= m*u[i];
+    }
+
+    //! acc -= m u for a term of the elementary matrix of the strain tensor,
+    //! which acts on each velocity of a batch.
+    template<std::size_t Dimensions>
+    void subtract_block(double* acc, double const* u, std::array<std::array<double, Dimensions>, Dimensions> const& m, int dof)
+    {
+      for(int b=0; b<dof; b+=Dimensions)
+        for(std::size_t d1=0; d1<Dimensions; ++d1)
+          for(std::size_t d2=0; d2<Dimensions; ++d2)
+            acc[b + d1] -= m[d1][d2]*u[b + d2];
+    }
+
+    //! Residual r = b - A x on the nodes of one colour when x is zero on
+    //! them: the node is the corner k1 of the element pos - k1, only the
+    //! row k1 of its elementary matrix is applied to the other corners.
+    //! elements is the global box of the elements seen from the nodes: on
+    //! a periodic direction the element between the last and the first
+    //! node is both -1 and M-1.
+    auto const kernel_colored_residual = [](auto const& x, auto const& b, auto& r, auto const& matelem,
+                                            auto const& elements, std::size_t colour, int dof){
+      auto const kernel_pos = [&, colour, dof](auto const& pos){
+        constexpr std::size_t dim = std::decay_t<decltype(pos)>::dimensions;
+        std::size_t c = 0;
+        for(std::size_t d=0; d<dim; ++d)
+          c |= (pos[d]&1)<<d;
+        if (c != colour)
+          return;
+
+        auto ur = r.at(pos);
+        auto ub = b.at(pos);
+        for(int i=0; i<dof; ++i)
+          ur[i] = ub[i];
+
+        for(std::size_t k1=0; k1<(1<<dim); ++k1){
+          auto elem = pos;
+          bool inside = true;
+          for(std::size_t d=0; d<dim; ++d){
+            elem[d] -= (k1>>d)&1;
+            inside = inside && elem[d] >= elements.bottom_left[d] && elem[d] < elements.upper_right[d];
+          }
+          if (!inside)
+            continue;
+
+          auto const ielem = get_element(elem);
+          for(std::size_t k2=0; k2<ielem.size(); ++k2)
+            if (k2 != k1)
+              subtract_block(ur, x.at(ielem[k2]), matelem[k1][k2], dof);
+        }
+      };
+      return kernel_pos;
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "colored_residual"
+    //! r = b - A x on the owned nodes of one colour for x zero on them. The
+    //! cost is one row of the elementary matrix per element instead of the
+    //! whole matrix of MatResidual. The Dirichlet rows are rows of the
+    //! identity: their residual is b.
+    template<std::size_t Dimensions, typename MatElem>
+    PetscErrorCode colored_residual(DM dm, Vec b, Vec x, Vec r, std::size_t colour,
+                                    MatElem const& matelem, dirichlet_conditions<Dimensions> const* bc)
+    {
+      PetscErrorCode ierr;
+      Vec xlocal;
+      PetscFunctionBeginUser;
+
+      ierr = petsc::get_local_vector(dm, &xlocal);CHKERRQ(ierr);
+      ierr = DMGlobalToLocalBegin(dm, x, INSERT_VALUES, xlocal);CHKERRQ(ierr);
+      ierr = DMGlobalToLocalEnd(dm, x, INSERT_VALUES, xlocal);CHKERRQ(ierr);
+
+      DMDALocalInfo info;
+      ierr = DMDAGetLocalInfo(dm, &info);CHKERRQ(ierr);
+      petsc::strided_array<Dimensions> ax, ab, ar;
+      ax.set_layout({{info.gxs, info.gys, info.gzs}}, {{info.gxm, info.gym, info.gzm}}, info.dof);
+      for(auto a: {&ab, &ar})
+        a->set_layout({{info.xs, info.ys, info.zs}}, {{info.xm, info.ym, info.zm}}, info.dof);
+
+      PetscScalar const *px, *pb;
+      ierr = VecGetArrayRead(xlocal, &px);CHKERRQ(ierr);
+      ierr = VecGetArrayRead(b, &pb);CHKERRQ(ierr);
+      ierr = VecGetArray(r, &ar.data_);CHKERRQ(ierr);
+      ax.data_ = const_cast<PetscScalar*>(px);
+      ab.data_ = const_cast<PetscScalar*>(pb);
+
+      auto bd_type = get_boundary_type<Dimensions>(dm);
+      auto gbounds = get_global_bounds<Dimensions>(dm);
+      geometry::box<int, Dimensions> elements;
+      for(std::size_t d=0; d<Dimensions; ++d){
+        elements.bottom_left[d] = (bd_type[d] == DM_BOUNDARY_PERIODIC)? -1: 0;
+        elements.upper_right[d] = (bd_type[d] == DM_BOUNDARY_PERIODIC)? gbounds[d]: gbounds[d] - 1;
+      }
+
+      auto box = get_DM_bounds<Dimensions>(dm, false);
+      algorithm::iterate_parallel(box, kernel_colored_residual(ax, ab, ar, matelem, elements, colour, info.dof));
+
+      if (bc){
+        int const dof = info.dof;
+        for(auto const& face: get_dirichlet_boxes<Dimensions>(dm)){
+          auto const& conditions = bc->conditions_[face.second];
+          algorithm::iterate(face.first, [&](auto const& pos){
+            auto ur = ar.at(pos);
+            auto ub = ab.at(pos);
+            for(int i=0; i<dof; ++i)
+              if (conditions[i%Dimensions])
+                ur[i] = ub[i];
+          });
+        }
+      }
+
+      ierr = VecRestoreArray(r, &ar.data_);CHKERRQ(ierr);
+      ierr = VecRestoreArrayRead(b, &pb);CHKERRQ(ierr);
+      ierr = VecRestoreArrayRead(xlocal, &px);CHKERRQ(ierr);
+      ierr = petsc::restore_local_vector(dm, &xlocal);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    //! Colour residual of the velocity operator of a context, with the
+    //! elementary matrix chosen as in eigenvalue_bound.
+    template<typename CTX, typename Dimensions = typename CTX::dimension_type>
+    auto make_colored_residual(CTX const& ctx)
+    {
+      constexpr std::size_t dim = Dimensions::value;
+      using residual_type = std::function<PetscErrorCode(DM, Vec, Vec, Vec, std::size_t)>;
+
+      auto const with = [&ctx](auto const& matelem){
+        bool set_bc = ctx.set_bc_;
+        auto bc = ctx.bc_;
+        return residual_type{[set_bc, bc, matelem](DM dm, Vec b, Vec x, Vec r, std::size_t colour){
+          return colored_residual<dim>(dm, b, x, r, colour, matelem, (set_bc)? &bc: nullptr);
+        }};
+      };
+
+      if (ctx.apply == &strain_tensor_mult<dim> || ctx.apply == &strain_tensor_sumfact_mult<dim>)
+        return with(getMatElemStrainTensor(ctx.h));
+      if (ctx.apply == &mass_mult<dim> || ctx.apply == &mass_line_mult<dim>)
+        return with(getMatElemMass(ctx.h));
+      return with(getMatElemLaplacian(ctx.h));
+    }
+
+    //! Context of the multicolour Gauss-Seidel smoother.
+    template<std::size_t Dimensions>
+    struct colored_gs_context{
+      DM dm;
+      std::function<PetscErrorCode(DM, Vec, Vec, Vec, std::size_t)> residual;
+      Vec invdiag = nullptr;
+      Vec r = nullptr;
+      double omega = 1.;
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "colored_gs_setup"
+    template<std::size_t Dimensions>
+    PetscErrorCode colored_gs_setup(PC pc)
+    {
+      PetscErrorCode ierr;
+      colored_gs_context<Dimensions> *s;
+      Mat A;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+      ierr = PCGetOperators(pc, &A, nullptr);CHKERRQ(ierr);
+      // the DM of the level is set on its operator by createLevelMatrices
+      ierr = MatGetDM(A, &s->dm);CHKERRQ(ierr);
+
+      if (!s->invdiag){
+        ierr = MatCreateVecs(A, &s->invdiag, &s->r);CHKERRQ(ierr);
+      }
+      ierr = MatGetDiagonal(A, s->invdiag);CHKERRQ(ierr);
+      ierr = VecReciprocal(s->invdiag);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "colored_gs_update"
+    template<std::size_t Dimensions>
+    PetscErrorCode colored_gs_update(colored_gs_context<Dimensions> *s, Vec x, Vec r, std::size_t colour)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      petsc::strided_array<Dimensions> ax, ar, ad;
+      DMDALocalInfo info;
+      ierr = DMDAGetLocalInfo(s->dm, &info);CHKERRQ(ierr);
+      for(auto a: {&ax, &ar, &ad})
+        a->set_layout({{info.xs, info.ys, info.zs}}, {{info.xm, info.ym, info.zm}}, info.dof);
+
+      PetscScalar const *pr, *pd;
+      ierr = VecGetArray(x, &ax.data_);CHKERRQ(ierr);
+      ierr = VecGetArrayRead(r, &pr);CHKERRQ(ierr);
+      ierr = VecGetArrayRead(s->invdiag, &pd);CHKERRQ(ierr);
+      ar.data_ = const_cast<PetscScalar*>(pr);
+      ad.data_ = const_cast<PetscScalar*>(pd);
+
+      auto box = get_DM_bounds<Dimensions>(s->dm, false);
+      algorithm::iterate(box, kernel_colored_update(ax, ar, ad, colour, s->omega, info.dof));
+
+      ierr = VecRestoreArrayRead(s->invdiag, &pd);CHKERRQ(ierr);
+      ierr = VecRestoreArrayRead(r, &pr);CHKERRQ(ierr);
+      ierr = VecRestoreArray(x, &ax.data_);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "colored_gs_apply"
+    //! One sweep of multicolour Gauss-Seidel from x = 0. The nodes of a
+    //! colour are not coupled by the Q1 box stencil, the residual is
+    //! computed on the nodes of the colour only between two colours, so a
+    //! sweep costs about one matrix-free product. No inner product is
+    //! computed.
+    template<std::size_t Dimensions>
+    PetscErrorCode colored_gs_apply(PC pc, Vec b, Vec x)
+    {
+      PetscErrorCode ierr;
+      colored_gs_context<Dimensions> *s;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+
+      ierr = VecSet(x, 0.);CHKERRQ(ierr);
+      ierr = colored_gs_update(s, x, b, 0);CHKERRQ(ierr);
+
+      for(std::size_t colour=1; colour<(1<<Dimensions); ++colour){
+        ierr = s->residual(s->dm, b, x, s->r, colour);CHKERRQ(ierr);
+        ierr = colored_gs_update(s, x, s->r, colour);CHKERRQ(ierr);
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "colored_gs_destroy"
+    template<std::size_t Dimensions>
+    PetscErrorCode colored_gs_destroy(PC pc)
+    {
+      PetscErrorCode ierr;
+      colored_gs_context<Dimensions> *s;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+      ierr = VecDestroy(&s->invdiag);CHKERRQ(ierr);
+      ierr = VecDestroy(&s->r);CHKERRQ(ierr);
+      delete s;
+
+      PetscFunctionReturn(0);
+    }
+
+    //! Context of the Chebyshev smoother of a single precision level.
+    //! smoother is the Richardson KSP of the level (not referenced): its
+    //! number of iterations gives steps at the setup.
+    template<std::size_t Dimensions>
+    struct single_chebyshev_context{
+      using array_type = petsc::local_array<Dimensions, float>;
+
+      std::shared_ptr<single_precision_level<Dimensions>> level;
+      KSP smoother;
+      double emin, emax;
+      PetscInt steps = 0;
+      array_type r, z, invdiag;
+
+      single_chebyshev_context(std::shared_ptr<single_precision_level<Dimensions>> l,
+                               KSP ksp, double emin_, double emax_)
+      : level{l}, smoother{ksp}, emin{emin_}, emax{emax_}, r{l->x.dm_}, z{l->x.dm_}, invdiag{l->x.dm_}
+      {}
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "single_chebyshev_setup"
+    //! The degree is read here, once the options of the smoother are
+    //! applied, and the Richardson iteration is reduced to one step. A
+    //! later setup only changes the degree if the number of iterations was
+    //! set again.
+    template<std::size_t Dimensions>
+    PetscErrorCode single_chebyshev_setup(PC pc)
+    {
+      PetscErrorCode ierr;
+      single_chebyshev_context<Dimensions> *s;
+      Mat A;
+      Vec diag;
+      PetscInt maxit;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+
+      ierr = KSPGetTolerances(s->smoother, nullptr, nullptr, nullptr, &maxit);CHKERRQ(ierr);
+      if (s->steps == 0 || maxit != 1){
+        s->steps = maxit;
+        ierr = KSPSetTolerances(s->smoother, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT, 1);CHKERRQ(ierr);
+      }
+      ierr = PCGetOperators(pc, &A, nullptr);CHKERRQ(ierr);
+
+      ierr = MatCreateVecs(A, &diag, nullptr);CHKERRQ(ierr);
+      ierr = MatGetDiagonal(A, diag);CHKERRQ(ierr);
+      ierr = VecReciprocal(diag);CHKERRQ(ierr);
+      ierr = copy_owned(diag, s->invdiag);CHKERRQ(ierr);
+      ierr = VecDestroy(&diag);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "single_chebyshev_apply"
+    //! steps iterations of Chebyshev with Jacobi on [emin, emax] from
+    //! x = 0, entirely in float: b is converted once at the entry and x
+    //! once at the exit. No inner product is computed.
+    template<std::size_t Dimensions>
+    PetscErrorCode single_chebyshev_apply(PC pc, Vec b, Vec x)
+    {
+      PetscErrorCode ierr;
+      single_chebyshev_context<Dimensions> *s;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+      auto& level = *s->level;
+      // the search direction is level.x, its product by A is level.y
+      auto& d = level.x;
+      auto& w = level.y;
+      auto& r = s->r;
+      auto& z = s->z;
+      auto& invdiag = s->invdiag;
+      int const dof = r.dof_;
+      auto box = get_DM_bounds<Dimensions>(r.dm_, false);
+
+      double const theta = .5*(s->emax + s->emin);
+      double const delta = .5*(s->emax - s->emin);
+      double const sigma = theta/delta;
+      double rho = 1./sigma;
+
+      ierr = copy_owned(b, r);CHKERRQ(ierr);
+      float const c0 = static_cast<float>(1./theta);
+      algorithm::iterate(box, [&](auto const& pos){
+        auto ud = d.at(pos), uz = z.at(pos);
+        auto ur = r.at(pos), ui = invdiag.at(pos);
+        for(int i=0; i<dof; ++i)
+          uz[i] = ud[i] = c0*ui[i]*ur[i];
+      });
+
+      for(PetscInt k=1; k<s->steps; ++k){
+        ierr = level.mult();CHKERRQ(ierr);
+
+        double const rho_new = 1./(2.*sigma - rho);
+        float const c1 = static_cast<float>(rho_new*rho);
+        float const c2 = static_cast<float>(2.*rho_new/delta);
+        algorithm::iterate(box, [&](auto const& pos){
+          auto ud = d.at(pos), uw = w.at(pos), uz = z.at(pos);
+          auto ur = r.at(pos), ui = invdiag.at(pos);
+          for(int i=0; i<dof; ++i){
+            ur[i] -= uw[i];
+            ud[i] = c1*ud[i] + c2*ui[i]*ur[i];
+            uz[i] += ud[i];
+          }
+        });
+        rho = rho_new;
+      }
+
+      ierr = copy_owned(x, z, true);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "single_chebyshev_destroy"
+    template<std::size_t Dimensions>
+    PetscErrorCode single_chebyshev_destroy(PC pc)
+    {
+      PetscErrorCode ierr;
+      single_chebyshev_context<Dimensions> *s;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+      delete s;
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_level_smoother"
+    //! Sets the smoother of a matrix-free multigrid level:
+    //!  - cg: CG with Jacobi,
+    //!  - chebyshev: Chebyshev with Jacobi on [bound/10, bound] where bound
+    //!    is the Gershgorin bound of the elementary matrix, or with the
+    //!    bounds estimated once at the setup if estimate is set,
+    //!  - gauss_seidel: multicolour Gauss-Seidel in a Richardson iteration.
+    //! Chebyshev and Gauss-Seidel do not compute any inner product. On a
+    //! single precision level, Chebyshev runs in float in a Richardson
+    //! iteration (see single_chebyshev_apply): its degree is the number
+    //! of smoothing steps of the level, read at the setup after the
+    //! options, and the Gershgorin bound is used.
+    template<typename CTX, typename Dimensions = typename CTX::dimension_type>
+    PetscErrorCode set_level_smoother(KSP smoother, CTX const& ctx, smoother_type type, PetscBool estimate)
+    {
+      PetscErrorCode ierr;
+      PC pc;
+      PetscFunctionBeginUser;
+
+      ierr = KSPGetPC(smoother, &pc);CHKERRQ(ierr);
+
+      switch(type){
+        case smoother_type::cg:
+          ierr = KSPSetType(smoother, KSPCG);CHKERRQ(ierr);
+          ierr = PCSetType(pc, PCJACOBI);CHKERRQ(ierr);
+          break;
+        case smoother_type::chebyshev:
+          if (ctx.single_){
+            double bound = eigenvalue_bound(ctx);
+            auto *s = new single_chebyshev_context<Dimensions::value>{ctx.single_, smoother, .1*bound, bound};
+            ierr = KSPSetType(smoother, KSPRICHARDSON);CHKERRQ(ierr);
+            ierr = KSPSetNormType(smoother, KSP_NORM_NONE);CHKERRQ(ierr);
+            ierr = PCSetType(pc, PCSHELL);CHKERRQ(ierr);
+            ierr = PCShellSetContext(pc, s);CHKERRQ(ierr);
+            ierr = PCShellSetSetUp(pc, single_chebyshev_setup<Dimensions::value>);CHKERRQ(ierr);
+            ierr = PCShellSetApply(pc, single_chebyshev_apply<Dimensions::value>);CHKERRQ(ierr);
+            ierr = PCShellSetDestroy(pc, single_chebyshev_destroy<Dimensions::value>);CHKERRQ(ierr);
+            ierr = PCShellSetName(pc, "single precision Chebyshev");CHKERRQ(ierr);
+            break;
+          }
+          ierr = KSPSetType(smoother, KSPCHEBYSHEV);CHKERRQ(ierr);
+          if (estimate){
+            ierr = KSPChebyshevEstEigSet(smoother, 0, .1, 0, 1.1);CHKERRQ(ierr);
+          }
+          else{
+            double bound = eigenvalue_bound(ctx);
+            ierr = KSPChebyshevSetEigenvalues(smoother, bound, .1*bound);CHKERRQ(ierr);
+          }
+          ierr = KSPSetNormType(smoother, KSP_NORM_NONE);CHKERRQ(ierr);
+          ierr = PCSetType(pc, PCJACOBI);CHKERRQ(ierr);
+          break;
+        case smoother_type::gauss_seidel:
+        {
+          auto *s = new colored_gs_context<Dimensions::value>{ctx.dm, make_colored_residual(ctx)};
+          ierr = KSPSetType(smoother, KSPRICHARDSON);CHKERRQ(ierr);
+          ierr = KSPSetNormType(smoother, KSP_NORM_NONE);CHKERRQ(ierr);
+          ierr = PCSetType(pc, PCSHELL);CHKERRQ(ierr);
+          ierr = PCShellSetContext(pc, s);CHKERRQ(ierr);
+          ierr = PCShellSetSetUp(pc, colored_gs_setup<Dimensions::value>);CHKERRQ(ierr);
+          ierr = PCShellSetApply(pc, colored_gs_apply<Dimensions::value>);CHKERRQ(ierr);
+          ierr = PCShellSetDestroy(pc, colored_gs_destroy<Dimensions::value>);CHKERRQ(ierr);
+          ierr = PCShellSetName(pc, "multicolour Gauss-Seidel");CHKERRQ(ierr);
+          break;
+        }
+      }
+
+      PetscFunctionReturn(0);
+    }
+  }
+}
+#endif
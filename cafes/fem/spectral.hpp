@@ -0,0 +1,460 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef CAFES_FEM_SPECTRAL_HPP_INCLUDED
+#define CAFES_FEM_SPECTRAL_HPP_INCLUDED
+
+#include <fem/matElem.hpp>
+#include <fem/mesh.hpp>
+#include <fem/quadrature.hpp>
+#include <particle/geometry/position.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <vector>
+#include <fftw3-mpi.h>
+#include <petsc.h>
+
+namespace cafes
+{
+  namespace fem
+  {
+    //! Symbol of the periodic Q1/4Q1 Stokes operator
+    //!
+    //!   [ A  -B^T ] [u]   [f]
+    //!   [ B    0  ] [p] = [g]
+    //!
+    //! on a uniform grid. The velocity grid is split in its 2^Dimensions
+    //! cosets u^c_m = u_{2m+c} which live on the pressure grid. The operator
+    //! is then invariant by the translations of the pressure grid and, for
+    //! each frequency phi of the pressure grid, it is a dense block of size
+    //! Dimensions*2^Dimensions + 1 (the fields of a node are ordered
+    //! c*Dimensions + d for the velocity and the pressure last).
+    template<std::size_t Dimensions>
+    struct periodic_stokes_symbol{
+      static constexpr std::size_t ncosets = 1<<Dimensions;
+      static constexpr std::size_t nvelocity = ncosets*Dimensions;
+      static constexpr std::size_t nfields = nvelocity + 1;
+      static constexpr std::size_t nshifts = (Dimensions == 2)? 9: 27;
+
+      using complex = std::complex<double>;
+      using block = std::array<std::array<double, Dimensions>, Dimensions>;
+
+      //! stencils of A and B: coefficients between the cosets for each shift
+      //! q in {-1, 0, 1}^Dimensions of the pressure grid
+      std::array<std::array<std::array<block, nshifts>, ncosets>, ncosets> a_{};
+      std::array<std::array<std::array<double, Dimensions>, nshifts>, ncosets> b_{};
+      std::array<std::array<int, Dimensions>, nshifts> shifts_;
+
+      //! matelem_u is the elementary matrix of the Laplacian or of the
+      //! strain tensor, matelem_p the one of getMatElemPressure.
+      template<typename MatElemU, typename MatElemP>
+      periodic_stokes_symbol(MatElemU const& matelem_u, MatElemP const& matelem_p)
+      {
+        for(std::size_t s=0; s<nshifts; ++s)
+          for(std::size_t d=0, r=s; d<Dimensions; ++d, r/=3)
+            shifts_[s][d] = static_cast<int>(r%3) - 1;
+
+        geometry::position<int, Dimensions> zero;
+        for(std::size_t d=0; d<Dimensions; ++d)
+          zero[d] = 0;
+        auto const ielem = get_element(zero);
+        auto const ielem_4Q1 = get_element_4Q1(zero);
+
+        // velocity elements: the origin of an element has the parity pe
+        for(std::size_t pe=0; pe<ncosets; ++pe)
+          for(std::size_t k1=0; k1<ielem.size(); ++k1)
+            for(std::size_t k2=0; k2<ielem.size(); ++k2)
+            {
+              std::size_t c1 = 0, c2 = 0, s = 0;
+              for(std::size_t d=0, w=1; d<Dimensions; ++d, w*=3)
+              {
+                int const n1 = ((pe>>d)&1) + ielem[k1][d];
+                int const n2 = ((pe>>d)&1) + ielem[k2][d];
+                c1 |= (n1%2)<<d;
+                c2 |= (n2%2)<<d;
+                s += (n2/2 - n1/2 + 1)*w;
+              }
+              add_block(a_[c1][c2][s], matelem_u[k1][k2]);
+            }
+
+        // pressure elements: the 4Q1 patch starts at the velocity node 2m
+        for(std::size_t ip=0; ip<ielem.size(); ++ip)
+          for(std::size_t iv=0; iv<ielem_4Q1.size(); ++iv)
+          {
+            std::size_t c = 0, s = 0;
+            for(std::size_t d=0, w=1; d<Dimensions; ++d, w*=3)
+            {
+              c |= (ielem_4Q1[iv][d]%2)<<d;
+              s += (ielem_4Q1[iv][d]/2 - ielem[ip][d] + 1)*w;
+            }
+            for(std::size_t d=0; d<Dimensions; ++d)
+              b_[c][s][d] += matelem_p[ip][iv][d];
+          }
+      }
+
+      static void add_block(block& a, double m)
+      {
+        for(std::size_t d=0; d<Dimensions; ++d)
+          a[d][d] += m;
+      }
+
+      static void add_block(block& a, block const& m)
+      {
+        for(std::size_t d1=0; d1<Dimensions; ++d1)
+          for(std::size_t d2=0; d2<Dimensions; ++d2)
+            a[d1][d2] += m[d1][d2];
+      }
+
+      //! Solves in place the block of the frequency phi: u holds the nfields
+      //! Fourier coefficients of the right hand side and gets the ones of
+      //! the solution. For phi = 0, the mean of the velocity and of the
+      //! pressure are set to 0 (the mean force is removed).
+      void solve(std::array<double, Dimensions> const& phi, complex* u) const
+      {
+        std::array<complex, nshifts> e;
+        for(std::size_t s=0; s<nshifts; ++s)
+        {
+          double angle = 0;
+          for(std::size_t d=0; d<Dimensions; ++d)
+            angle += phi[d]*shifts_[s][d];
+          e[s] = std::polar(1., angle);
+        }
+
+        std::array<std::array<complex, nvelocity>, nvelocity> a{};
+        std::array<complex, nvelocity> b{}, z;
+
+        for(std::size_t c1=0; c1<ncosets; ++c1)
+          for(std::size_t c2=0; c2<ncosets; ++c2)
+            for(std::size_t s=0; s<nshifts; ++s)
+              for(std::size_t d1=0; d1<Dimensions; ++d1)
+                for(std::size_t d2=0; d2<Dimensions; ++d2)
+                  a[c1*Dimensions + d1][c2*Dimensions + d2] += a_[c1][c2][s][d1][d2]*e[s];
+
+        for(std::size_t c=0; c<ncosets; ++c)
+          for(std::size_t s=0; s<nshifts; ++s)
+            for(std::size_t d=0; d<Dimensions; ++d)
+              b[c*Dimensions + d] += b_[c][s][d]*e[s];
+
+        double amax = 0;
+        for(std::size_t i=0; i<nvelocity; ++i)
+          amax = std::max(amax, std::abs(a[i][i]));
+
+        // the constant velocities are the kernel of A and the constant
+        // pressures the kernel of B^T at phi = 0
+        bool const mean = std::all_of(phi.begin(), phi.end(), [](double x){return x == 0;});
+        if (mean)
+          for(std::size_t d=0; d<Dimensions; ++d)
+          {
+            complex mean = 0;
+            for(std::size_t c=0; c<ncosets; ++c)
+              mean += u[c*Dimensions + d];
+            mean /= static_cast<double>(ncosets);
+            for(std::size_t c1=0; c1<ncosets; ++c1)
+            {
+              u[c1*Dimensions + d] -= mean;
+              for(std::size_t c2=0; c2<ncosets; ++c2)
+                a[c1*Dimensions + d][c2*Dimensions + d] += amax;
+            }
+          }
+
+        cholesky(a);
+
+        for(std::size_t i=0; i<nvelocity; ++i)
+          z[i] = std::conj(b[i]);
+        cholesky_solve(a, u);
+        cholesky_solve(a, z.data());
+
+        // Schur complement B A^{-1} B^H (a real number)
+        complex schur = 0, by = 0;
+        double bnorm = 0;
+        for(std::size_t i=0; i<nvelocity; ++i)
+        {
+          schur += b[i]*z[i];
+          by += b[i]*u[i];
+          bnorm += std::norm(b[i]);
+        }
+
+        complex p = 0;
+        if (!mean && std::abs(schur) > 1e-12*bnorm/amax)
+          p = (u[nvelocity] - by)/schur;
+
+        for(std::size_t i=0; i<nvelocity; ++i)
+          u[i] += z[i]*p;
+        u[nvelocity] = p;
+      }
+
+      //! In place Cholesky factorization of a Hermitian positive definite
+      //! matrix (lower part).
+      static void cholesky(std::array<std::array<complex, nvelocity>, nvelocity>& a)
+      {
+        for(std::size_t j=0; j<nvelocity; ++j)
+        {
+          double diag = a[j][j].real();
+          for(std::size_t k=0; k<j; ++k)
+            diag -= std::norm(a[j][k]);
+          diag = std::sqrt(diag);
+          a[j][j] = diag;
+          for(std::size_t i=j+1; i<nvelocity; ++i)
+          {
+            complex sum = a[i][j];
+            for(std::size_t k=0; k<j; ++k)
+              sum -= a[i][k]*std::conj(a[j][k]);
+            a[i][j] = sum/diag;
+          }
+        }
+      }
+
+      static void cholesky_solve(std::array<std::array<complex, nvelocity>, nvelocity> const& a, complex* x)
+      {
+        for(std::size_t i=0; i<nvelocity; ++i)
+        {
+          for(std::size_t k=0; k<i; ++k)
+            x[i] -= a[i][k]*x[k];
+          x[i] /= a[i][i].real();
+        }
+        for(std::size_t i=nvelocity; i-- > 0;)
+        {
+          for(std::size_t k=i+1; k<nvelocity; ++k)
+            x[i] -= std::conj(a[k][i])*x[k];
+          x[i] /= a[i][i].real();
+        }
+      }
+    };
+
+    //! Direct solver of the periodic Stokes problem on the composite DM of
+    //! fem::createMesh: the velocity cosets and the pressure are gathered
+    //! in the slab decomposition of FFTW along the slowest direction, then
+    //! transformed, solved frequency by frequency with
+    //! periodic_stokes_symbol and transformed back. The cost is
+    //! O(N log N) and does not depend on the conditioning.
+    template<std::size_t Dimensions>
+    struct periodic_stokes_solver{
+      using symbol_type = periodic_stokes_symbol<Dimensions>;
+      using complex = typename symbol_type::complex;
+      static constexpr std::size_t nfields = symbol_type::nfields;
+
+      DM dm_ = nullptr;
+      std::shared_ptr<symbol_type> symbol_;
+      //! size of the pressure grid in the order of FFTW (slowest first)
+      std::array<ptrdiff_t, Dimensions> n_;
+      ptrdiff_t local_n0_, local_0_start_, nlocal_;
+      fftw_complex* data_ = nullptr;
+      fftw_plan forward_, backward_;
+      Vec slab_;
+      VecScatter scatter_u_, scatter_p_;
+
+      #undef __FUNCT__
+      #define __FUNCT__ "setup"
+      template<typename MatElemU, typename MatElemP>
+      PetscErrorCode setup(DM dm, MatElemU const& matelem_u, MatElemP const& matelem_p)
+      {
+        PetscErrorCode ierr;
+        DM dav, dap;
+        PetscInt M[3];
+        DMBoundaryType bd[3];
+        PetscFunctionBeginUser;
+
+        dm_ = dm;
+        ierr = DMCompositeGetEntries(dm_, &dav, &dap);CHKERRQ(ierr);
+        ierr = DMDAGetInfo(dap, nullptr, &M[0], &M[1], &M[2], nullptr, nullptr, nullptr,
+                           nullptr, nullptr, &bd[0], &bd[1], &bd[2], nullptr);CHKERRQ(ierr);
+
+        for(std::size_t d=0; d<Dimensions; ++d){
+          if (bd[d] != DM_BOUNDARY_PERIODIC)
+            SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_ARG_WRONG, "the FFT Stokes solver needs a periodic box");
+          if (M[d] < 2)
+            SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_ARG_WRONG, "the FFT Stokes solver needs at least 2 pressure points in each direction");
+          n_[d] = M[Dimensions-1-d];
+        }
+
+        symbol_.reset(new symbol_type(matelem_u, matelem_p));
+
+        static bool fftw_initialized = false;
+        if (!fftw_initialized){
+          fftw_mpi_init();
+          fftw_initialized = true;
+        }
+
+        MPI_Comm comm = PetscObjectComm((PetscObject)dm_);
+        ptrdiff_t alloc = fftw_mpi_local_size_many(Dimensions, n_.data(), nfields, FFTW_MPI_DEFAULT_BLOCK,
+                                                   comm, &local_n0_, &local_0_start_);
+        data_ = fftw_alloc_complex(alloc);
+        forward_ = fftw_mpi_plan_many_dft(Dimensions, n_.data(), nfields, FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK,
+                                          data_, data_, comm, FFTW_FORWARD, FFTW_MEASURE);
+        backward_ = fftw_mpi_plan_many_dft(Dimensions, n_.data(), nfields, FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK,
+                                           data_, data_, comm, FFTW_BACKWARD, FFTW_MEASURE);
+
+        ptrdiff_t plane = 1;
+        for(std::size_t d=1; d<Dimensions; ++d)
+          plane *= n_[d];
+        nlocal_ = local_n0_*plane;
+
+        ierr = VecCreateMPI(comm, nlocal_*nfields, PETSC_DETERMINE, &slab_);CHKERRQ(ierr);
+
+        // natural indices of the velocity cosets and of the pressure of the
+        // nodes of the slab and their position in the slab
+        std::vector<PetscInt> from_u, to_u, from_p, to_p;
+        from_u.reserve(nlocal_*symbol_type::nvelocity);
+        to_u.reserve(nlocal_*symbol_type::nvelocity);
+        for(ptrdiff_t i=0; i<nlocal_; ++i){
+          ptrdiff_t const m = local_0_start_*plane + i;
+          std::array<PetscInt, Dimensions> pos;
+          for(std::size_t d=0, r=m; d<Dimensions; r/=M[d], ++d)
+            pos[d] = r%M[d];
+
+          for(std::size_t c=0; c<symbol_type::ncosets; ++c){
+            PetscInt node = 0;
+            for(std::size_t d=Dimensions; d-- > 0;)
+              node = node*2*M[d] + 2*pos[d] + ((c>>d)&1);
+            for(std::size_t d=0; d<Dimensions; ++d){
+              from_u.push_back(Dimensions*node + d);
+              to_u.push_back(m*nfields + c*Dimensions + d);
+            }
+          }
+          from_p.push_back(m);
+          to_p.push_back(m*nfields + nfields - 1);
+        }
+
+        ierr = create_scatter(dav, from_u, to_u, scatter_u_);CHKERRQ(ierr);
+        ierr = create_scatter(dap, from_p, to_p, scatter_p_);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "create_scatter"
+      PetscErrorCode create_scatter(DM da, std::vector<PetscInt>& from, std::vector<PetscInt> const& to, VecScatter& scatter)
+      {
+        PetscErrorCode ierr;
+        AO ao;
+        IS is_from, is_to;
+        Vec v;
+        PetscFunctionBeginUser;
+
+        ierr = DMDAGetAO(da, &ao);CHKERRQ(ierr);
+        ierr = AOApplicationToPetsc(ao, from.size(), from.data());CHKERRQ(ierr);
+
+        MPI_Comm comm = PetscObjectComm((PetscObject)da);
+        ierr = ISCreateGeneral(comm, from.size(), from.data(), PETSC_COPY_VALUES, &is_from);CHKERRQ(ierr);
+        ierr = ISCreateGeneral(comm, to.size(), to.data(), PETSC_COPY_VALUES, &is_to);CHKERRQ(ierr);
+
+        ierr = DMGetGlobalVector(da, &v);CHKERRQ(ierr);
+        ierr = VecScatterCreate(v, is_from, slab_, is_to, &scatter);CHKERRQ(ierr);
+        ierr = DMRestoreGlobalVector(da, &v);CHKERRQ(ierr);
+
+        ierr = ISDestroy(&is_from);CHKERRQ(ierr);
+        ierr = ISDestroy(&is_to);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "apply"
+      //! x = A^{-1} b where A is the periodic Stokes operator.
+      PetscErrorCode apply(Vec b, Vec x)
+      {
+        PetscErrorCode ierr;
+        Vec vu, vp;
+        PetscScalar *array;
+        PetscFunctionBeginUser;
+
+        ierr = DMCompositeGetAccess(dm_, b, &vu, &vp);CHKERRQ(ierr);
+        ierr = VecScatterBegin(scatter_u_, vu, slab_, INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+        ierr = VecScatterBegin(scatter_p_, vp, slab_, INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+        ierr = VecScatterEnd(scatter_u_, vu, slab_, INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+        ierr = VecScatterEnd(scatter_p_, vp, slab_, INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+        ierr = DMCompositeRestoreAccess(dm_, b, &vu, &vp);CHKERRQ(ierr);
+
+        ierr = VecGetArray(slab_, &array);CHKERRQ(ierr);
+        for(ptrdiff_t i=0; i<nlocal_*static_cast<ptrdiff_t>(nfields); ++i){
+          data_[i][0] = array[i];
+          data_[i][1] = 0.;
+        }
+
+        fftw_execute(forward_);
+
+        ptrdiff_t plane = 1;
+        for(std::size_t d=1; d<Dimensions; ++d)
+          plane *= n_[d];
+
+        double const pi = std::acos(-1.);
+        #pragma omp parallel for
+        for(ptrdiff_t i=0; i<nlocal_; ++i){
+          // frequencies in the order x, y, z of the DMDA
+          std::array<double, Dimensions> phi;
+          ptrdiff_t r = local_0_start_*plane + i;
+          for(std::size_t d=Dimensions; d-- > 0;){
+            phi[Dimensions-1-d] = 2*pi*(r%n_[d])/n_[d];
+            r /= n_[d];
+          }
+          symbol_->solve(phi, reinterpret_cast<complex*>(data_ + i*nfields));
+        }
+
+        fftw_execute(backward_);
+
+        double scale = 1.;
+        for(auto n: n_)
+          scale /= n;
+        for(ptrdiff_t i=0; i<nlocal_*static_cast<ptrdiff_t>(nfields); ++i)
+          array[i] = scale*data_[i][0];
+        ierr = VecRestoreArray(slab_, &array);CHKERRQ(ierr);
+
+        ierr = DMCompositeGetAccess(dm_, x, &vu, &vp);CHKERRQ(ierr);
+        ierr = VecScatterBegin(scatter_u_, slab_, vu, INSERT_VALUES, SCATTER_REVERSE);CHKERRQ(ierr);
+        ierr = VecScatterBegin(scatter_p_, slab_, vp, INSERT_VALUES, SCATTER_REVERSE);CHKERRQ(ierr);
+        ierr = VecScatterEnd(scatter_u_, slab_, vu, INSERT_VALUES, SCATTER_REVERSE);CHKERRQ(ierr);
+        ierr = VecScatterEnd(scatter_p_, slab_, vp, INSERT_VALUES, SCATTER_REVERSE);CHKERRQ(ierr);
+        ierr = DMCompositeRestoreAccess(dm_, x, &vu, &vp);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "destroy"
+      PetscErrorCode destroy()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        fftw_destroy_plan(forward_);
+        fftw_destroy_plan(backward_);
+        fftw_free(data_);
+        data_ = nullptr;
+        ierr = VecDestroy(&slab_);CHKERRQ(ierr);
+        ierr = VecScatterDestroy(&scatter_u_);CHKERRQ(ierr);
+        ierr = VecScatterDestroy(&scatter_p_);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+    };
+  }
+}
+#endif
@@ -0,0 +1,103 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+#ifndef CAFES_FEM_SUBQUADRATURE_HPP_INCLUDED
+#define CAFES_FEM_SUBQUADRATURE_HPP_INCLUDED
+
+#include <fem/quadrature.hpp>
+#include <particle/geometry/position.hpp>
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace cafes
+{
+  namespace fem
+  {
+    //!
+    //! The scale^Dimensions points of the sub-grid of a cell of size h
+    //! (x first) with the P1 basis functions and their gradients at these
+    //! points. They do not depend on the cell: the kernels which integrate
+    //! on the sub-grid of each cell take them in this table.
+    //!
+    template<std::size_t Dimensions>
+    struct subquadrature
+    {
+      static constexpr std::size_t nbasis = 1 << Dimensions;
+
+      std::size_t scale;
+      std::array<double, Dimensions> h;
+      std::vector<geometry::position<double, Dimensions>> points; //!< position from the corner of the cell
+      std::vector<std::array<double, nbasis>> values;
+      std::vector<std::array<std::array<double, Dimensions>, nbasis>> gradients;
+
+      subquadrature(std::size_t s, std::array<double, Dimensions> const& hcell):
+      scale{s}, h{hcell}
+      {
+        std::size_t n = 1;
+        for(std::size_t d=0; d<Dimensions; ++d)
+          n *= scale;
+
+        points.resize(n);
+        values.resize(n);
+        gradients.resize(n);
+        for(std::size_t i=0; i<n; ++i){
+          std::size_t k = i;
+          for(std::size_t d=0; d<Dimensions; ++d){
+            points[i][d] = (k%scale)*(h[d]/scale);
+            k /= scale;
+          }
+          values[i] = P1_integration(points[i], h);
+          gradients[i] = P1_integration_grad(points[i], h);
+        }
+      }
+
+      std::size_t size() const
+      {
+        return points.size();
+      }
+    };
+
+    //! The table of the sub-grid (scale, h) built at the first call.
+    template<std::size_t Dimensions>
+    subquadrature<Dimensions> const& get_subquadrature(std::size_t scale, std::array<double, Dimensions> const& h)
+    {
+      using key_type = std::pair<std::size_t, std::array<double, Dimensions>>;
+      static std::map<key_type, subquadrature<Dimensions>> tables;
+
+      key_type key{scale, h};
+      auto it = tables.find(key);
+      if (it == tables.end())
+        it = tables.emplace(key, subquadrature<Dimensions>{scale, h}).first;
+      return it->second;
+    }
+  }
+}
+#endif
@@ -29,6 +29,7 @@
 #ifndef CAFES_PARTICLE_FORCES_TORQUES_HPP_INCLUDED
 #define CAFES_PARTICLE_FORCES_TORQUES_HPP_INCLUDED
 
+#include <particle/grid_index.hpp>
 #include <particle/singularity/add_singularity.hpp>
 
 namespace cafes
@@ -61,6 +62,8 @@ namespace cafes
 
     #undef __FUNCT__
     #define __FUNCT__ "forces_torques_with_control"
+    //! The fluid points inside the particles are taken in index if it is
+    //! given and built for these particles.
     template<std::size_t Dimensions, typename Shape, typename torque_type>
     PetscErrorCode forces_torques_with_control(std::vector<particle<Shape>> const& particles,
                                                Vec control,
@@ -69,7 +72,8 @@ namespace cafes
                                                torque_type& torques,
                                                std::vector<int> const& integration_points_size,
                                                std::array<double, Dimensions> const& h,
-                                               bool compute_singularity)
+                                               bool compute_singularity,
+                                               particle_grid_index<Dimensions> const* index = nullptr)
     {
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
@@ -83,18 +87,26 @@ namespace cafes
         auto p = particles[ipart];
         forces[ipart] = 0.;
         torques[ipart] = 0.;
-        auto pbox = p.bounding_box(h);
-        if (geometry::intersect(box, pbox)){
-          auto new_box = geometry::overlap_box(box, pbox);
-          auto pts = find_fluid_points_insides(p, new_box, h);
-          for(auto& ind: pts){
-            std::array<double, Dimensions> g;
-            for(std::size_t d=0; d<Dimensions; ++d){
-              forces[ipart][d] += pcontrol[icontrol];
-              g[d] = pcontrol[icontrol++];
-            }
-            set_torques(torques, ipart, p.center_, ind, g, h);
-          }       
+        auto add_point = [&](auto const& ind){
+          std::array<double, Dimensions> g;
+          for(std::size_t d=0; d<Dimensions; ++d){
+            forces[ipart][d] += pcontrol[icontrol];
+            g[d] = pcontrol[icontrol++];
+          }
+          set_torques(torques, ipart, p.center_, ind, g, h);
+        };
+
+        if (index && index->matches(particles))
+          for(std::size_t i=index->start[ipart]; i<index->start[ipart + 1]; ++i)
+            add_point(index->points[i]);
+        else{
+          auto pbox = p.bounding_box(h);
+          if (geometry::intersect(box, pbox)){
+            auto new_box = geometry::overlap_box(box, pbox);
+            auto pts = find_fluid_points_insides(p, new_box, h);
+            for(auto& ind: pts)
+              add_point(ind);
+          }
         }
         forces[ipart] *= p.volume()/integration_points_size[ipart];
         torques[ipart] *= p.volume()/integration_points_size[ipart]; 
@@ -83,6 +83,12 @@ namespace cafes
         super_ellipsoid& operator=(super_ellipsoid const&) = default;
         super_ellipsoid& operator=(super_ellipsoid&&)      = default;
 
+        //! The exponents of the shape as stored (2/n, 2/e; e is 0 in 2D).
+        std::array<double, 2> exponents() const
+        {
+          return {{n_, e_}};
+        }
+
         box<double, Dimensions> bounding_box() const
         {
           position_type bl{center_}, ur{center_};
@@ -311,6 +317,20 @@ namespace cafes
            return implicit(p) < 1.;
         }
 
+        //! the exponents are at least 1
+        bool is_convex() const
+        {
+           return n_ <= 2. && (Dimensions == 2 || e_ <= 2.);
+        }
+
+        //! The interval (x0, x1) of the points {x, p[1](, p[2])} inside the
+        //! super-ellipsoid, x0 > x1 if there is none. Returns false when
+        //! these points are not an interval (rotated and not convex).
+        bool row_interval(position_type const& p, double& x0, double& x1) const
+        {
+           return row_interval_(p, x0, x1, dimension_type{});
+        }
+
         private:
 
         double implicit(position_type const& p, int_<2> const&) const
@@ -337,6 +357,112 @@ namespace cafes
                 + std::pow( std::abs((p[2]-center_[2])/shape_factors_[2]), r1);
         }
 
+        bool row_interval_(position_type const& p, double& x0, double& x1, int_<2> const&) const
+        {
+           x0 = 1.;
+           x1 = 0.;
+
+           if (!q_.is_rotate())
+           {
+             auto r = 2./n_;
+             auto v = std::pow( std::abs((p[1]-center_[1])/shape_factors_[1]), r);
+             if (v < 1.)
+             {
+               auto half = shape_factors_[0]*std::pow(1. - v, 1./r);
+               x0 = center_[0] - half;
+               x1 = center_[0] + half;
+             }
+             return true;
+           }
+
+           // ellipse: second order polynomial in x
+           if (n_ == 1.)
+           {
+             auto rot = q_.conj();
+             auto w = rot.rotate(position_type{-center_[0], p[1]-center_[1]});
+             auto v = rot.rotate(position_type{1., 0.});
+             double a = 0., b = 0., c = -1.;
+             for(std::size_t d=0; d<2; ++d)
+             {
+               auto s2 = shape_factors_[d]*shape_factors_[d];
+               a += v[d]*v[d]/s2;
+               b += 2*w[d]*v[d]/s2;
+               c += w[d]*w[d]/s2;
+             }
+             auto delta = b*b - 4*a*c;
+             if (delta > 0.)
+             {
+               x0 = (-b - std::sqrt(delta))/(2*a);
+               x1 = (-b + std::sqrt(delta))/(2*a);
+             }
+             return true;
+           }
+
+           if (!is_convex())
+             return false;
+
+           // the implicit function is unimodal on the line: a point inside
+           // by golden section search, then the two ends by bisection
+           auto f = [&](double x){ return implicit(position_type{x, p[1]}); };
+           auto radius = std::sqrt(shape_factors_[0]*shape_factors_[0] + shape_factors_[1]*shape_factors_[1]);
+           auto tol = 1e-12*radius;
+           double l = center_[0] - radius, u = center_[0] + radius;
+           double const g = (std::sqrt(5.) - 1.)/2.;
+           double xl = u - g*(u - l), xu = l + g*(u - l);
+           double fl = f(xl), fu = f(xu);
+           while (fl >= 1. && fu >= 1. && u - l > tol)
+           {
+             if (fl < fu)
+             {
+               u = xu; xu = xl; fu = fl;
+               xl = u - g*(u - l); fl = f(xl);
+             }
+             else
+             {
+               l = xl; xl = xu; fl = fu;
+               xu = l + g*(u - l); fu = f(xu);
+             }
+           }
+           if (fl >= 1. && fu >= 1.)
+             return true;
+
+           auto xin = (fl < 1.)? xl: xu;
+           auto bisect = [&](double in, double out)
+           {
+             while (std::abs(out - in) > tol)
+             {
+               auto m = (in + out)/2;
+               if (f(m) < 1.) in = m; else out = m;
+             }
+             return in;
+           };
+           x0 = bisect(xin, center_[0] - radius);
+           x1 = bisect(xin, center_[0] + radius);
+           return true;
+        }
+
+        bool row_interval_(position_type const& p, double& x0, double& x1, int_<3> const&) const
+        {
+           auto r1 = 2./n_;
+           auto r2 = e_/n_;
+           auto r3 = 2./e_;
+
+           x0 = 1.;
+           x1 = 0.;
+
+           auto vz = std::pow( std::abs((p[2]-center_[2])/shape_factors_[2]), r1);
+           if (vz >= 1.)
+             return true;
+           auto vxy = std::pow(1. - vz, 1./r2) - std::pow( std::abs((p[1]-center_[1])/shape_factors_[1]), r3);
+           if (vxy > 0.)
+           {
+             auto half = shape_factors_[0]*std::pow(vxy, 1./r3);
+             x0 = center_[0] - half;
+             x1 = center_[0] + half;
+           }
+           return true;
+        }
+
         static double c(double w, double m)
         {
           auto cw = std::cos(w);
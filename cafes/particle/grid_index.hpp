@@ -0,0 +1,171 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+#ifndef CAFES_PARTICLE_GRID_INDEX_HPP_INCLUDED
+#define CAFES_PARTICLE_GRID_INDEX_HPP_INCLUDED
+
+#include <particle/geometry/position.hpp>
+#include <petsc/vec.hpp>
+
+#include <petsc.h>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace cafes
+{
+  //!
+  //! The fluid points of the local box inside each particle, found once
+  //! for a configuration of the particles instead of scanning the bounding
+  //! boxes at each product of the particle operators. The points of the
+  //! particle i are [start[i], start[i+1]) in the order of the unknowns of
+  //! the SEM and DtoN problems, with their node offsets in the ghosted
+  //! local array and in the global array of the velocity DMDA.
+  //!
+  //! It is built by set_materials with the unknowns of the problem and
+  //! keyed on the geometry of the particles: when they move or turn,
+  //! create_Mat_and_Vec must be called again since the sizes of the shell
+  //! matrix and of its vectors change as well (see check).
+  //!
+  template<std::size_t Dimensions>
+  struct particle_grid_index
+  {
+    using position_type_i = geometry::position<int, Dimensions>;
+
+    std::vector<position_type_i> points;
+    std::vector<std::ptrdiff_t> local_nodes;
+    std::vector<std::ptrdiff_t> global_nodes;
+    std::vector<std::size_t> start{0};
+    std::vector<double> geometry;   //!< Key of the particles of the index (see geometry_of)
+
+    void clear()
+    {
+      points.clear();
+      local_nodes.clear();
+      global_nodes.clear();
+      start.assign(1, 0);
+      geometry.clear();
+    }
+
+    //! The centers, the shape factors and the orientations of the
+    //! particles parts.
+    template<typename Parts>
+    static std::vector<double> geometry_of(Parts const& parts)
+    {
+      std::vector<double> g;
+      for(auto& p: parts){
+        g.insert(g.end(), p.center_.begin(), p.center_.end());
+        g.insert(g.end(), p.shape_factors_.begin(), p.shape_factors_.end());
+        for(std::size_t d=0; d<4; ++d)
+          g.push_back(p.q_.components_[d]);
+      }
+      return g;
+    }
+
+    //! Keys the index on the particles parts once their points are added.
+    template<typename Parts>
+    void set_geometry(Parts const& parts)
+    {
+      geometry = geometry_of(parts);
+    }
+
+    //! The index was built for the particles parts at their current
+    //! positions and orientations.
+    template<typename Parts>
+    bool matches(Parts const& parts) const
+    {
+      return start.size() == parts.size() + 1 && geometry == geometry_of(parts);
+    }
+
+    //! Adds the points of the next particle.
+    void push_back(std::vector<position_type_i> const& pts)
+    {
+      points.insert(points.end(), pts.begin(), pts.end());
+      start.push_back(points.size());
+    }
+
+    std::size_t size(std::size_t ipart) const
+    {
+      return start[ipart + 1] - start[ipart];
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "particle_grid_index::set_layout"
+    //! Computes the node offsets of the points for the velocity DMDA of dm
+    //! (the first entry if dm is a DMComposite).
+    PetscErrorCode set_layout(DM dm)
+    {
+      PetscErrorCode ierr;
+      PetscBool iscomposite;
+      DMDALocalInfo info;
+      PetscFunctionBeginUser;
+
+      ierr = PetscObjectTypeCompare((PetscObject)dm, DMCOMPOSITE, &iscomposite);CHKERRQ(ierr);
+      ierr = DMDAGetLocalInfo((iscomposite)? petsc::get_DM(dm, 0): dm, &info);CHKERRQ(ierr);
+
+      std::array<int, 3> gcorner{{info.gxs, info.gys, info.gzs}}, gsize{{info.gxm, info.gym, info.gzm}};
+      std::array<int, 3> corner{{info.xs, info.ys, info.zs}}, size{{info.xm, info.ym, info.zm}};
+
+      local_nodes.resize(points.size());
+      global_nodes.resize(points.size());
+      for(std::size_t i=0; i<points.size(); ++i){
+        std::ptrdiff_t l = 0, g = 0;
+        for(int d=Dimensions-1; d>=0; --d){
+          l = l*gsize[d] + points[i][d] - gcorner[d];
+          g = g*size[d] + points[i][d] - corner[d];
+        }
+        local_nodes[i] = l;
+        global_nodes[i] = g;
+      }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "particle_grid_index::check"
+    //! Checks that the index was built for the particles parts where they
+    //! are and that v has its layout: Dimensions values for each point.
+    template<typename Parts>
+    PetscErrorCode check(Parts const& parts, Vec v) const
+    {
+      PetscErrorCode ierr;
+      PetscInt size;
+      PetscFunctionBeginUser;
+
+      if (!matches(parts))
+        SETERRQ(PETSC_COMM_SELF, PETSC_ERR_ARG_WRONGSTATE, "the particles have moved since the fluid points inside them were found: call create_Mat_and_Vec after the particles move");
+
+      ierr = VecGetLocalSize(v, &size);CHKERRQ(ierr);
+      if (static_cast<std::size_t>(size) != points.size()*Dimensions)
+        SETERRQ2(PETSC_COMM_SELF, PETSC_ERR_ARG_SIZ, "the vector has %D local values for %D fluid points inside the particles: call create_Mat_and_Vec after the particles move",
+                 size, static_cast<PetscInt>(points.size()));
+
+      PetscFunctionReturn(0);
+    }
+  };
+}
+#endif
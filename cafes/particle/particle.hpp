@@ -58,8 +58,12 @@
 
 #include <array>
 #include <algorithm>
+#include <cmath>
 #include <initializer_list>
 #include <numeric>
+#include <vector>
+#include <algorithm/iterate.hpp>
+#include <fem/subquadrature.hpp>
 #include <particle/physics/force.hpp>
 #include <particle/physics/velocity.hpp>
 #include <particle/geometry/box.hpp>
@@ -91,9 +95,13 @@ namespace cafes
 
       using Shape::surface;
       using Shape::contains;
+      using Shape::is_convex;
+      using Shape::row_interval;
       using Shape::bounding_box;
       using Shape::center_;
       using Shape::shape_factors_;
+      using Shape::q_;
+      using Shape::exponents;
       using Shape::surface_area;
       using Shape::volume;
       using Shape::Cd_R;
@@ -108,39 +116,85 @@ namespace cafes
       //                  geometry::vector<double, 3>> angular_velocity_;
   };
 
-  template<typename Shape>
-  auto find_fluid_points_insides( particle<Shape> const& p, cafes::geometry::box<int, 2> const& b, std::array<double, 2> const& h)
+  //! The nodes {start[0] + i, start[1](, start[2])} for 0 <= i < length,
+  //! in the indices of the DMDA.
+  template<std::size_t Dimensions>
+  struct node_run
+  {
+    geometry::position<int, Dimensions> start;
+    int length;
+  };
+
+  //! The nodes of the box b inside the particle p as runs along x, row by
+  //! row. The inside interval of a row is given by the shape (see
+  //! super_ellipsoid::row_interval) and only its ends are tested with
+  //! contains(). The rows where it is not an interval are tested node by
+  //! node.
+  template<typename Shape, std::size_t Dimensions>
+  std::vector<node_run<Dimensions>> find_fluid_runs_insides(particle<Shape> const& p,
+                                                            geometry::box<int, Dimensions> const& b,
+                                                            std::array<double, Dimensions> const& h)
   {
-      std::vector<geometry::position<int, 2>> that;
-      that.reserve(b.length());
-
-      double x, y;
-      std::size_t ix, iy;
-      for(y=b.bottom_left[1]*h[1], iy=b.bottom_left[1]; iy<b.upper_right[1]; y+=h[1], ++iy)
-          for(x=b.bottom_left[0]*h[0], ix=b.bottom_left[0]; ix<b.upper_right[0]; x+=h[0], ++ix)
-          {
-              cafes::geometry::position<double, 2> pt {x,y};
-              if(p.contains(pt)) that.push_back({ix, iy});
+    std::vector<node_run<Dimensions>> runs;
+
+    auto rows = b;
+    rows.upper_right[0] = rows.bottom_left[0] + 1;
+
+    algorithm::iterate(rows, [&](auto const& row){
+      geometry::position<double, Dimensions> pt;
+      for(std::size_t d=0; d<Dimensions; ++d)
+        pt[d] = row[d]*h[d];
+
+      auto inside = [&](int ix){
+        pt[0] = ix*h[0];
+        return p.contains(pt);
+      };
+      auto add_run = [&](int i0, int i1){
+        geometry::position<int, Dimensions> start = row;
+        start[0] = i0;
+        runs.push_back({start, i1 - i0 + 1});
+      };
+
+      double x0, x1;
+      if (p.row_interval(pt, x0, x1)){
+        if (x0 > x1)
+          return;
+        // one node of margin for the rounding errors
+        int i0 = std::max<int>(b.bottom_left[0], std::floor(x0/h[0]));
+        int i1 = std::min<int>(b.upper_right[0] - 1, std::ceil(x1/h[0]));
+        while (i0 <= i1 && !inside(i0))
+          ++i0;
+        while (i1 >= i0 && !inside(i1))
+          --i1;
+        if (i0 <= i1)
+          add_run(i0, i1);
+      }
+      else{
+        int i0 = b.bottom_left[0];
+        for(int ix=b.bottom_left[0]; ix<b.upper_right[0]; ++ix)
+          if (!inside(ix)){
+            if (i0 < ix)
+              add_run(i0, ix - 1);
+            i0 = ix + 1;
           }
+        if (i0 < b.upper_right[0])
+          add_run(i0, b.upper_right[0] - 1);
+      }
+    });
 
-      return that;
+    return runs;
   }
 
-  template<typename Shape>
-  auto find_fluid_points_insides( particle<Shape> const& p, cafes::geometry::box<int, 3> const& b, std::array<double, 3> const& h)
+  template<typename Shape, std::size_t Dimensions>
+  auto find_fluid_points_insides( particle<Shape> const& p, cafes::geometry::box<int, Dimensions> const& b, std::array<double, Dimensions> const& h)
   {
-    std::vector<geometry::position<int, 3>> that;
-    that.reserve(b.length());
-
-    double x, y, z;
-    std::size_t ix, iy, iz;
-    for(z=b.bottom_left[2]*h[2], iz=b.bottom_left[2]; iz<b.upper_right[2]; z+=h[2], ++iz)
-        for(y=b.bottom_left[1]*h[1], iy=b.bottom_left[1]; iy<b.upper_right[1]; y+=h[1], ++iy)
-            for(x=b.bottom_left[0]*h[0], ix=b.bottom_left[0]; ix<b.upper_right[0]; x+=h[0], ++ix)
-            {
-               cafes::geometry::position<double, 3> pt {x, y, z};
-               if(p.contains(pt)) that.push_back({ix, iy, iz});
-            }   
+    std::vector<geometry::position<int, Dimensions>> that;
+
+    for(auto& run: find_fluid_runs_insides(p, b, h))
+      for(int i=0; i<run.length; ++i){
+        that.push_back(run.start);
+        that.back()[0] += i;
+      }
 
     return that;
   }
@@ -227,19 +281,219 @@ namespace cafes
   //   return kernel_pos;
   // };
 
-  auto kernel_num_count = [](auto const& p, auto const& h, auto const& hs, auto& box_scale, auto& num)
+  namespace detail
   {
-    auto const kernel_pos = [&](auto const& pos){
-      auto const kernel = [&](auto const& pos_scale)
-      {
-        auto pts = pos*h + pos_scale*hs;
-        if (p.contains(pts))
-          num++;
+    //! Sub-points [a, a + m) of the sub-grid of the cell pos inside the
+    //! convex particle p: the blocks with their corners inside are inside,
+    //! the blocks with their corners outside are outside and the others
+    //! are split in 2^Dimensions blocks down to the sub-points.
+    template<typename Shape, std::size_t Dimensions, typename sub_type, typename Kernel>
+    void refine_inside(particle<Shape> const& p, geometry::position<int, Dimensions> const& pos,
+                       std::array<double, Dimensions> const& h, sub_type const& sub,
+                       std::array<std::size_t, Dimensions> const& a, std::array<std::size_t, Dimensions> const& m,
+                       bool split, Kernel& kernel)
+    {
+      auto const scale = sub.scale;
+      auto index = [&](std::array<std::size_t, Dimensions> const& k){
+        std::size_t i = 0;
+        for(int d=Dimensions-1; d>=0; --d)
+          i = i*scale + k[d];
+        return i;
       };
-      algorithm::iterate(box_scale, kernel);
+
+      std::size_t nleaf = 1;
+      for(std::size_t d=0; d<Dimensions; ++d)
+        nleaf *= m[d];
+
+      if (nleaf == 1){
+        auto i = index(a);
+        if (p.contains(pos*h + sub.points[i]))
+          kernel(pos, i);
+        return;
+      }
+
+      if (!split){
+        std::size_t inside = 0;
+        for(std::size_t c=0; c<(1u << Dimensions); ++c){
+          geometry::position<double, Dimensions> x;
+          for(std::size_t d=0; d<Dimensions; ++d)
+            x[d] = pos[d]*h[d] + (a[d] + ((c>>d)&1)*m[d])*(h[d]/scale);
+          inside += p.contains(x);
+        }
+        if (inside == 0)
+          return;
+        if (inside == (1u << Dimensions)){
+          for(std::size_t l=0; l<nleaf; ++l){
+            std::array<std::size_t, Dimensions> k;
+            std::size_t r = l;
+            for(std::size_t d=0; d<Dimensions; ++d){
+              k[d] = a[d] + r%m[d];
+              r /= m[d];
+            }
+            kernel(pos, index(k));
+          }
+          return;
+        }
+      }
+
+      for(std::size_t c=0; c<(1u << Dimensions); ++c){
+        std::array<std::size_t, Dimensions> ac, mc;
+        bool empty = false;
+        for(std::size_t d=0; d<Dimensions; ++d){
+          auto half = m[d]/2;
+          if ((c>>d)&1){
+            empty |= (half == 0);
+            ac[d] = a[d] + half;
+            mc[d] = m[d] - half;
+          }
+          else{
+            ac[d] = a[d];
+            mc[d] = (half == 0)? m[d]: half;
+          }
+        }
+        if (!empty)
+          refine_inside(p, pos, h, sub, ac, mc, false, kernel);
+      }
+    }
+  }
+
+  //! Calls kernel(pos, i) for the sub-points i of the table sub (see
+  //! fem::subquadrature) of the cells pos of box which are inside the
+  //! particle p. For a convex particle, a cell whose corners are all
+  //! inside is inside and the cells cut by the surface are refined as an
+  //! octree. A cell whose corners are all outside can still hold
+  //! sub-points where the surface crosses one of its edges: the particle
+  //! being convex, this only happens on the grid lines without a node
+  //! inside. The sub-points on the edges of these lines are tested and
+  //! the cells around an edge with a sub-point inside are sub-sampled,
+  //! as the whole box when it has no node inside (a particle smaller than
+  //! a cell). The blocks of the octree are still classified by their
+  //! corners: a surface crossing the edge of a block of k sub-cells
+  //! between two of its corners outside, which is thinner than
+  //! (k h/scale)^2/(8 R), is missed by the counting and by the projection
+  //! alike. The sub-points of the other particles are all tested.
+  template<typename Shape, std::size_t Dimensions, typename sub_type, typename Kernel>
+  void iterate_inside(particle<Shape> const& p, geometry::box<int, Dimensions> const& box,
+                      std::array<double, Dimensions> const& h, sub_type const& sub, Kernel&& kernel)
+  {
+    auto sample = [&](auto const& pos){
+      for(std::size_t i=0; i<sub.size(); ++i)
+        if (p.contains(pos*h + sub.points[i]))
+          kernel(pos, i);
     };
-    return kernel_pos;
-  };
+
+    if (!p.is_convex()){
+      algorithm::iterate(box, sample);
+      return;
+    }
+
+    // the corners of the cells are tested once
+    std::array<std::size_t, Dimensions> n, stride;
+    std::size_t nnodes = 1;
+    for(std::size_t d=0; d<Dimensions; ++d){
+      n[d] = box.upper_right[d] - box.bottom_left[d] + 1;
+      stride[d] = nnodes;
+      nnodes *= n[d];
+    }
+    auto node = [&](std::size_t l){
+      std::array<std::size_t, Dimensions> k;
+      for(std::size_t d=0; d<Dimensions; ++d){
+        k[d] = l%n[d];
+        l /= n[d];
+      }
+      return k;
+    };
+    auto node_position = [&](std::array<std::size_t, Dimensions> const& k){
+      geometry::position<double, Dimensions> x;
+      for(std::size_t d=0; d<Dimensions; ++d)
+        x[d] = (box.bottom_left[d] + static_cast<int>(k[d]))*h[d];
+      return x;
+    };
+
+    std::vector<char> node_inside(nnodes);
+    bool any_inside = false;
+    for(std::size_t l=0; l<nnodes; ++l){
+      node_inside[l] = p.contains(node_position(node(l)));
+      any_inside |= node_inside[l];
+    }
+
+    if (!any_inside){
+      algorithm::iterate(box, sample);
+      return;
+    }
+
+    // the cells (by their lower corner) around an edge crossed by the
+    // surface between two nodes outside
+    std::vector<char> crossed(nnodes, 0);
+    for(std::size_t d=0; d<Dimensions; ++d)
+      for(std::size_t l=0; l<nnodes; ++l){
+        auto k = node(l);
+        if (k[d] != 0)
+          continue;
+
+        bool line_inside = false;
+        for(std::size_t j=0; j<n[d]; ++j)
+          line_inside |= node_inside[l + j*stride[d]];
+        if (line_inside)
+          continue;
+
+        for(k[d]=0; k[d]+1<n[d]; ++k[d]){
+          bool hit = false;
+          auto x = node_position(k);
+          for(std::size_t j=1; j<sub.scale && !hit; ++j){
+            auto y = x;
+            y[d] += j*(h[d]/sub.scale);
+            hit = p.contains(y);
+          }
+          if (!hit)
+            continue;
+
+          for(std::size_t c=0; c<(1u << Dimensions); ++c){
+            if ((c>>d)&1)
+              continue;
+            bool valid = true;
+            std::size_t cell = 0;
+            for(std::size_t dd=0; dd<Dimensions; ++dd){
+              std::size_t kc = k[dd];
+              if ((c>>dd)&1){
+                valid &= (kc > 0);
+                kc--;
+              }
+              valid &= (kc + 1 < n[dd]);
+              cell += kc*stride[dd];
+            }
+            if (valid)
+              crossed[cell] = 1;
+          }
+        }
+      }
+
+    std::array<std::size_t, Dimensions> a, m;
+    a.fill(0);
+    m.fill(sub.scale);
+
+    algorithm::iterate(box, [&](auto const& pos){
+      std::size_t l0 = 0;
+      for(std::size_t d=0; d<Dimensions; ++d)
+        l0 += (pos[d] - box.bottom_left[d])*stride[d];
+
+      std::size_t inside = 0;
+      for(std::size_t c=0; c<(1u << Dimensions); ++c){
+        std::size_t l = l0;
+        for(std::size_t d=0; d<Dimensions; ++d)
+          l += ((c>>d)&1)*stride[d];
+        inside += node_inside[l];
+      }
+
+      if (inside == (1u << Dimensions))
+        for(std::size_t i=0; i<sub.size(); ++i)
+          kernel(pos, i);
+      else if (inside > 0)
+        detail::refine_inside(p, pos, h, sub, a, m, true, kernel);
+      else if (crossed[l0])
+        sample(pos);
+    });
+  }
 
   template<std::size_t Dimensions,
            typename part_type,
@@ -248,10 +502,12 @@ namespace cafes
            typename nb_type,
            typename num_type,
            typename box_type,
-           typename dpart_type>
+           typename dpart_type,
+           typename index_type>
   auto set_materials(part_type& parts, surf_type& surf_points, radial_type& radial_vec,
                      nb_type& nb_surf_points, num_type& num, box_type const& box,
-                     std::array<double, Dimensions> const &h, dpart_type const& dpart, std::size_t const scale)
+                     std::array<double, Dimensions> const &h, dpart_type const& dpart, std::size_t const scale,
+                     index_type& index)
   {
     surf_points.resize(parts.size());
     radial_vec.resize(parts.size());
@@ -261,21 +517,17 @@ namespace cafes
     std::size_t size = 0;
     std::size_t ipart = 0;
 
-    std::array<double, Dimensions> hs;
-    for(std::size_t d=0; d<Dimensions; ++d)
-      hs[d] = h[d]/scale;
-
-    geometry::position<std::size_t, Dimensions> p1, p2;
-    p1.fill(0);
-    p2.fill(scale);
-    geometry::box<std::size_t, Dimensions> box_scale{ p1, p2};
+    auto const& sub = fem::get_subquadrature(scale, h);
 
+    // the points found here are kept in the index of the particle operators
+    index.clear();
     for(auto& p: parts){
       auto pbox = p.bounding_box(h);
       if (geometry::intersect(box, pbox)){
         auto new_box = geometry::box_inside(box, pbox);
         auto pts = find_fluid_points_insides(p, new_box, h);
         size += pts.size();
+        index.push_back(pts);
 
         auto spts = p.surface(dpart);
         auto spts_valid = find_surf_points_insides(spts, new_box, h);
@@ -285,12 +537,16 @@ namespace cafes
         auto radial_valid = find_radial_surf_points_insides(spts, new_box, h, p.center_);
         radial_vec[ipart].assign(radial_valid.begin(), radial_valid.end());
         
-        algorithm::iterate(new_box, kernel_num_count(p, h, hs, box_scale, num[ipart]));
+        iterate_inside(p, new_box, h, sub, [&](auto const&, std::size_t){num[ipart]++;});
 
       }
+      else
+        index.push_back({});
       ipart++;
     }
 
+    index.set_geometry(parts);
+
     MPI_Allreduce(MPI_IN_PLACE, nb_surf_points.data(), parts.size(), MPI_INT, MPI_SUM, PETSC_COMM_WORLD);
     MPI_Allreduce(MPI_IN_PLACE, num.data(), parts.size(), MPI_INT, MPI_SUM, PETSC_COMM_WORLD);
 
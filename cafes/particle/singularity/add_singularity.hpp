@@ -67,7 +67,7 @@ namespace cafes
       using position_type = geometry::position<double, Dimensions>;
       using position_type_i = geometry::position<int, Dimensions>;
 
-      std::array<double, Dimensions> hs = {{h[0]/sing.scale, h[1]/sing.scale}};
+      auto const& sub = fem::get_subquadrature(sing.scale, h);
       double coef = 1./(sing.scale*sing.scale);
 
       for(std::size_t j=box.bottom_left[1]; j<box.upper_right[1]; ++j)
@@ -77,35 +77,30 @@ namespace cafes
           position_type_i pts_i = {i, j};
           auto ielem = fem::get_element(pts_i);
 
-          for(std::size_t js=0; js<sing.scale; ++js)
+          for(std::size_t is=0; is<sub.size(); ++is)
           {
-            for(std::size_t is=0; is<sing.scale; ++is)
+            position_type pts = {i*h[0] + sub.points[is][0], j*h[1] + sub.points[is][1]};
+
+            if (!p1.contains(pts) && !p2.contains(pts))
             {
-              position_type pts = {i*h[0] + is*hs[0], j*h[1] + js*hs[1]};
+              auto pos_ref_part = sing.get_pos_in_part_ref(pts);
 
-              if (!p1.contains(pts) && !p2.contains(pts))
+              if (std::abs(pos_ref_part[1]) <= sing.cutoff_dist_)
               {
-                auto pos_ref_part = sing.get_pos_in_part_ref(pts);
+                auto& bfunc = sub.gradients[is];
 
-                if (std::abs(pos_ref_part[1]) <= sing.cutoff_dist_)
+                auto gradUsing = sing.get_grad_u_sing(pts);
+                auto psing = sing.get_p_sing(pts);
+                
+                for (std::size_t je=0; je<bfunc.size(); ++je)
                 {
-                  position_type pts_loc = {is*hs[0], js*hs[1]};
-
-                  auto bfunc = fem::P1_integration_grad(pts_loc, h);
+                  auto u = sol.at(ielem[je]);
 
-                  auto gradUsing = sing.get_grad_u_sing(pts);
-                  auto psing = sing.get_p_sing(pts);
-                  
-                  for (std::size_t je=0; je<bfunc.size(); ++je)
+                  for (std::size_t d1=0; d1<Dimensions; ++d1)
                   {
-                    auto u = sol.at(ielem[je]);
-
-                    for (std::size_t d1=0; d1<Dimensions; ++d1)
-                    {
-                      for (std::size_t d2=0; d2<Dimensions; ++d2)
-                        u[d1] -= coef*gradUsing[d1][d2]*bfunc[je][d2];
-                    u[d1] += coef*psing*bfunc[je][d1];
-                    }
+                    for (std::size_t d2=0; d2<Dimensions; ++d2)
+                      u[d1] -= coef*gradUsing[d1][d2]*bfunc[je][d2];
+                  u[d1] += coef*psing*bfunc[je][d1];
                   }
                 }
               }
@@ -191,9 +186,7 @@ namespace cafes
       using position_type = geometry::position<double, Dimensions>;
       using position_type_i = geometry::position<int, Dimensions>;
 
-      std::array<double, Dimensions> hs = {{ h[0]/sing.scale, 
-                                             h[1]/sing.scale,
-                                             h[2]/sing.scale }};
+      auto const& sub = fem::get_subquadrature(sing.scale, h);
 
       double coef = 1./(sing.scale*sing.scale*sing.scale);
 
@@ -206,38 +199,28 @@ namespace cafes
             position_type_i pts_i = {i, j, k};
             auto ielem = fem::get_element(pts_i);
 
-            for(std::size_t ks=0; ks<sing.scale; ++ks)
+            for(std::size_t is=0; is<sub.size(); ++is)
             {
-              for(std::size_t js=0; js<sing.scale; ++js)
+              position_type pts = {i*h[0] + sub.points[is][0], 
+                                   j*h[1] + sub.points[is][1],
+                                   k*h[2] + sub.points[is][2] };
+
+              if (!p1.contains(pts) && !p2.contains(pts))
               {
-                for(std::size_t is=0; is<sing.scale; ++is)
+                auto& bfunc = sub.gradients[is];
+
+                auto gradUsing = sing.get_grad_u_sing(pts);
+                auto psing = sing.get_p_sing(pts);
+                
+                for (std::size_t je=0; je<bfunc.size(); ++je)
                 {
-                  position_type pts = {i*h[0] + is*hs[0], 
-                                       j*h[1] + js*hs[1],
-                                       k*h[2] + ks*hs[2] };
+                  auto u = sol.at(ielem[je]);
 
-                  if (!p1.contains(pts) && !p2.contains(pts))
+                  for (std::size_t d1=0; d1<Dimensions; ++d1)
                   {
-                    position_type pts_loc = {is*hs[0], 
-                                             js*hs[1],
-                                             ks*hs[2]};
-
-                    auto bfunc = fem::P1_integration_grad(pts_loc, h);
-
-                    auto gradUsing = sing.get_grad_u_sing(pts);
-                    auto psing = sing.get_p_sing(pts);
-                    
-                    for (std::size_t je=0; je<bfunc.size(); ++je)
-                    {
-                      auto u = sol.at(ielem[je]);
-
-                      for (std::size_t d1=0; d1<Dimensions; ++d1)
-                      {
-                        for (std::size_t d2=0; d2<Dimensions; ++d2)
-                          u[d1] -= coef*gradUsing[d1][d2]*bfunc[je][d2];
-                      u[d1] += coef*psing*bfunc[je][d1];
-                      }
-                    }
+                    for (std::size_t d2=0; d2<Dimensions; ++d2)
+                      u[d1] -= coef*gradUsing[d1][d2]*bfunc[je][d2];
+                  u[d1] += coef*psing*bfunc[je][d1];
                   }
                 }
               }
@@ -408,7 +391,7 @@ namespace cafes
       using position_type = geometry::position<double, Dimensions>;
       using position_type_i = geometry::position<int, Dimensions>;
 
-      std::array<double, Dimensions> hs = {{h[0]/sing.scale, h[1]/sing.scale}};
+      auto const& sub = fem::get_subquadrature(sing.scale, h);
       double coef = 1./(sing.scale*sing.scale);
 
       for(std::size_t j=box.bottom_left[1]; j<box.upper_right[1]; ++j)
@@ -418,31 +401,26 @@ namespace cafes
           position_type_i pts_i = {i, j};
           auto ielem = fem::get_element(pts_i);
 
-          for(std::size_t js=0; js<sing.scale; ++js)
+          for(std::size_t is=0; is<sub.size(); ++is)
           {
-            for(std::size_t is=0; is<sing.scale; ++is)
+            position_type pts = {i*h[0] + sub.points[is][0], j*h[1] + sub.points[is][1]};
+
+            if (!p1.contains(pts) && !p2.contains(pts))
             {
-              position_type pts = {i*h[0] + is*hs[0], j*h[1] + js*hs[1]};
+              auto pos_ref_part = sing.get_pos_in_part_ref(pts);
 
-              if (!p1.contains(pts) && !p2.contains(pts))
+              if (std::abs(pos_ref_part[1]) <= sing.cutoff_dist_)
               {
-                auto pos_ref_part = sing.get_pos_in_part_ref(pts);
+                auto& bfunc = sub.values[is];
 
-                if (std::abs(pos_ref_part[1]) <= sing.cutoff_dist_)
+                auto Using = sing.get_u_sing(pts);
+                
+                for (std::size_t je=0; je<bfunc.size(); ++je)
                 {
-                  position_type pts_loc = {is*hs[0], js*hs[1]};
-
-                  auto bfunc = fem::P1_integration(pts_loc, h);
-
-                  auto Using = sing.get_u_sing(pts);
-                  
-                  for (std::size_t je=0; je<bfunc.size(); ++je)
-                  {
-                    auto u = sol.at(ielem[je]);
+                  auto u = sol.at(ielem[je]);
 
-                    for (std::size_t d=0; d<Dimensions; ++d)
-                      u[d] += coef*Using[d]*bfunc[je];
-                  }
+                  for (std::size_t d=0; d<Dimensions; ++d)
+                    u[d] += coef*Using[d]*bfunc[je];
                 }
               }
             }
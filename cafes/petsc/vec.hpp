@@ -29,11 +29,24 @@
 #ifndef CAFES_PETSC_VEC_HPP_INCLUDED
 #define CAFES_PETSC_VEC_HPP_INCLUDED
 
+#include <algorithm/iterate.hpp>
+#include <fem/mesh.hpp>
+#include <particle/geometry/box.hpp>
 #include <particle/geometry/position.hpp>
 #include <petsc.h>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <iostream>
+#include <memory>
 #include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace cafes
 {
@@ -64,6 +77,210 @@ namespace cafes
       DMCompositeRestoreAccessArray(dm, v, 1, entries, vtmp);
     }
 
+    struct local_vector_entry{
+      Vec v;
+      PetscScalar* array;
+      bool used;
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "destroy_local_vector_pool"
+    //! User destroy of the container of the pool: called by PETSc when the
+    //! DM which owns the pool is destroyed.
+    PetscErrorCode destroy_local_vector_pool(void* ctx)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      auto pool = static_cast<std::vector<local_vector_entry>*>(ctx);
+      for(auto& e: *pool)
+      {
+        ierr = VecDestroy(&e.v);CHKERRQ(ierr);
+        delete [] e.array;
+      }
+      delete pool;
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "get_local_vector_pool"
+    //! Returns the pool of the local vectors of dm. The pool is composed
+    //! with the DM so that its arrays are freed with it.
+    PetscErrorCode get_local_vector_pool(DM dm, std::vector<local_vector_entry>** pool, bool create)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      PetscContainer container = nullptr;
+      ierr = PetscObjectQuery((PetscObject)dm, "cafes_local_vector_pool", (PetscObject*)&container);CHKERRQ(ierr);
+      if (container)
+      {
+        ierr = PetscContainerGetPointer(container, (void**)pool);CHKERRQ(ierr);
+        PetscFunctionReturn(0);
+      }
+
+      *pool = nullptr;
+      if (!create)
+        PetscFunctionReturn(0);
+
+      *pool = new std::vector<local_vector_entry>;
+      ierr = PetscContainerCreate(PETSC_COMM_SELF, &container);CHKERRQ(ierr);
+      ierr = PetscContainerSetPointer(container, *pool);CHKERRQ(ierr);
+      ierr = PetscContainerSetUserDestroy(container, destroy_local_vector_pool);CHKERRQ(ierr);
+      ierr = PetscObjectCompose((PetscObject)dm, "cafes_local_vector_pool", (PetscObject)container);CHKERRQ(ierr);
+      // the DM holds the only reference
+      ierr = PetscContainerDestroy(&container);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "get_local_vector"
+    //! Same as DMGetLocalVector but, when several threads are used, the
+    //! array is allocated by us and first touched by the threads plane by
+    //! plane along the outermost direction with the static schedule of
+    //! algorithm::iterate_colored. The pages are then on the NUMA node of
+    //! the thread which computes on them. The arrays are kept on the DM
+    //! and freed when it is destroyed.
+    PetscErrorCode get_local_vector(DM dm, Vec* v)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+#ifdef _OPENMP
+      if (omp_get_max_threads() > 1)
+      {
+        std::vector<local_vector_entry>* pool;
+        ierr = get_local_vector_pool(dm, &pool, true);CHKERRQ(ierr);
+        for(auto& e: *pool)
+        {
+          if (!e.used)
+          {
+            e.used = true;
+            *v = e.v;
+            PetscFunctionReturn(0);
+          }
+        }
+
+        DMDALocalInfo info;
+        ierr = DMDAGetLocalInfo(dm, &info);CHKERRQ(ierr);
+
+        int const nplanes = (info.dim == 3)? info.gzm: info.gym;
+        std::size_t const plane_size = static_cast<std::size_t>(info.dof)*info.gxm*((info.dim == 3)? info.gym: 1);
+        std::size_t const size = plane_size*nplanes;
+
+        // new without () does not initialize the array
+        auto array = new PetscScalar[size];
+
+        #pragma omp parallel for schedule(static)
+        for(int plane=0; plane<nplanes; ++plane)
+          for(std::size_t i=0; i<plane_size; ++i)
+            array[plane*plane_size + i] = 0.;
+
+        ierr = VecCreateSeqWithArray(PETSC_COMM_SELF, info.dof, size, array, v);CHKERRQ(ierr);
+        pool->push_back({*v, array, true});
+
+        PetscFunctionReturn(0);
+      }
+#endif
+
+      ierr = DMGetLocalVector(dm, v);CHKERRQ(ierr);
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "restore_local_vector"
+    PetscErrorCode restore_local_vector(DM dm, Vec* v)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      std::vector<local_vector_entry>* pool;
+      ierr = get_local_vector_pool(dm, &pool, false);CHKERRQ(ierr);
+      if (pool)
+      {
+        for(auto& e: *pool)
+        {
+          if (e.v == *v)
+          {
+            e.used = false;
+            *v = nullptr;
+            PetscFunctionReturn(0);
+          }
+        }
+      }
+
+      ierr = DMRestoreLocalVector(dm, v);CHKERRQ(ierr);
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "destroy_local_vectors"
+    //! Frees the local vectors of get_local_vector on dm which are not in
+    //! use. The others are freed with the DM.
+    PetscErrorCode destroy_local_vectors(DM dm)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      std::vector<local_vector_entry>* pool;
+      ierr = get_local_vector_pool(dm, &pool, false);CHKERRQ(ierr);
+      if (!pool)
+        PetscFunctionReturn(0);
+
+      std::vector<local_vector_entry> used;
+      for(auto& e: *pool)
+      {
+        if (e.used)
+        {
+          used.push_back(e);
+          continue;
+        }
+        ierr = VecDestroy(&e.v);CHKERRQ(ierr);
+        delete [] e.array;
+      }
+      *pool = used;
+
+      PetscFunctionReturn(0);
+    }
+
+    //! Raw strided access to the dof of the nodes of a DMDA array with the
+    //! global indices of the nodes.
+    template<std::size_t Dimensions, typename T = PetscScalar>
+    struct strided_array{
+      T* data_ = nullptr;
+      std::ptrdiff_t offset_ = 0;
+      std::array<std::ptrdiff_t, Dimensions> stride_;
+
+      void set_layout(std::array<int, 3> const& corner, std::array<int, 3> const& size, int dof)
+      {
+        std::ptrdiff_t s = dof;
+        offset_ = 0;
+        for(std::size_t d=0; d<Dimensions; ++d)
+        {
+          stride_[d] = s;
+          offset_ += corner[d]*s;
+          s *= size[d];
+        }
+      }
+
+      template<typename Index>
+      T* at(Index const& indices) const
+      {
+        std::ptrdiff_t i = -offset_;
+        for(std::size_t d=0; d<Dimensions; ++d)
+          i += indices[d]*stride_[d];
+        return data_ + i;
+      }
+
+      //! Access with the offset of the node in the array (see particle_grid_index).
+      T* at_node(std::ptrdiff_t node) const
+      {
+        return data_ + node*stride_[0];
+      }
+    };
+
     template<std::size_t Dimensions>
     struct petsc_vec{
       DM dm_;
@@ -76,9 +293,13 @@ namespace cafes
 
       bool readonly_;
       PetscBool iscomposite;
+      bool persistent_ = false;
+      std::size_t entry_offset_ = 0;
+      PetscScalar* global_array_ = nullptr;
+      fem::element_region region_ = fem::element_region::all;
 
-      typename std::conditional<Dimensions==2, PetscScalar ***, PetscScalar ****>::type pv_;
-      typename std::conditional<Dimensions==2, PetscScalar ***, PetscScalar ****>::type pvg_;
+      strided_array<Dimensions> pv_;
+      strided_array<Dimensions> pvg_;
 
       // no copy
       petsc_vec(petsc_vec const& ) = delete;
@@ -89,105 +310,277 @@ namespace cafes
       petsc_vec(DM dm, Vec v, std::size_t entry, bool readonly=true):
       dm_global_{dm}, v_global_{v}, entry_{entry}, readonly_{readonly}
       {
-        PetscObjectTypeCompare((PetscObject)dm,DMCOMPOSITE,&iscomposite);
+        set_layout();
+
         if (iscomposite)
-        {
           v_entry_ = get_Vec(dm, v, entry_);
-          dm_ = get_DM(dm, entry);
-        }
         else
-        {
           v_entry_ = v;
-          dm_ = dm;
+
+        get_local_vector(dm_, &v_);
+
+        get_array(v_, pv_.data_);
+        get_array(v_entry_, pvg_.data_);
+      }
+
+      //! Persistent view: the local vector and the layouts are kept for the
+      //! life of the view and attach() only re-points it at a global vector.
+      //! The local array of a writable view is zero outside of an apply
+      //! (see clear_local).
+      petsc_vec(DM dm, std::size_t entry, bool readonly=true):
+      dm_global_{dm}, v_global_{nullptr}, entry_{entry}, readonly_{readonly}, persistent_{true}
+      {
+        set_layout();
+
+        if (iscomposite)
+        {
+          DMDALocalInfo info;
+          DMDAGetLocalInfo(dm_, &info);
+          VecCreateMPIWithArray(PetscObjectComm((PetscObject)dm_), info.dof,
+                                info.dof*info.xm*info.ym*info.zm, PETSC_DECIDE, nullptr, &v_entry_);
         }
+        else
+          v_entry_ = nullptr;
 
-        DMGetLocalVector(dm_, &v_);
+        get_local_vector(dm_, &v_);
+        if (!readonly_)
+          VecSet(v_, 0.);
 
-        dof_ = fem::get_dof(dm_);
+        get_array(v_, pv_.data_);
+      }
 
+      void set_layout()
+      {
+        PetscObjectTypeCompare((PetscObject)dm_global_, DMCOMPOSITE, &iscomposite);
+        dm_ = (iscomposite)? get_DM(dm_global_, entry_): dm_global_;
+
+        if (iscomposite)
+          for(std::size_t i=0; i<entry_; ++i)
+          {
+            DMDALocalInfo info;
+            DMDAGetLocalInfo(get_DM(dm_global_, i), &info);
+            entry_offset_ += info.dof*info.xm*info.ym*info.zm;
+          }
+
+        DMDALocalInfo info;
+        DMDAGetLocalInfo(dm_, &info);
+        dof_ = info.dof;
+        pv_.set_layout({{info.gxs, info.gys, info.gzs}}, {{info.gxm, info.gym, info.gzm}}, dof_);
+        pvg_.set_layout({{info.xs, info.ys, info.zs}}, {{info.xm, info.ym, info.zm}}, dof_);
+      }
+
+      void get_array(Vec v, PetscScalar*& array)
+      {
         if (readonly_)
         {
-          DMDAVecGetArrayDOFRead(dm_, v_, &pv_);
-          DMDAVecGetArrayDOFRead(dm_, v_entry_, &pvg_);
+          PetscScalar const* a;
+          VecGetArrayRead(v, &a);
+          array = const_cast<PetscScalar*>(a);
         }
         else
+          VecGetArray(v, &array);
+      }
+
+      void restore_array(Vec v, PetscScalar*& array)
+      {
+        if (readonly_)
         {
-          DMDAVecGetArrayDOF(dm_, v_, &pv_);
-          DMDAVecGetArrayDOF(dm_, v_entry_, &pvg_);
+          PetscScalar const* a = array;
+          VecRestoreArrayRead(v, &a);
         }
+        else
+          VecRestoreArray(v, &array);
+        array = nullptr;
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "attach"
+      //! Re-points a persistent view at the global vector v.
+      PetscErrorCode attach(Vec v)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        if (v_global_)
+        {
+          ierr = detach();CHKERRQ(ierr);
+        }
+
+        v_global_ = v;
+        get_array(v_global_, global_array_);
+        pvg_.data_ = global_array_ + entry_offset_;
+
+        if (iscomposite)
+        {
+          ierr = VecPlaceArray(v_entry_, pvg_.data_);CHKERRQ(ierr);
+        }
+        else
+          v_entry_ = v_global_;
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "detach"
+      PetscErrorCode detach()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        set_region(fem::element_region::all);
+
+        if (iscomposite)
+        {
+          ierr = VecResetArray(v_entry_);CHKERRQ(ierr);
+        }
+        else
+          v_entry_ = nullptr;
+
+        restore_array(v_global_, global_array_);
+        pvg_.data_ = nullptr;
+        v_global_ = nullptr;
+
+        PetscFunctionReturn(0);
       }
 
       double* at(std::array<int, 2> indices){
-        return pv_[indices[1]][indices[0]];
+        return pv_.at(indices);
       }
 
       double* at(std::array<int, 3> indices){
-        return pv_[indices[2]][indices[1]][indices[0]];
+        return pv_.at(indices);
       }
 
       double const* at(std::array<int, 2> indices) const{
-        return pv_[indices[1]][indices[0]];
+        return pv_.at(indices);
       }
 
       double const* at(std::array<int, 3> indices) const{
-        return pv_[indices[2]][indices[1]][indices[0]];
+        return pv_.at(indices);
       }
 
       double* at(geometry::position<int, 2> indices){
-        return pv_[indices[1]][indices[0]];
+        return pv_.at(indices);
       }
 
       double* at(geometry::position<int, 3> indices){
-        return pv_[indices[2]][indices[1]][indices[0]];
+        return pv_.at(indices);
       }
 
       double const* at(geometry::position<int, 2> indices) const{
-        return pv_[indices[1]][indices[0]];
+        return pv_.at(indices);
       }
 
       double const* at(geometry::position<int, 3> indices) const{
-        return pv_[indices[2]][indices[1]][indices[0]];
+        return pv_.at(indices);
       }
 
       double* at_g(geometry::position<int, 2> indices){
-        return pvg_[indices[1]][indices[0]];
+        return pvg_.at(indices);
       }
 
       double* at_g(geometry::position<int, 3> indices){
-        return pvg_[indices[2]][indices[1]][indices[0]];
+        return pvg_.at(indices);
       }
 
       double const* at_g(geometry::position<int, 2> indices) const{
-        return pvg_[indices[1]][indices[0]];
+        return pvg_.at(indices);
       }
 
       double const* at_g(geometry::position<int, 3> indices) const{
-        return pvg_[indices[2]][indices[1]][indices[0]];
+        return pvg_.at(indices);
+      }
+
+      double* at_node(std::ptrdiff_t node){
+        return pv_.at_node(node);
+      }
+
+      double const* at_node(std::ptrdiff_t node) const{
+        return pv_.at_node(node);
+      }
+
+      double* at_g_node(std::ptrdiff_t node){
+        return pvg_.at_node(node);
+      }
+
+      double const* at_g_node(std::ptrdiff_t node) const{
+        return pvg_.at_node(node);
       }
       
+      //! Selects the elements used by the operators applied on this vector.
+      //! The interior elements only touch owned nodes: for these regions
+      //! at() gives the global array so that they can be computed while
+      //! the ghost values are exchanged.
+      void set_region(fem::element_region region)
+      {
+        if (fem::is_interior(region_) != fem::is_interior(region))
+          std::swap(pv_, pvg_);
+        region_ = region;
+      }
+
       #undef __FUNCT__
-      #define __FUNCT__ "local_to_global"
-      PetscErrorCode local_to_global(InsertMode iora)
+      #define __FUNCT__ "local_to_global_begin"
+      PetscErrorCode local_to_global_begin(InsertMode iora)
       {
         PetscErrorCode ierr;
         PetscFunctionBeginUser;
         ierr=DMLocalToGlobalBegin(dm_, v_, iora, v_entry_);CHKERRQ(ierr);
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "local_to_global_end"
+      PetscErrorCode local_to_global_end(InsertMode iora)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
         ierr=DMLocalToGlobalEnd(dm_, v_, iora, v_entry_);CHKERRQ(ierr);
         PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "local_to_global"
+      PetscErrorCode local_to_global(InsertMode iora)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+        ierr=local_to_global_begin(iora);CHKERRQ(ierr);
+        ierr=local_to_global_end(iora);CHKERRQ(ierr);
+        PetscFunctionReturn(0);
 
       }
 
       #undef __FUNCT__
-      #define __FUNCT__ "global_to_local"
-      PetscErrorCode global_to_local(InsertMode iora)
+      #define __FUNCT__ "global_to_local_begin"
+      PetscErrorCode global_to_local_begin(InsertMode iora)
       {
         PetscErrorCode ierr;
         PetscFunctionBeginUser;
         ierr=DMGlobalToLocalBegin(dm_, v_entry_, iora, v_);CHKERRQ(ierr);
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "global_to_local_end"
+      PetscErrorCode global_to_local_end(InsertMode iora)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
         ierr=DMGlobalToLocalEnd(dm_, v_entry_, iora, v_);CHKERRQ(ierr);
         PetscFunctionReturn(0);
       }
 
+      #undef __FUNCT__
+      #define __FUNCT__ "global_to_local"
+      PetscErrorCode global_to_local(InsertMode iora)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+        ierr=global_to_local_begin(iora);CHKERRQ(ierr);
+        ierr=global_to_local_end(iora);CHKERRQ(ierr);
+        PetscFunctionReturn(0);
+      }
+
       #undef __FUNCT__
       #define __FUNCT__ "fill"
       PetscErrorCode fill(double value)
@@ -208,26 +601,144 @@ namespace cafes
         PetscFunctionReturn(0);
       }
 
-      ~petsc_vec()
+      #undef __FUNCT__
+      #define __FUNCT__ "clear_local"
+      //! Sets to zero the local values which can be written by the
+      //! boundary elements of an overlapped apply: the ghost nodes and the
+      //! last two layers of owned nodes in each direction (the 4Q1 patches
+      //! of the pressure elements cover two velocity elements).
+      PetscErrorCode clear_local()
       {
-        if (readonly_)
+        PetscErrorCode ierr;
+        DMDALocalInfo info;
+        PetscFunctionBeginUser;
+
+        ierr = DMDAGetLocalInfo(dm_, &info);CHKERRQ(ierr);
+        std::array<int, 3> ghost_start{{info.gxs, info.gys, info.gzs}};
+        std::array<int, 3> ghost_end{{info.gxs + info.gxm, info.gys + info.gym, info.gzs + info.gzm}};
+        std::array<int, 3> inner_end{{info.xs + info.xm - 2, info.ys + info.ym - 2, info.zs + info.zm - 2}};
+
+        geometry::box<int, Dimensions> ghost;
+        for(std::size_t d=0; d<Dimensions; ++d)
         {
-          DMDAVecRestoreArrayDOFRead(dm_, v_, &pv_);
-          DMDAVecRestoreArrayDOFRead(dm_, v_entry_, &pvg_);
+          ghost.bottom_left[d] = ghost_start[d];
+          ghost.upper_right[d] = ghost_end[d];
+          inner_end[d] = std::max(ghost_start[d], inner_end[d]);
         }
-        else
+
+        // slab d: outside of the inner nodes in the direction d,
+        // inside in the directions > d
+        for(std::size_t d=0; d<Dimensions; ++d)
+        {
+          auto slab = ghost;
+          slab.bottom_left[d] = inner_end[d];
+          for(std::size_t e=d+1; e<Dimensions; ++e)
+            slab.upper_right[e] = inner_end[e];
+          algorithm::iterate(slab, [&](auto const& pos){
+            auto u = pv_.at(pos);
+            for(int i=0; i<dof_; ++i)
+              u[i] = 0.;
+          });
+        }
+
+        PetscFunctionReturn(0);
+      }
+
+      ~petsc_vec()
+      {
+        set_region(fem::element_region::all);
+
+        if (persistent_)
         {
-          DMDAVecRestoreArrayDOF(dm_, v_, &pv_);
-          DMDAVecRestoreArrayDOF(dm_, v_entry_, &pvg_);
+          if (v_global_)
+            detach();
+          if (iscomposite)
+            VecDestroy(&v_entry_);
+          restore_array(v_, pv_.data_);
+          restore_local_vector(dm_, &v_);
+          return;
         }
 
-        DMRestoreLocalVector(dm_, &v_);
+        restore_array(v_, pv_.data_);
+        restore_array(v_entry_, pvg_.data_);
+
+        restore_local_vector(dm_, &v_);
         if (iscomposite)
         {
           retore_Vec(dm_global_, v_global_, v_entry_, entry_);
         } 
       }
     };
+
+    //! Ghosted local values of a DMDA stored as T, with the at() access of
+    //! petsc_vec so that the element kernels can be applied on them. They
+    //! are converted from and to the local array of a petsc_vec.
+    template<std::size_t Dimensions, typename T>
+    struct local_array{
+      DM dm_;
+      int dof_;
+      fem::element_region region_ = fem::element_region::all;
+      std::vector<T> data_;
+      strided_array<Dimensions, T> pv_;
+
+      local_array(DM dm): dm_{dm}
+      {
+        DMDALocalInfo info;
+        DMDAGetLocalInfo(dm_, &info);
+        dof_ = info.dof;
+        data_.assign(static_cast<std::size_t>(info.dof)*info.gxm*info.gym*info.gzm, T(0));
+        pv_.data_ = data_.data();
+        pv_.set_layout({{info.gxs, info.gys, info.gzs}}, {{info.gxm, info.gym, info.gzm}}, dof_);
+      }
+
+      // no copy: pv_ points to data_
+      local_array(local_array const& ) = delete;
+      local_array& operator=(local_array const& ) = delete;
+
+      template<typename Index>
+      T* at(Index const& indices){
+        return pv_.at(indices);
+      }
+
+      template<typename Index>
+      T const* at(Index const& indices) const{
+        return pv_.at(indices);
+      }
+
+      void fill(T value)
+      {
+        std::fill(data_.begin(), data_.end(), value);
+      }
+
+      //! v must be a view on the same DMDA with the region all.
+      void copy_from(petsc_vec<Dimensions> const& v)
+      {
+        std::transform(v.pv_.data_, v.pv_.data_ + data_.size(), data_.begin(),
+                       [](PetscScalar a){return static_cast<T>(a);});
+      }
+
+      void copy_to(petsc_vec<Dimensions>& v) const
+      {
+        std::copy(data_.begin(), data_.end(), v.pv_.data_);
+      }
+    };
+
+    //! Persistent views of a matrix-free operator, created on first use
+    //! for a DM, an entry and an access mode.
+    template<std::size_t Dimensions>
+    struct petsc_vec_cache{
+      std::vector<std::unique_ptr<petsc_vec<Dimensions>>> views_;
+
+      petsc_vec<Dimensions>& get(DM dm, std::size_t entry, bool readonly=true)
+      {
+        for(auto& v: views_)
+          if (v->dm_global_ == dm && v->entry_ == entry && v->readonly_ == readonly)
+            return *v;
+
+        views_.emplace_back(new petsc_vec<Dimensions>(dm, entry, readonly));
+        return *views_.back();
+      }
+    };
   }
 }
 #endif
\ No newline at end of file
@@ -30,12 +30,17 @@
 #define PARTICLE_PROBLEM_CONTEXT_HPP_INCLUDED
 
 #include <fem/bc.hpp>
+#include <fem/mixed_precision.hpp>
 #include <particle/particle.hpp>
+#include <particle/grid_index.hpp>
 #include <problem/problem.hpp>
 #include <particle/geometry/position.hpp>
+#include <problem/surface_operator.hpp>
 #include <petsc/vec.hpp>
 #include <array>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <type_traits>
 #include <petsc.h>
@@ -45,6 +50,64 @@ namespace cafes
   namespace problem
   {
 
+    //! Diagonal of an operator and what it was computed from: the DM, the
+    //! step, the diagonal kernel, the single precision level and the
+    //! Dirichlet rows of the context. The vector is destroyed with the last
+    //! copy of the context which holds it.
+    struct diagonal_cache{
+      Vec diag = nullptr;
+      DM dm = nullptr;
+      std::vector<double> h{};
+      void(*apply_diag)() = nullptr;
+      void const* single = nullptr;
+      std::vector<bool> bc{};
+
+      //! true if diag was computed with the operator of ctx
+      template<typename CTX>
+      bool matches(CTX const& ctx) const
+      {
+        return diag && dm == ctx.dm
+            && h == std::vector<double>(ctx.h.begin(), ctx.h.end())
+            && apply_diag == reinterpret_cast<void(*)()>(ctx.apply_diag)
+            && single == ctx.single_.get()
+            && bc == dirichlet_rows(ctx);
+      }
+
+      template<typename CTX>
+      void set_key(CTX const& ctx)
+      {
+        dm = ctx.dm;
+        h.assign(ctx.h.begin(), ctx.h.end());
+        apply_diag = reinterpret_cast<void(*)()>(ctx.apply_diag);
+        single = ctx.single_.get();
+        bc = dirichlet_rows(ctx);
+      }
+
+      //! the components set on each side, empty without Dirichlet conditions
+      template<typename CTX>
+      static std::vector<bool> dirichlet_rows(CTX const& ctx)
+      {
+        std::vector<bool> rows;
+        if (ctx.set_bc_)
+          for(auto const& side: ctx.bc_.conditions_)
+            for(auto const& c: side)
+              rows.push_back(c != nullptr);
+        return rows;
+      }
+
+      diagonal_cache() = default;
+      diagonal_cache(diagonal_cache const&) = delete;
+      diagonal_cache& operator=(diagonal_cache const&) = delete;
+
+      ~diagonal_cache()
+      {
+        PetscBool finalized;
+        PetscFinalized(&finalized);
+        if (!finalized)
+          VecDestroy(&diag);
+      }
+    };
+
     template<std::size_t Dimensions, std::size_t Ndm=1>
     struct context{
       template<std::size_t N> using int_ = std::integral_constant<std::size_t, N>;
@@ -60,8 +123,28 @@ namespace cafes
                              std::array<double, Dimensions> const&);
       PetscErrorCode(*apply_diag)(petsc::petsc_vec<Dimensions>&,
                                   std::array<double, Dimensions> const&) = nullptr;
+      //! fused viscous, divergence and gradient operator used by stokes_matrix if set
+      PetscErrorCode(*apply_stokes)(petsc::petsc_vec<Dimensions> const&,
+                                    petsc::petsc_vec<Dimensions> const&,
+                                    petsc::petsc_vec<Dimensions>&,
+                                    petsc::petsc_vec<Dimensions>&,
+                                    std::array<double, Dimensions> const&) = nullptr;
       fem::dirichlet_conditions<Dimensions> bc_{};
       bool set_bc_ = false;
+      //! apply and apply_stokes specialized on the number of dof with their
+      //! elementary matrices scaled for h (see fem::set_operator)
+      std::function<PetscErrorCode(petsc::petsc_vec<Dimensions>&,
+                                   petsc::petsc_vec<Dimensions>&)> op{};
+      std::function<PetscErrorCode(petsc::petsc_vec<Dimensions> const&,
+                                   petsc::petsc_vec<Dimensions> const&,
+                                   petsc::petsc_vec<Dimensions>&,
+                                   petsc::petsc_vec<Dimensions>&)> stokes_op{};
+      //! persistent views on the vectors of the matrix-free products
+      std::shared_ptr<petsc::petsc_vec_cache<Dimensions>> views = std::make_shared<petsc::petsc_vec_cache<Dimensions>>();
+      //! diagonal of the operator computed by the first MATOP_GET_DIAGONAL
+      std::shared_ptr<diagonal_cache> diag_ = std::make_shared<diagonal_cache>();
+      //! float vectors and operator of a single precision multigrid level
+      std::shared_ptr<fem::single_precision_level<Dimensions>> single_{};
 
       context(context const&) = default;
       context(context&&)      = default;
@@ -96,7 +179,28 @@ namespace cafes
       bool add_rigid_motion;
       bool compute_singularity;
       Vec sol_tmp;
+      //! fluid points inside the particles (built by set_materials)
+      particle_grid_index<Dimensions> index{};
+      //! interpolation on the surface points (assembled at the first use)
+      surface_operator<Dimensions> surface{};
     };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "destroy_particle_context"
+    //! The context of the shell matrix of a particle problem belongs to
+    //! it: it is deleted with the matrix.
+    template<typename Ctx>
+    PetscErrorCode destroy_particle_context(Mat A)
+    {
+      PetscErrorCode ierr;
+      Ctx *ctx;
+      PetscFunctionBeginUser;
+
+      ierr = MatShellGetContext(A, &ctx);CHKERRQ(ierr);
+      delete ctx;
+
+      PetscFunctionReturn(0);
+    }
   }
 }
 
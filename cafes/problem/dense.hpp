@@ -0,0 +1,161 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef PARTICLE_PROBLEM_DENSE_HPP_INCLUDED
+#define PARTICLE_PROBLEM_DENSE_HPP_INCLUDED
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //! Linear algebra on the small dense matrices of the solvers (the
+    //! Gram matrices of the particles and of the subspaces, the coarse
+    //! systems of the rigid motions), stored row major on each process.
+    namespace detail
+    {
+      //! Jacobi eigenvalue algorithm for the small symmetric matrix a (n x n,
+      //! row major): the eigenvectors are the columns of v.
+      inline void symmetric_eigen(std::vector<double> a, std::size_t n,
+                                  std::vector<double>& lambda, std::vector<double>& v)
+      {
+        v.assign(n*n, 0.);
+        for(std::size_t i=0; i<n; ++i)
+          v[i*n + i] = 1.;
+
+        for(int sweep=0; sweep<50; ++sweep){
+          double off = 0.;
+          for(std::size_t i=0; i<n; ++i)
+            for(std::size_t j=i+1; j<n; ++j)
+              off += a[i*n + j]*a[i*n + j];
+          if (off < 1e-30)
+            break;
+
+          for(std::size_t p=0; p<n; ++p)
+            for(std::size_t q=p+1; q<n; ++q){
+              if (a[p*n + q] == 0.)
+                continue;
+              double theta = .5*(a[q*n + q] - a[p*n + p])/a[p*n + q];
+              double t = ((theta >= 0)? 1.: -1.)/(std::abs(theta) + std::sqrt(theta*theta + 1.));
+              double c = 1./std::sqrt(t*t + 1.), s = t*c;
+              for(std::size_t k=0; k<n; ++k){
+                double akp = a[k*n + p], akq = a[k*n + q];
+                a[k*n + p] = c*akp - s*akq;
+                a[k*n + q] = s*akp + c*akq;
+              }
+              for(std::size_t k=0; k<n; ++k){
+                double apk = a[p*n + k], aqk = a[q*n + k];
+                a[p*n + k] = c*apk - s*aqk;
+                a[q*n + k] = s*apk + c*aqk;
+              }
+              for(std::size_t k=0; k<n; ++k){
+                double vkp = v[k*n + p], vkq = v[k*n + q];
+                v[k*n + p] = c*vkp - s*vkq;
+                v[k*n + q] = s*vkp + c*vkq;
+              }
+            }
+        }
+
+        lambda.resize(n);
+        for(std::size_t i=0; i<n; ++i)
+          lambda[i] = a[i*n + i];
+      }
+
+      //! Solves h y = e with the Cholesky factorization of the small SPD
+      //! matrix h (m x m, row major).
+      inline void cholesky_solve(std::vector<double> h, std::size_t m, std::vector<double>& y)
+      {
+        for(std::size_t j=0; j<m; ++j){
+          for(std::size_t k=0; k<j; ++k)
+            h[j*m + j] -= h[j*m + k]*h[j*m + k];
+          h[j*m + j] = std::sqrt(h[j*m + j]);
+          for(std::size_t i=j+1; i<m; ++i){
+            for(std::size_t k=0; k<j; ++k)
+              h[i*m + j] -= h[i*m + k]*h[j*m + k];
+            h[i*m + j] /= h[j*m + j];
+          }
+        }
+        for(std::size_t i=0; i<m; ++i){
+          for(std::size_t k=0; k<i; ++k)
+            y[i] -= h[i*m + k]*y[k];
+          y[i] /= h[i*m + i];
+        }
+        for(std::size_t i=m; i-- > 0;){
+          for(std::size_t k=i+1; k<m; ++k)
+            y[i] -= h[k*m + i]*y[k];
+          y[i] /= h[i*m + i];
+        }
+      }
+
+      //! LU factorization with partial pivoting of the small matrix a
+      //! (n x n, row major) in place. Returns false if a is singular.
+      inline bool lu_factor(std::vector<double>& a, std::size_t n, std::vector<std::size_t>& piv)
+      {
+        piv.resize(n);
+        for(std::size_t j=0; j<n; ++j){
+          std::size_t p = j;
+          for(std::size_t i=j+1; i<n; ++i)
+            if (std::abs(a[i*n + j]) > std::abs(a[p*n + j]))
+              p = i;
+          piv[j] = p;
+          if (a[p*n + j] == 0.)
+            return false;
+          if (p != j)
+            for(std::size_t k=0; k<n; ++k)
+              std::swap(a[j*n + k], a[p*n + k]);
+          for(std::size_t i=j+1; i<n; ++i){
+            a[i*n + j] /= a[j*n + j];
+            for(std::size_t k=j+1; k<n; ++k)
+              a[i*n + k] -= a[i*n + j]*a[j*n + k];
+          }
+        }
+        return true;
+      }
+
+      //! Solves a y = b in place with the factors of lu_factor.
+      inline void lu_solve(std::vector<double> const& a, std::size_t n, std::vector<std::size_t> const& piv, std::vector<double>& y)
+      {
+        for(std::size_t j=0; j<n; ++j)
+          std::swap(y[j], y[piv[j]]);
+        for(std::size_t i=0; i<n; ++i)
+          for(std::size_t k=0; k<i; ++k)
+            y[i] -= a[i*n + k]*y[k];
+        for(std::size_t i=n; i-- > 0;){
+          for(std::size_t k=i+1; k<n; ++k)
+            y[i] -= a[i*n + k]*y[k];
+          y[i] /= a[i*n + i];
+        }
+      }
+    }
+  }
+}
+#endif
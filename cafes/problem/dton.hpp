@@ -29,6 +29,9 @@
 #ifndef CAFES_PROBLEM_DTON_HPP_INCLUDED
 #define CAFES_PROBLEM_DTON_HPP_INCLUDED
 
+#include <problem/inexact.hpp>
+#include <problem/particle_pc.hpp>
+#include <problem/recycling.hpp>
 #include <problem/particle_operator.hpp>
 #include <problem/problem.hpp>
 #include <problem/stokes.hpp>
@@ -85,6 +88,60 @@ namespace cafes
       PetscFunctionReturn(0);
     }
 
+    #undef __FUNCT__
+    #define __FUNCT__ "DtoN_matrix_batch"
+    //! DtoN_matrix for a batch of surface values: y[b] is the product of
+    //! x[b] with the motion of the particles set by set_motion(b). The two
+    //! fluid solves of the products are done for the whole batch by
+    //! solve_problem_batch.
+    template<std::size_t Dimensions, typename Ctx, typename Motion>
+    PetscErrorCode DtoN_matrix_batch(Ctx& ctx, std::vector<Vec> const& x, std::vector<Vec> const& y, Motion&& set_motion){
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      std::size_t const nbatch = x.size();
+      std::vector<Vec> rhs(nbatch), sol;
+      for(std::size_t b=0; b<nbatch; ++b){
+        ierr = VecDuplicate(ctx.problem.rhs, &rhs[b]);CHKERRQ(ierr);
+      }
+
+      for(std::size_t b=0; b<nbatch; ++b){
+        ierr = set_motion(b);CHKERRQ(ierr);
+        ierr = VecSet(ctx.problem.rhs, 0.);CHKERRQ(ierr);
+        ierr = init_problem<Dimensions, Ctx>(ctx, x[b]);CHKERRQ(ierr);
+        ierr = VecCopy(ctx.problem.rhs, rhs[b]);CHKERRQ(ierr);
+      }
+      ierr = solve_problem_batch(ctx.problem, rhs, sol);CHKERRQ(ierr);
+
+      std::vector<std::vector<geometry::vector<double, Dimensions>>> g;
+      g.resize(ctx.particles.size());
+      for(std::size_t ipart=0; ipart<ctx.surf_points.size(); ++ipart)
+        g[ipart].resize(ctx.surf_points[ipart].size());
+
+      // the simple layers of the traces on the surfaces
+      for(std::size_t b=0; b<nbatch; ++b){
+        ierr = set_motion(b);CHKERRQ(ierr);
+        ierr = VecCopy(sol[b], ctx.problem.sol);CHKERRQ(ierr);
+        ierr = VecCopy(sol[b], ctx.sol_tmp);CHKERRQ(ierr);
+        ierr = interp_fluid_to_surf(ctx, g, ctx.add_rigid_motion, ctx.compute_singularity);CHKERRQ(ierr);
+        ierr = SL_to_Rhs(ctx, g);CHKERRQ(ierr);
+        ierr = VecCopy(ctx.problem.rhs, rhs[b]);CHKERRQ(ierr);
+      }
+      ierr = solve_problem_batch(ctx.problem, rhs, sol);CHKERRQ(ierr);
+
+      for(std::size_t b=0; b<nbatch; ++b){
+        ierr = VecCopy(sol[b], ctx.problem.sol);CHKERRQ(ierr);
+        ierr = compute_y<Dimensions, Ctx>(ctx, y[b]);CHKERRQ(ierr);
+      }
+
+      for(std::size_t b=0; b<nbatch; ++b){
+        ierr = VecDestroy(&rhs[b]);CHKERRQ(ierr);
+        ierr = VecDestroy(&sol[b]);CHKERRQ(ierr);
+      }
+
+      PetscFunctionReturn(0);
+    }
+
 
 
     template<typename Shape, std::size_t Dimensions, typename Problem_type>
@@ -97,17 +154,20 @@ namespace cafes
       using position_type_i = geometry::position<int,Dimensions>;
 
       using Ctx = particle_context<Dimensions, Shape, Problem_type>;
-      Ctx *ctx;
+      Ctx *ctx = nullptr;
 
       std::vector<std::vector<std::pair<position_type_i, position_type>>> surf_points_;
       std::vector<std::vector<geometry::vector<double, Dimensions>>> radial_vec_;
       std::vector<int> nb_surf_points_;
       std::vector<int> num_;
-      Vec sol;
-      Vec rhs;
+      Vec sol = nullptr;
+      Vec rhs = nullptr;
       Vec sol_rhs, sol_g, sol_tmp;
-      Mat A;
+      Mat A = nullptr;
       KSP ksp;
+      inexact_control *inexact_ = nullptr; //!< Relaxation of the inner tolerance
+      particle_pc_cache pc_cache_;         //!< Blocks of the particle preconditioner
+      krylov_recycling<Dimensions> *recycling_ = nullptr; //!< Subspace kept between two solves
       std::size_t scale_=4;
       bool default_flags_ = true;
       bool use_sing = true;
@@ -136,14 +196,26 @@ namespace cafes
         auto box = fem::get_DM_bounds<Dimensions>(problem_.ctx->dm, 0);
         auto& h = problem_.ctx->h;
 
-        auto size = set_materials(parts_, surf_points_, radial_vec_,
-                                  nb_surf_points_, num_, box,
-                                  h, dpart_, scale_);
+        // the particles are set again: the blocks of the particle
+        // preconditioner probed at their previous positions are dropped
+        pc_cache_.clear();
+
+        // the matrix of the previous particles releases its context when
+        // the solvers using it are done with it
+        ierr = MatDestroy(&A);CHKERRQ(ierr);
+        ierr = VecDestroy(&sol);CHKERRQ(ierr);
+        ierr = VecDestroy(&rhs);CHKERRQ(ierr);
 
         ctx = new Ctx{problem_, parts_, surf_points_, radial_vec_, nb_surf_points_, num_, scale_, false, false, false, sol_tmp};
 
+        auto size = set_materials(parts_, surf_points_, radial_vec_,
+                                  nb_surf_points_, num_, box,
+                                  h, dpart_, scale_, ctx->index);
+        ierr = ctx->index.set_layout(problem_.ctx->dm);CHKERRQ(ierr);
+
         ierr = MatCreateShell(PETSC_COMM_WORLD, size*Dimensions, size*Dimensions, PETSC_DECIDE, PETSC_DECIDE, ctx, &A);CHKERRQ(ierr);
         ierr = MatShellSetOperation(A, MATOP_MULT, (void(*)(void))DtoN_matrix<Dimensions, Ctx>);CHKERRQ(ierr);
+        ierr = MatShellSetOperation(A, MATOP_DESTROY, (void(*)(void))destroy_particle_context<Ctx>);CHKERRQ(ierr);
 
         ierr = MatCreateVecs(A, &sol, &rhs);CHKERRQ(ierr);
 
@@ -191,6 +263,9 @@ namespace cafes
         ierr = KSPGetPC(ksp, &pc);CHKERRQ(ierr);
         ierr = PCSetType(pc, PCNONE);CHKERRQ(ierr);
         ierr = KSPSetFromOptions(ksp);CHKERRQ(ierr);
+        ierr = set_particle_preconditioner(ksp, parts_, problem_.ctx->dm, problem_.ctx->h, false, &pc_cache_);CHKERRQ(ierr);
+        ierr = set_inexact_inner_solves(ksp, problem_.ksp, &inexact_);CHKERRQ(ierr);
+        ierr = set_krylov_recycling(ksp, false, &recycling_);CHKERRQ(ierr);
 
         PetscFunctionReturn(0);
       }
@@ -263,7 +338,15 @@ namespace cafes
           ctx->compute_singularity = true;
         }
 
-        ierr = KSPSolve(ksp, rhs, sol);CHKERRQ(ierr);
+        if (recycling_){
+          ierr = recycling_->solve(ksp, rhs, sol, parts_, ctx->index, problem_.ctx->dm, problem_.ctx->h);CHKERRQ(ierr);
+        }
+        else{
+          ierr = KSPSolve(ksp, rhs, sol);CHKERRQ(ierr);
+        }
+        if (inexact_){
+          ierr = inexact_->restore();CHKERRQ(ierr);
+        }
 
         if (default_flags_){
           std::cout<<"Last Problem...\n";
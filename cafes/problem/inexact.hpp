@@ -0,0 +1,212 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef PARTICLE_PROBLEM_INEXACT_HPP_INCLUDED
+#define PARTICLE_PROBLEM_INEXACT_HPP_INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <petsc.h>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //!
+    //! Relaxation of the tolerance of an inner solver (the Stokes solver
+    //! in the SEM and DtoN operators, the DtoN solver in the NtoD operator)
+    //! as the residual of the outer solver decreases: at the outer
+    //! iteration k the inner relative tolerance is
+    //!
+    //!     min(rtol_max, rtol0 * |r_0|/|r_k|)
+    //!
+    //! where rtol0 is the tolerance given to the inner solver. The ratio
+    //! is replaced by its square root when the outer method is not a
+    //! flexible one since the inexact operator breaks its recurrences.
+    //!
+    struct inexact_control
+    {
+      KSP outer = nullptr, inner = nullptr; //!< solvers with the monitors of the control
+      PetscBool enabled = PETSC_TRUE;
+      PetscReal rtol0;
+      PetscReal rtol_max = 1e-1;
+      PetscBool flexible = PETSC_FALSE;
+      PetscBool view = PETSC_FALSE;
+      PetscReal rnorm0 = 0.;
+      PetscReal rtol;
+
+      // last inner solve
+      PetscInt its = 0;
+      PetscReal inner_rnorm0 = 0., inner_rnorm = 0.;
+
+      PetscInt inner_solves = 0;
+      PetscInt inner_iterations = 0;
+      //! estimation of the inner iterations saved: the iterations needed
+      //! to reach rtol0 with the mean convergence rate of each inner solve
+      PetscReal saved = 0.;
+
+      void finish_inner_solve_()
+      {
+        if (its == 0)
+          return;
+        inner_solves++;
+        inner_iterations += its;
+        if (inner_rnorm > 0 && inner_rnorm < inner_rnorm0){
+          PetscReal const rate = std::pow(inner_rnorm/inner_rnorm0, 1./its);
+          PetscReal const needed = std::log(rtol0)/std::log(rate);
+          if (needed > its)
+            saved += needed - its;
+        }
+        its = 0;
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "inexact_control::restore"
+      //! Sets back the inner tolerance at the end of the outer solve.
+      PetscErrorCode restore()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        if (!enabled)
+          PetscFunctionReturn(0);
+
+        finish_inner_solve_();
+        rtol = rtol0;
+        ierr = KSPSetTolerances(inner, rtol0, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT);CHKERRQ(ierr);
+
+        if (view){
+          ierr = PetscPrintf(PETSC_COMM_WORLD, "inexact inner solves: %D solves, %D iterations, %g iterations saved\n",
+                             inner_solves, inner_iterations, (double)saved);CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "inexact_outer_monitor"
+    inline PetscErrorCode inexact_outer_monitor(KSP ksp, PetscInt it, PetscReal rnorm, void *ctx)
+    {
+      PetscErrorCode ierr;
+      auto *c = static_cast<inexact_control*>(ctx);
+      PetscFunctionBeginUser;
+
+      if (!c->enabled || ksp != c->outer)
+        PetscFunctionReturn(0);
+
+      if (it == 0){
+        c->rnorm0 = rnorm;
+        c->rtol = c->rtol0;
+      }
+      else if (rnorm > 0){
+        PetscReal ratio = c->rnorm0/rnorm;
+        if (!c->flexible)
+          ratio = std::sqrt(ratio);
+        c->rtol = std::min(c->rtol_max, std::max(c->rtol0, c->rtol0*ratio));
+      }
+      ierr = KSPSetTolerances(c->inner, c->rtol, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "inexact_inner_monitor"
+    inline PetscErrorCode inexact_inner_monitor(KSP ksp, PetscInt it, PetscReal rnorm, void *ctx)
+    {
+      auto *c = static_cast<inexact_control*>(ctx);
+      PetscFunctionBeginUser;
+
+      if (!c->enabled || ksp != c->inner)
+        PetscFunctionReturn(0);
+
+      if (it == 0){
+        c->finish_inner_solve_();
+        c->inner_rnorm0 = rnorm;
+      }
+      c->its = it;
+      c->inner_rnorm = rnorm;
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_inexact_inner_solves"
+    //! Couples the tolerance of inner to the residual of outer when the
+    //! option -<outer prefix>inexact is set. control is left to nullptr
+    //! otherwise or if there is no inner Krylov solver. An existing control
+    //! is kept by the solver and reused when it is set up again: it only
+    //! follows the last outer solver, the inner monitor is added once per
+    //! inner solver and the control is disabled if the option is not set
+    //! anymore.
+    inline PetscErrorCode set_inexact_inner_solves(KSP outer, KSP inner, inexact_control **control)
+    {
+      PetscErrorCode ierr;
+      const char *prefix;
+      PetscBool inexact = PETSC_FALSE;
+      PetscReal rtol_max = 1e-1;
+      PetscBool view = PETSC_FALSE;
+      PetscFunctionBeginUser;
+
+      if (*control)
+        (*control)->enabled = PETSC_FALSE;
+      if (!inner)
+        PetscFunctionReturn(0);
+
+      ierr = KSPGetOptionsPrefix(outer, &prefix);CHKERRQ(ierr);
+      ierr = PetscOptionsBegin(PETSC_COMM_WORLD, prefix, "Inexact inner solves", "");CHKERRQ(ierr);
+      ierr = PetscOptionsBool("-inexact", "Relax the tolerance of the inner solver as the outer residual decreases", "inexact.hpp", inexact, &inexact, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsReal("-inexact_rtol_max", "The largest relative tolerance of the inner solver", "inexact.hpp", rtol_max, &rtol_max, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsBool("-inexact_view", "Print the inner iterations at the end of each outer solve", "inexact.hpp", view, &view, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsEnd();CHKERRQ(ierr);
+
+      if (!inexact)
+        PetscFunctionReturn(0);
+
+      auto *c = (*control)? *control: new inexact_control;
+      c->enabled = PETSC_TRUE;
+      c->rtol_max = rtol_max;
+      c->view = view;
+      ierr = KSPGetTolerances(inner, &c->rtol0, nullptr, nullptr, nullptr);CHKERRQ(ierr);
+      c->rtol = c->rtol0;
+      ierr = PetscObjectTypeCompareAny((PetscObject)outer, &c->flexible, KSPFGMRES, KSPGCR, KSPFCG, KSPFBCGS, KSPPIPEFGMRES, "");CHKERRQ(ierr);
+
+      // the solvers create a new outer KSP at each setup
+      ierr = KSPMonitorSet(outer, inexact_outer_monitor, c, nullptr);CHKERRQ(ierr);
+      c->outer = outer;
+      if (c->inner != inner){
+        ierr = KSPMonitorSet(inner, inexact_inner_monitor, c, nullptr);CHKERRQ(ierr);
+        c->inner = inner;
+      }
+      *control = c;
+
+      PetscFunctionReturn(0);
+    }
+  }
+}
+#endif
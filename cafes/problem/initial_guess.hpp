@@ -0,0 +1,366 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef PARTICLE_PROBLEM_INITIAL_GUESS_HPP_INCLUDED
+#define PARTICLE_PROBLEM_INITIAL_GUESS_HPP_INCLUDED
+
+#include <problem/dense.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include <petsc.h>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //! Initial guesses of the Stokes solver
+    //!  - none: cold start
+    //!  - previous: solution of the previous solve
+    //!  - fischer: projection on the last solutions (Fischer 1998), the
+    //!    history is cleared when it is full
+    //!  - pod: projection on the POD modes of a sliding window of the last
+    //!    solutions
+    //! The projections minimize the residual on the space spanned by the
+    //! history since the Stokes operator is not definite.
+    enum class initial_guess_type {none, previous, fischer, pod};
+
+    struct initial_guess_stats
+    {
+      PetscInt solves = 0;
+      PetscInt iterations = 0;
+      //! estimation of the iterations saved: the reduction of the residual
+      //! given by the initial guess divided by the mean convergence rate
+      PetscReal saved = 0.;
+    };
+
+    //!
+    //! History of the solutions x and of A x for the initial guesses
+    //!
+    struct initial_guess
+    {
+      initial_guess_type type = initial_guess_type::none;
+      std::size_t size = 8;     //!< maximum number of solutions kept
+      std::array<initial_guess_stats, 4> stats;
+
+      std::vector<Vec> x_, Ax_; //!< history (Ax_ orthonormal for fischer)
+      Vec r_ = nullptr, Ax_new_ = nullptr;
+      PetscReal bnorm_ = 0., rnorm0_ = 0.;
+
+      // POD: Gram matrices of the window and the projection on the modes
+      std::vector<double> gram_x_, gram_Ax_;
+      std::vector<double> modes_;  //!< V Lambda^{-1/2} (size x nmodes_)
+      std::vector<double> h_;      //!< (A Phi)^T (A Phi)
+      std::size_t nmodes_ = 0;
+
+      initial_guess() = default;
+      initial_guess(initial_guess const&) = delete;
+      initial_guess& operator=(initial_guess const&) = delete;
+
+      ~initial_guess()
+      {
+        PetscBool finalized;
+        PetscFinalized(&finalized);
+        if (!finalized)
+          destroy();
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "initial_guess::compute"
+      //! Sets the initial guess of A x = b in x.
+      PetscErrorCode compute(Mat A, Vec b, Vec x)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        ierr = VecNorm(b, NORM_2, &bnorm_);CHKERRQ(ierr);
+        rnorm0_ = bnorm_;
+
+        if (type == initial_guess_type::none || x_.empty()){
+          ierr = VecSet(x, 0.);CHKERRQ(ierr);
+          PetscFunctionReturn(0);
+        }
+
+        std::size_t const n = x_.size();
+        std::vector<PetscScalar> dots(n);
+        ierr = VecMDot(b, n, Ax_.data(), dots.data());CHKERRQ(ierr);
+
+        if (type == initial_guess_type::previous){
+          ierr = VecCopy(x_[0], x);CHKERRQ(ierr);
+          ierr = VecWAXPY(r_, -1., Ax_[0], b);CHKERRQ(ierr);
+          ierr = VecNorm(r_, NORM_2, &rnorm0_);CHKERRQ(ierr);
+          PetscFunctionReturn(0);
+        }
+
+        PetscReal proj = 0.;
+        std::vector<PetscScalar> coefs(n);
+        if (type == initial_guess_type::fischer){
+          for(std::size_t i=0; i<n; ++i){
+            coefs[i] = dots[i];
+            proj += dots[i]*dots[i];
+          }
+        }
+        else{
+          // residual minimization on the POD modes Phi = X modes_
+          std::vector<double> e(nmodes_, 0.);
+          for(std::size_t j=0; j<nmodes_; ++j)
+            for(std::size_t i=0; i<n; ++i)
+              e[j] += modes_[i*nmodes_ + j]*dots[i];
+          std::vector<double> y{e};
+          detail::cholesky_solve(h_, nmodes_, y);
+          for(std::size_t j=0; j<nmodes_; ++j)
+            proj += e[j]*y[j];
+          for(std::size_t i=0; i<n; ++i){
+            coefs[i] = 0.;
+            for(std::size_t j=0; j<nmodes_; ++j)
+              coefs[i] += modes_[i*nmodes_ + j]*y[j];
+          }
+        }
+
+        ierr = VecSet(x, 0.);CHKERRQ(ierr);
+        ierr = VecMAXPY(x, n, coefs.data(), x_.data());CHKERRQ(ierr);
+        rnorm0_ = std::sqrt(std::max(bnorm_*bnorm_ - proj, 0.));
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "initial_guess::update"
+      //! Adds the solution x of A x = b given by ksp to the history.
+      PetscErrorCode update(Mat A, Vec b, Vec x, KSP ksp)
+      {
+        PetscErrorCode ierr;
+        PetscInt its;
+        PetscFunctionBeginUser;
+
+        ierr = KSPGetIterationNumber(ksp, &its);CHKERRQ(ierr);
+        auto& s = stats[static_cast<std::size_t>(type)];
+        s.solves++;
+        s.iterations += its;
+
+        if (type == initial_guess_type::none)
+          PetscFunctionReturn(0);
+
+        if (!r_){
+          ierr = VecDuplicate(b, &r_);CHKERRQ(ierr);
+          ierr = VecDuplicate(b, &Ax_new_);CHKERRQ(ierr);
+        }
+
+        PetscReal rnorm;
+        ierr = MatMult(A, x, Ax_new_);CHKERRQ(ierr);
+        ierr = VecWAXPY(r_, -1., Ax_new_, b);CHKERRQ(ierr);
+        ierr = VecNorm(r_, NORM_2, &rnorm);CHKERRQ(ierr);
+        if (its > 0 && rnorm < rnorm0_ && rnorm0_ < bnorm_){
+          PetscReal rate = std::pow(rnorm/rnorm0_, 1./its);
+          s.saved += std::log(rnorm0_/bnorm_)/std::log(rate);
+        }
+
+        if (type == initial_guess_type::previous){
+          ierr = push_back_(x);CHKERRQ(ierr);
+          ierr = VecCopy(x, x_[0]);CHKERRQ(ierr);
+          ierr = VecCopy(Ax_new_, Ax_[0]);CHKERRQ(ierr);
+        }
+        else if (type == initial_guess_type::fischer){
+          ierr = fischer_update_(x);CHKERRQ(ierr);
+        }
+        else{
+          ierr = pod_update_(x);CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "initial_guess::push_back_"
+      //! Makes room for a new solution at the end of the history.
+      PetscErrorCode push_back_(Vec x)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        std::size_t const max_size = (type == initial_guess_type::previous)? 1: size;
+        if (x_.size() < max_size){
+          Vec y, Ay;
+          ierr = VecDuplicate(x, &y);CHKERRQ(ierr);
+          ierr = VecDuplicate(x, &Ay);CHKERRQ(ierr);
+          x_.push_back(y);
+          Ax_.push_back(Ay);
+        }
+        else{
+          // the oldest vectors are recycled
+          std::rotate(x_.begin(), x_.begin() + 1, x_.end());
+          std::rotate(Ax_.begin(), Ax_.begin() + 1, Ax_.end());
+        }
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "initial_guess::fischer_update_"
+      PetscErrorCode fischer_update_(Vec x)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        if (x_.size() == size){
+          for(std::size_t i=0; i<x_.size(); ++i){
+            ierr = VecDestroy(&x_[i]);CHKERRQ(ierr);
+            ierr = VecDestroy(&Ax_[i]);CHKERRQ(ierr);
+          }
+          x_.clear();
+          Ax_.clear();
+        }
+
+        std::size_t const n = x_.size();
+        ierr = VecCopy(x, r_);CHKERRQ(ierr);
+
+        // two passes of Gram-Schmidt on A x
+        PetscReal norm0, norm;
+        ierr = VecNorm(Ax_new_, NORM_2, &norm0);CHKERRQ(ierr);
+        std::vector<PetscScalar> dots(n);
+        for(int pass=0; pass<2 && n>0; ++pass){
+          ierr = VecMDot(Ax_new_, n, Ax_.data(), dots.data());CHKERRQ(ierr);
+          for(auto& d: dots)
+            d = -d;
+          ierr = VecMAXPY(Ax_new_, n, dots.data(), Ax_.data());CHKERRQ(ierr);
+          ierr = VecMAXPY(r_, n, dots.data(), x_.data());CHKERRQ(ierr);
+        }
+        ierr = VecNorm(Ax_new_, NORM_2, &norm);CHKERRQ(ierr);
+
+        // x is already in the span of the history
+        if (norm <= 1e-10*norm0)
+          PetscFunctionReturn(0);
+
+        ierr = push_back_(x);CHKERRQ(ierr);
+        ierr = VecAXPBY(x_.back(), 1./norm, 0., r_);CHKERRQ(ierr);
+        ierr = VecAXPBY(Ax_.back(), 1./norm, 0., Ax_new_);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "initial_guess::pod_update_"
+      PetscErrorCode pod_update_(Vec x)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        std::size_t const old_n = x_.size();
+        ierr = push_back_(x);CHKERRQ(ierr);
+        ierr = VecCopy(x, x_.back());CHKERRQ(ierr);
+        ierr = VecCopy(Ax_new_, Ax_.back());CHKERRQ(ierr);
+
+        // shift the Gram matrices when the oldest snapshot is dropped
+        std::size_t const n = x_.size();
+        std::vector<double> gx(n*n, 0.), gA(n*n, 0.);
+        std::size_t const shift = (old_n == n)? 1: 0;
+        for(std::size_t i=0; i+1<n; ++i)
+          for(std::size_t j=0; j+1<n; ++j){
+            gx[i*n + j] = gram_x_[(i + shift)*old_n + j + shift];
+            gA[i*n + j] = gram_Ax_[(i + shift)*old_n + j + shift];
+          }
+
+        std::vector<PetscScalar> dx(n), dA(n);
+        ierr = VecMDot(x_.back(), n, x_.data(), dx.data());CHKERRQ(ierr);
+        ierr = VecMDot(Ax_.back(), n, Ax_.data(), dA.data());CHKERRQ(ierr);
+        for(std::size_t i=0; i<n; ++i){
+          gx[i*n + n - 1] = gx[(n - 1)*n + i] = dx[i];
+          gA[i*n + n - 1] = gA[(n - 1)*n + i] = dA[i];
+        }
+        gram_x_ = gx;
+        gram_Ax_ = gA;
+
+        // POD modes of the window: the small eigenvalues are dropped
+        std::vector<double> lambda, v;
+        detail::symmetric_eigen(gram_x_, n, lambda, v);
+        double const lmax = *std::max_element(lambda.begin(), lambda.end());
+        std::vector<std::size_t> keep;
+        for(std::size_t j=0; j<n; ++j)
+          if (lambda[j] > 1e-12*lmax)
+            keep.push_back(j);
+
+        nmodes_ = keep.size();
+        modes_.assign(n*nmodes_, 0.);
+        for(std::size_t i=0; i<n; ++i)
+          for(std::size_t j=0; j<nmodes_; ++j)
+            modes_[i*nmodes_ + j] = v[i*n + keep[j]]/std::sqrt(lambda[keep[j]]);
+
+        h_.assign(nmodes_*nmodes_, 0.);
+        for(std::size_t j=0; j<nmodes_; ++j)
+          for(std::size_t k=0; k<nmodes_; ++k)
+            for(std::size_t i=0; i<n; ++i)
+              for(std::size_t l=0; l<n; ++l)
+                h_[j*nmodes_ + k] += modes_[i*nmodes_ + j]*gram_Ax_[i*n + l]*modes_[l*nmodes_ + k];
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "initial_guess::view"
+      PetscErrorCode view() const
+      {
+        PetscErrorCode ierr;
+        const char *names[] = {"none", "previous", "fischer", "pod"};
+        PetscFunctionBeginUser;
+
+        for(std::size_t i=0; i<stats.size(); ++i)
+          if (stats[i].solves > 0){
+            ierr = PetscPrintf(PETSC_COMM_WORLD, "initial guess %s: %D solves, %D iterations, %g iterations saved\n",
+                               names[i], stats[i].solves, stats[i].iterations, (double)stats[i].saved);CHKERRQ(ierr);
+          }
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "initial_guess::destroy"
+      PetscErrorCode destroy()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        for(std::size_t i=0; i<x_.size(); ++i){
+          ierr = VecDestroy(&x_[i]);CHKERRQ(ierr);
+          ierr = VecDestroy(&Ax_[i]);CHKERRQ(ierr);
+        }
+        x_.clear();
+        Ax_.clear();
+        gram_x_.clear();
+        gram_Ax_.clear();
+        nmodes_ = 0;
+        ierr = VecDestroy(&r_);CHKERRQ(ierr);
+        ierr = VecDestroy(&Ax_new_);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+    };
+  }
+}
+#endif
@@ -0,0 +1,509 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef PARTICLE_PROBLEM_MONOLITHIC_HPP_INCLUDED
+#define PARTICLE_PROBLEM_MONOLITHIC_HPP_INCLUDED
+
+#include <problem/dense.hpp>
+#include <problem/initial_guess.hpp>
+#include <problem/problem.hpp>
+#include <problem/rigid_motion.hpp>
+#include <problem/stokes.hpp>
+#include <fem/bc.hpp>
+#include <fem/matrixFree.hpp>
+#include <fem/mesh.hpp>
+#include <particle/particle.hpp>
+#include <particle/geometry/box.hpp>
+#include <particle/geometry/position.hpp>
+#include <petsc/vec.hpp>
+
+#include <petsc.h>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //!
+    //! Context of the coupling blocks of the monolithic problem. The
+    //! constraint unknowns are the Lagrange multipliers on the fluid
+    //! points inside the particles owned by this process followed, on
+    //! process 0 only, by the rigid motions (V, w) of all the particles.
+    //!
+    template<std::size_t Dimensions>
+    struct monolithic_context
+    {
+      using position_type_i = geometry::position<int, Dimensions>;
+      static constexpr std::size_t rigid_size = problem::rigid_size<Dimensions>();
+
+      DM dm;
+      std::array<double, Dimensions> h;
+      fem::dirichlet_conditions<Dimensions> bc{};
+      std::vector<std::vector<position_type_i>> points;                  //!< Fluid points inside each particle
+      std::vector<std::vector<std::array<double, Dimensions>>> radial;   //!< Their position from the center
+      std::vector<double> gram;   //!< R^T R for each particle
+      PetscInt npoints = 0;
+      PetscMPIInt rank;
+      double alpha;               //!< Approximation of E^T K^{-1} M E by alpha I
+
+      std::size_t nrigid() const
+      {
+        return points.size()*rigid_size;
+      }
+
+      //! The rigid motions stored at the end of the constraint vector
+      //! on process 0, sent to all the processes.
+      PetscErrorCode get_rigid(PetscScalar const* px, std::vector<double>& c) const
+      {
+        c.assign(nrigid(), 0.);
+        if (rank == 0)
+          std::copy(px + Dimensions*npoints, px + Dimensions*npoints + nrigid(), c.begin());
+        return MPI_Bcast(c.data(), nrigid(), MPI_DOUBLE, 0, PETSC_COMM_WORLD);
+      }
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "monolithic_spread"
+    //! y = -M E l: the multipliers l are extended by zero to the fluid
+    //! and multiplied by the velocity mass matrix.
+    template<std::size_t Dimensions>
+    PetscErrorCode monolithic_spread(Mat C, Vec x, Vec y)
+    {
+      PetscErrorCode ierr;
+      monolithic_context<Dimensions> *ctx;
+      PetscFunctionBeginUser;
+
+      ierr = MatShellGetContext(C, (void**) &ctx);CHKERRQ(ierr);
+
+      Vec forces;
+      ierr = DMGetGlobalVector(ctx->dm, &forces);CHKERRQ(ierr);
+      ierr = VecSet(forces, 0.);CHKERRQ(ierr);
+
+      PetscScalar const *px;
+      ierr = VecGetArrayRead(x, &px);CHKERRQ(ierr);
+      {
+        auto petsc_forces = petsc::petsc_vec<Dimensions>(ctx->dm, forces, 0, false);
+        std::size_t num = 0;
+        for(auto& pts: ctx->points)
+          for(auto& ind: pts){
+            auto u = petsc_forces.at_g(ind);
+            for(std::size_t d=0; d<Dimensions; ++d)
+              u[d] = -px[num++];
+          }
+      }
+      ierr = VecRestoreArrayRead(x, &px);CHKERRQ(ierr);
+
+      ierr = fem::apply_mass_matrix(ctx->dm, forces, y, ctx->h);CHKERRQ(ierr);
+      ierr = DMRestoreGlobalVector(ctx->dm, &forces);CHKERRQ(ierr);
+
+      auto petsc_y = petsc::petsc_vec<Dimensions>(ctx->dm, y, 0);
+      ierr = SetNullDirichletOnRHS(petsc_y, ctx->bc);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "monolithic_restrict"
+    //! y = (E^T u, 0): the fluid velocity on the points inside the particles.
+    template<std::size_t Dimensions>
+    PetscErrorCode monolithic_restrict(Mat C, Vec x, Vec y)
+    {
+      PetscErrorCode ierr;
+      monolithic_context<Dimensions> *ctx;
+      PetscFunctionBeginUser;
+
+      ierr = MatShellGetContext(C, (void**) &ctx);CHKERRQ(ierr);
+
+      ierr = VecSet(y, 0.);CHKERRQ(ierr);
+
+      PetscScalar *py;
+      ierr = VecGetArray(y, &py);CHKERRQ(ierr);
+      {
+        auto sol = petsc::petsc_vec<Dimensions>(ctx->dm, x, 0);
+        std::size_t num = 0;
+        for(auto& pts: ctx->points)
+          for(auto& ind: pts){
+            auto u = sol.at_g(ind);
+            for(std::size_t d=0; d<Dimensions; ++d)
+              py[num++] = u[d];
+          }
+      }
+      ierr = VecRestoreArray(y, &py);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "monolithic_rigid"
+    //! The constraint block [0, -R; -R^T, 0] where R gives the velocity
+    //! of the rigid motions on the points inside the particles.
+    template<std::size_t Dimensions>
+    PetscErrorCode monolithic_rigid(Mat D, Vec x, Vec y)
+    {
+      PetscErrorCode ierr;
+      monolithic_context<Dimensions> *ctx;
+      PetscFunctionBeginUser;
+
+      ierr = MatShellGetContext(D, (void**) &ctx);CHKERRQ(ierr);
+      auto const rs = ctx->rigid_size;
+
+      PetscScalar const *px;
+      PetscScalar *py;
+      ierr = VecGetArrayRead(x, &px);CHKERRQ(ierr);
+      ierr = VecGetArray(y, &py);CHKERRQ(ierr);
+
+      std::vector<double> c, f(ctx->nrigid(), 0.);
+      ierr = ctx->get_rigid(px, c);CHKERRQ(ierr);
+
+      std::size_t num = 0;
+      for(std::size_t ipart=0; ipart<ctx->points.size(); ++ipart)
+        for(auto& r: ctx->radial[ipart]){
+          std::array<double, Dimensions> v{};
+          add_rigid_motion(&c[ipart*rs], r, v.data());
+          add_rigid_motion_transpose(px + num, r, &f[ipart*rs]);
+          for(std::size_t d=0; d<Dimensions; ++d)
+            py[num++] = -v[d];
+        }
+
+      MPI_Allreduce(MPI_IN_PLACE, f.data(), f.size(), MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+      if (ctx->rank == 0)
+        for(std::size_t k=0; k<f.size(); ++k)
+          py[num++] = -f[k];
+
+      ierr = VecRestoreArray(y, &py);CHKERRQ(ierr);
+      ierr = VecRestoreArrayRead(x, &px);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "monolithic_schur_apply"
+    //! z = S^{-1} r for the approximation S = [alpha I, -R; -R^T, 0] of
+    //! the Schur complement of the fluid block: the rigid motions solve
+    //! the small systems (R^T R) c = -alpha r_c - R^T r_l of each particle
+    //! and the multipliers are (r_l + R c)/alpha.
+    template<std::size_t Dimensions>
+    PetscErrorCode monolithic_schur_apply(PC pc, Vec r, Vec z)
+    {
+      PetscErrorCode ierr;
+      monolithic_context<Dimensions> *ctx;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&ctx);CHKERRQ(ierr);
+      auto const rs = ctx->rigid_size;
+
+      PetscScalar const *pr;
+      PetscScalar *pz;
+      ierr = VecGetArrayRead(r, &pr);CHKERRQ(ierr);
+      ierr = VecGetArray(z, &pz);CHKERRQ(ierr);
+
+      std::vector<double> c, f(ctx->nrigid(), 0.);
+      ierr = ctx->get_rigid(pr, c);CHKERRQ(ierr);
+
+      std::size_t num = 0;
+      for(std::size_t ipart=0; ipart<ctx->points.size(); ++ipart)
+        for(auto& rad: ctx->radial[ipart]){
+          add_rigid_motion_transpose(pr + num, rad, &f[ipart*rs]);
+          num += Dimensions;
+        }
+      MPI_Allreduce(MPI_IN_PLACE, f.data(), f.size(), MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+
+      for(std::size_t ipart=0; ipart<ctx->points.size(); ++ipart){
+        std::vector<double> y(rs);
+        for(std::size_t k=0; k<rs; ++k)
+          y[k] = -ctx->alpha*c[ipart*rs + k] - f[ipart*rs + k];
+        // particle without fluid point: its rigid motion is not constrained
+        if (ctx->gram[ipart*rs*rs] > 0)
+          detail::cholesky_solve({ctx->gram.begin() + ipart*rs*rs, ctx->gram.begin() + (ipart + 1)*rs*rs}, rs, y);
+        else
+          std::fill(y.begin(), y.end(), 0.);
+        std::copy(y.begin(), y.end(), c.begin() + ipart*rs);
+      }
+
+      num = 0;
+      for(std::size_t ipart=0; ipart<ctx->points.size(); ++ipart)
+        for(auto& rad: ctx->radial[ipart]){
+          std::array<double, Dimensions> v{};
+          add_rigid_motion(&c[ipart*rs], rad, v.data());
+          for(std::size_t d=0; d<Dimensions; ++d, ++num)
+            pz[num] = (pr[num] + v[d])/ctx->alpha;
+        }
+      if (ctx->rank == 0)
+        std::copy(c.begin(), c.end(), pz + num);
+
+      ierr = VecRestoreArray(z, &pz);CHKERRQ(ierr);
+      ierr = VecRestoreArrayRead(r, &pr);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    //!
+    //! Monolithic formulation of the free particles in a Stokes flow with
+    //! distributed Lagrange multipliers l on the fluid points inside the
+    //! particles
+    //!
+    //!     K u - M E l = f + M E rho F
+    //!     E^T u - R c = 0
+    //!        -R^T l   = 0
+    //!
+    //! where K is the Stokes operator and c the rigid motions of the
+    //! particles. The system is a MatNest of the Stokes matrix and of
+    //! shell coupling blocks solved by one Krylov method (prefix
+    //! monolithic_) with a lower block triangular fieldsplit
+    //! preconditioner: the Stokes preconditioner (multigrid, fast
+    //! diagonalization or PMM as for the Stokes problem) on the fluid
+    //! block (prefix monolithic_fieldsplit_0_) and the exact inverse of
+    //! [alpha I, -R; -R^T, 0] on the constraints, alpha being set by
+    //! -monolithic_schur_scale times h^2. The nested SEM, DtoN and NtoD
+    //! Krylov solves are replaced by this single one.
+    //!
+    template<typename Shape, std::size_t Dimensions, typename Problem_type>
+    struct monolithic : public Problem<Dimensions>
+    {
+      std::vector<particle<Shape>> parts_;
+      Problem_type problem_;
+
+      using Ctx = monolithic_context<Dimensions>;
+      Ctx *ctx;
+
+      Vec sol;
+      Vec rhs;
+      Mat A;      //!< [K, C01; C10, D]
+      Mat P;      //!< The same with the Stokes preconditioner matrix as K
+      Mat C01, C10, D;
+      KSP ksp;
+      PetscReal schur_scale_ = 1.;
+
+      monolithic(std::vector<particle<Shape>> const& parts, Problem_type& p):
+      parts_{parts}, problem_{p}
+      {}
+
+      #undef __FUNCT__
+      #define __FUNCT__ "create_Mat_and_Vec"
+      PetscErrorCode create_Mat_and_Vec()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        auto box = fem::get_DM_bounds<Dimensions>(problem_.ctx->dm, 0);
+        auto& h = problem_.ctx->h;
+
+        ctx = new Ctx;
+        ctx->dm = problem_.ctx->dm;
+        ctx->h = h;
+        ctx->bc = problem_.ctx->bc_;
+        MPI_Comm_rank(PETSC_COMM_WORLD, &ctx->rank);
+
+        find_rigid_points(parts_, box, h, ctx->points, ctx->radial);
+        for(auto& pts: ctx->points)
+          ctx->npoints += pts.size();
+
+        ctx->gram = rigid_gram(ctx->radial);
+
+        ierr = PetscOptionsBegin(PETSC_COMM_WORLD, "monolithic_", "Monolithic problem", "");CHKERRQ(ierr);
+        ierr = PetscOptionsReal("-schur_scale", "The multipliers block of the Schur complement is approximated by schur_scale*h^2 I", "monolithic.hpp", schur_scale_, &schur_scale_, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsEnd();CHKERRQ(ierr);
+        auto hmin = *std::min_element(h.begin(), h.end());
+        ctx->alpha = schur_scale_*hmin*hmin;
+
+        PetscInt nu;
+        ierr = VecGetLocalSize(problem_.sol, &nu);CHKERRQ(ierr);
+        PetscInt nc = Dimensions*ctx->npoints + ((ctx->rank == 0)? ctx->nrigid(): 0);
+
+        ierr = MatCreateShell(PETSC_COMM_WORLD, nu, nc, PETSC_DETERMINE, PETSC_DETERMINE, ctx, &C01);CHKERRQ(ierr);
+        ierr = MatShellSetOperation(C01, MATOP_MULT, (void(*)(void))monolithic_spread<Dimensions>);CHKERRQ(ierr);
+        ierr = MatCreateShell(PETSC_COMM_WORLD, nc, nu, PETSC_DETERMINE, PETSC_DETERMINE, ctx, &C10);CHKERRQ(ierr);
+        ierr = MatShellSetOperation(C10, MATOP_MULT, (void(*)(void))monolithic_restrict<Dimensions>);CHKERRQ(ierr);
+        ierr = MatCreateShell(PETSC_COMM_WORLD, nc, nc, PETSC_DETERMINE, PETSC_DETERMINE, ctx, &D);CHKERRQ(ierr);
+        ierr = MatShellSetOperation(D, MATOP_MULT, (void(*)(void))monolithic_rigid<Dimensions>);CHKERRQ(ierr);
+
+        Mat bA[2][2];
+        bA[0][0] = problem_.A; bA[0][1] = C01;
+        bA[1][0] = C10; bA[1][1] = D;
+        ierr = MatCreateNest(PETSC_COMM_WORLD, 2, PETSC_NULL, 2, PETSC_NULL, &bA[0][0], &A);CHKERRQ(ierr);
+        bA[0][0] = problem_.P;
+        ierr = MatCreateNest(PETSC_COMM_WORLD, 2, PETSC_NULL, 2, PETSC_NULL, &bA[0][0], &P);CHKERRQ(ierr);
+
+        ierr = MatCreateVecs(A, &sol, &rhs);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "setup_RHS"
+      virtual PetscErrorCode setup_RHS() override
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        auto& dm = problem_.ctx->dm;
+        auto& h = problem_.ctx->h;
+
+        ierr = VecSet(problem_.rhs, 0.);CHKERRQ(ierr);
+        ierr = problem_.setup_RHS();CHKERRQ(ierr);
+
+        // the forces rho F of the particles on their fluid points
+        Vec forces, mass_mult;
+        ierr = DMGetGlobalVector(dm, &forces);CHKERRQ(ierr);
+        ierr = DMGetGlobalVector(dm, &mass_mult);CHKERRQ(ierr);
+        ierr = VecSet(forces, 0.);CHKERRQ(ierr);
+        {
+          auto petsc_forces = petsc::petsc_vec<Dimensions>(dm, forces, 0, false);
+          for(std::size_t ipart=0; ipart<parts_.size(); ++ipart)
+            for(auto& ind: ctx->points[ipart]){
+              auto u = petsc_forces.at_g(ind);
+              for(std::size_t d=0; d<Dimensions; ++d)
+                u[d] = parts_[ipart].rho_*parts_[ipart].force_[d];
+            }
+        }
+        ierr = fem::apply_mass_matrix(dm, forces, mass_mult, h);CHKERRQ(ierr);
+        {
+          auto petsc_mass = petsc::petsc_vec<Dimensions>(dm, mass_mult, 0);
+          ierr = SetNullDirichletOnRHS(petsc_mass, ctx->bc);CHKERRQ(ierr);
+        }
+        ierr = VecAXPY(problem_.rhs, 1., mass_mult);CHKERRQ(ierr);
+        ierr = DMRestoreGlobalVector(dm, &mass_mult);CHKERRQ(ierr);
+        ierr = DMRestoreGlobalVector(dm, &forces);CHKERRQ(ierr);
+
+        Vec rhs_u, rhs_c;
+        ierr = VecNestGetSubVec(rhs, 0, &rhs_u);CHKERRQ(ierr);
+        ierr = VecNestGetSubVec(rhs, 1, &rhs_c);CHKERRQ(ierr);
+        ierr = VecCopy(problem_.rhs, rhs_u);CHKERRQ(ierr);
+        ierr = VecSet(rhs_c, 0.);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "setup_KSP"
+      virtual PetscErrorCode setup_KSP() override
+      {
+        PetscErrorCode ierr;
+        PC pc;
+        IS is[2];
+        KSP *subksp;
+        PetscBool same;
+        PetscFunctionBeginUser;
+
+        ierr = KSPCreate(PETSC_COMM_WORLD, &ksp);CHKERRQ(ierr);
+        ierr = KSPSetOptionsPrefix(ksp, "monolithic_");CHKERRQ(ierr);
+        ierr = KSPSetOperators(ksp, A, P);CHKERRQ(ierr);
+        ierr = KSPSetType(ksp, KSPFGMRES);CHKERRQ(ierr);
+
+        ierr = KSPGetPC(ksp, &pc);CHKERRQ(ierr);
+        ierr = PCSetType(pc, PCFIELDSPLIT);CHKERRQ(ierr);
+        ierr = MatNestGetISs(A, is, nullptr);CHKERRQ(ierr);
+        ierr = PCFieldSplitSetIS(pc, "0", is[0]);CHKERRQ(ierr);
+        ierr = PCFieldSplitSetIS(pc, "1", is[1]);CHKERRQ(ierr);
+        ierr = PCFieldSplitSetType(pc, PC_COMPOSITE_SCHUR);CHKERRQ(ierr);
+        ierr = PCFieldSplitSetSchurFactType(pc, PC_FIELDSPLIT_SCHUR_FACT_LOWER);CHKERRQ(ierr);
+        ierr = PCFieldSplitSetSchurPre(pc, PC_FIELDSPLIT_SCHUR_PRE_USER, D);CHKERRQ(ierr);
+        ierr = KSPSetFromOptions(ksp);CHKERRQ(ierr);
+        ierr = KSPSetUp(ksp);CHKERRQ(ierr);
+
+        ierr = PetscObjectTypeCompare((PetscObject)pc, PCFIELDSPLIT, &same);CHKERRQ(ierr);
+        if (!same)
+          PetscFunctionReturn(0);
+
+        ierr = PCFieldSplitGetSubKSP(pc, nullptr, &subksp);CHKERRQ(ierr);
+
+        // the fluid block: one application of the Stokes preconditioner
+        auto& stokes_ctx = *problem_.ctx;
+        ierr = KSPSetDM(subksp[0], stokes_ctx.dm);CHKERRQ(ierr);
+        ierr = KSPSetDMActive(subksp[0], PETSC_FALSE);CHKERRQ(ierr);
+        ierr = KSPSetType(subksp[0], KSPPREONLY);CHKERRQ(ierr);
+        ierr = KSPGetPC(subksp[0], &pc);CHKERRQ(ierr);
+        ierr = PCSetType(pc, PCFIELDSPLIT);CHKERRQ(ierr);
+        if (problem_.opt.pmm){
+          ierr = setPMMSolver<Dimensions>(subksp[0], stokes_ctx.dm, problem_.opt.pmm_pressure_mg);CHKERRQ(ierr);
+          ierr = KSPSetType(subksp[0], KSPPREONLY);CHKERRQ(ierr);
+        }
+        ierr = KSPSetFromOptions(subksp[0]);CHKERRQ(ierr);
+        ierr = KSPSetUp(subksp[0]);CHKERRQ(ierr);
+        ierr = setup_fieldsplit_solvers(pc, stokes_ctx, problem_.opt);CHKERRQ(ierr);
+
+        // the constraints block: exact inverse of the approximate Schur complement
+        ierr = KSPSetType(subksp[1], KSPPREONLY);CHKERRQ(ierr);
+        ierr = KSPGetPC(subksp[1], &pc);CHKERRQ(ierr);
+        ierr = PCSetType(pc, PCSHELL);CHKERRQ(ierr);
+        ierr = PCShellSetContext(pc, ctx);CHKERRQ(ierr);
+        ierr = PCShellSetApply(pc, monolithic_schur_apply<Dimensions>);CHKERRQ(ierr);
+        ierr = PCShellSetName(pc, "rigid constraints");CHKERRQ(ierr);
+        ierr = KSPSetFromOptions(subksp[1]);CHKERRQ(ierr);
+
+        ierr = PetscFree(subksp);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "solve"
+      //! Solves the coupled problem: the fluid solution is copied in the
+      //! Stokes problem and the rigid motions in the particles.
+      virtual PetscErrorCode solve() override
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        ierr = KSPSolve(ksp, rhs, sol);CHKERRQ(ierr);
+
+        Vec sol_u, sol_c;
+        ierr = VecNestGetSubVec(sol, 0, &sol_u);CHKERRQ(ierr);
+        ierr = VecNestGetSubVec(sol, 1, &sol_c);CHKERRQ(ierr);
+        ierr = VecCopy(sol_u, problem_.sol);CHKERRQ(ierr);
+
+        PetscScalar const *psol;
+        std::vector<double> c;
+        ierr = VecGetArrayRead(sol_c, &psol);CHKERRQ(ierr);
+        ierr = ctx->get_rigid(psol, c);CHKERRQ(ierr);
+        ierr = VecRestoreArrayRead(sol_c, &psol);CHKERRQ(ierr);
+
+        auto const rs = ctx->rigid_size;
+        for(std::size_t ipart=0; ipart<parts_.size(); ++ipart){
+          for(std::size_t d=0; d<Dimensions; ++d)
+            parts_[ipart].velocity_[d] = c[ipart*rs + d];
+          set_angular_velocity(parts_[ipart].angular_velocity_, &c[ipart*rs + Dimensions]);
+        }
+
+        PetscFunctionReturn(0);
+      }
+
+    };
+  }
+
+  template<typename PL, typename Problem_type, typename Dimensions = typename PL::value_type::dimension_type>
+  auto make_monolithic(PL const& pt, Problem_type& p)
+  {
+    using s_t = typename PL::value_type::shape_type;
+    return problem::monolithic<s_t, Dimensions::value, Problem_type>{pt, p};
+  }
+
+}
+#endif
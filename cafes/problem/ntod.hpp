@@ -29,7 +29,9 @@
 #ifndef CAFES_PROBLEM_NTOD_HPP_INCLUDED
 #define CAFES_PROBLEM_NTOD_HPP_INCLUDED
 
+#include <problem/dense.hpp>
 #include <problem/dton.hpp>
+#include <problem/recycling.hpp>
 #include <particle/forces_torques.hpp>
 
 namespace cafes
@@ -38,94 +40,81 @@ namespace cafes
   {
 
     #undef __FUNCT__
-    #define __FUNCT__ "NtoD_matrix"
+    #define __FUNCT__ "NtoD_set_motion"
+    //! Sets the velocity and the angular velocity of the particles which
+    //! intersect the local box from x.
     template<std::size_t Dimensions, typename Ctx>
-    PetscErrorCode NtoD_matrix(Mat A, Vec x, Vec y){
+    PetscErrorCode NtoD_set_motion(Ctx& ctx, Vec x){
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
-      std::size_t torque_size = (Dimensions==2)?1:3;
-
-      Ctx *ctx;
-      ierr = MatShellGetContext(A, (void**) &ctx);CHKERRQ(ierr);
-
-      ierr = VecSet(ctx->problem.rhs, 0.);CHKERRQ(ierr);
-      ierr = VecSet(ctx->problem.sol, 0.);CHKERRQ(ierr);
-
-      auto box = fem::get_DM_bounds<Dimensions>(ctx->problem.ctx->problem.ctx->dm, 0);
-      auto& h = ctx->problem.ctx->problem.ctx->h;
+      auto box = fem::get_DM_bounds<Dimensions>(ctx.problem.ctx->problem.ctx->dm, 0);
+      auto& h = ctx.problem.ctx->problem.ctx->h;
 
       std::size_t num = 0;
+      PetscScalar const *px;
+      ierr = VecGetArrayRead(x, &px);CHKERRQ(ierr);
 
-      if (ctx->compute_rhs)
+      for (std::size_t ipart=0; ipart<ctx.particles.size(); ++ipart)
       {
-        ctx->problem.ctx->compute_rhs = true;
-        ctx->problem.ctx->add_rigid_motion = false;
-        ctx->problem.ctx->compute_singularity = true;
-      }
-      else
-      {
-        ctx->problem.ctx->compute_rhs = false;
-        ctx->problem.ctx->add_rigid_motion = true;
-        ctx->problem.ctx->compute_singularity = true;
-
-        // set velocity and angular velocity on particles
-        PetscScalar const *px;
-        ierr = VecGetArrayRead(x, &px);CHKERRQ(ierr);
-
-        std::size_t num_print = 0;
-        for (std::size_t ipart=0; ipart<ctx->particles.size(); ++ipart)
+        auto p = ctx.particles[ipart];
+        auto pbox = p.bounding_box(h);
+        if (geometry::intersect(box, pbox))
         {
-          auto p = ctx->particles[ipart];
-          auto pbox = p.bounding_box(h);
-          if (geometry::intersect(box, pbox))
-          {
+          for(std::size_t d=0; d<Dimensions; ++d)
+            ctx.particles[ipart].velocity_[d] = px[num++];
+          if (Dimensions == 2)
+            ctx.particles[ipart].angular_velocity_[2] = px[num++];
+          else
             for(std::size_t d=0; d<Dimensions; ++d)
-              ctx->particles[ipart].velocity_[d] = px[num++];
-            if (Dimensions == 2)
-              ctx->particles[ipart].angular_velocity_[2] = px[num++];
-            else
-              for(std::size_t d=0; d<Dimensions; ++d)
-                ctx->particles[ipart].angular_velocity_[d] = px[num++];
-          }
+              ctx.particles[ipart].angular_velocity_[d] = px[num++];
         }
-        ierr = VecRestoreArrayRead(x, &px);CHKERRQ(ierr);
       }
+      ierr = VecRestoreArrayRead(x, &px);CHKERRQ(ierr);
 
-      ierr = ctx->problem.setup_RHS();CHKERRQ(ierr);
+      PetscFunctionReturn(0);
+    }
 
-      // solve DtoN with these velocities
-      ctx->problem.ctx->compute_rhs = false;
-      ctx->problem.ctx->add_rigid_motion = false;
-      ctx->problem.ctx->compute_singularity = false;
+    #undef __FUNCT__
+    #define __FUNCT__ "NtoD_forces"
+    //! Sets y with the forces and the torques on the particles which
+    //! intersect the local box computed from the last DtoN solution.
+    template<std::size_t Dimensions, typename Ctx>
+    PetscErrorCode NtoD_forces(Ctx& ctx, Vec y){
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
 
-      ierr = ctx->problem.solve();CHKERRQ(ierr);
+      std::size_t torque_size = (Dimensions==2)?1:3;
+
+      auto box = fem::get_DM_bounds<Dimensions>(ctx.problem.ctx->problem.ctx->dm, 0);
+      auto& h = ctx.problem.ctx->problem.ctx->h;
 
       std::vector<double> forces, torques;
 
-      forces.resize(ctx->particles.size()*Dimensions);
-      torques.resize(ctx->particles.size()*torque_size);
+      forces.resize(ctx.particles.size()*Dimensions);
+      torques.resize(ctx.particles.size()*torque_size);
 
       std::fill(forces.begin(), forces.end(), 0.);
       std::fill(torques.begin(), torques.end(), 0.);
 
-      ierr = forces_torques_with_control(ctx->particles,
-                                         ctx->problem.sol,
+      ierr = forces_torques_with_control(ctx.particles,
+                                         ctx.problem.sol,
                                          box,
                                          forces,
                                          torques,
-                                         ctx->num,
+                                         ctx.num,
                                          h,
-                                         ctx->compute_singularity);CHKERRQ(ierr);
+                                         ctx.compute_singularity,
+                                         &ctx.problem.ctx->index);CHKERRQ(ierr);
 
       // set y with the forces and the torques computed by DtoN
-      num = 0;
+      std::size_t num = 0;
       PetscScalar *py;
       ierr = VecGetArray(y, &py);CHKERRQ(ierr);
 
-      for (std::size_t ipart=0; ipart<ctx->particles.size(); ++ipart)
+      for (std::size_t ipart=0; ipart<ctx.particles.size(); ++ipart)
       {
-        auto p = ctx->particles[ipart];
+        auto p = ctx.particles[ipart];
         auto pbox = p.bounding_box(h);
         if (geometry::intersect(box, pbox))
         {
@@ -140,6 +129,49 @@ namespace cafes
       PetscFunctionReturn(0);
     }
 
+    #undef __FUNCT__
+    #define __FUNCT__ "NtoD_matrix"
+    template<std::size_t Dimensions, typename Ctx>
+    PetscErrorCode NtoD_matrix(Mat A, Vec x, Vec y){
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      Ctx *ctx;
+      ierr = MatShellGetContext(A, (void**) &ctx);CHKERRQ(ierr);
+
+      ierr = VecSet(ctx->problem.rhs, 0.);CHKERRQ(ierr);
+      ierr = VecSet(ctx->problem.sol, 0.);CHKERRQ(ierr);
+
+      if (ctx->compute_rhs)
+      {
+        ctx->problem.ctx->compute_rhs = true;
+        ctx->problem.ctx->add_rigid_motion = false;
+        ctx->problem.ctx->compute_singularity = true;
+      }
+      else
+      {
+        ctx->problem.ctx->compute_rhs = false;
+        ctx->problem.ctx->add_rigid_motion = true;
+        ctx->problem.ctx->compute_singularity = true;
+
+        // set velocity and angular velocity on particles
+        ierr = NtoD_set_motion<Dimensions>(*ctx, x);CHKERRQ(ierr);
+      }
+
+      ierr = ctx->problem.setup_RHS();CHKERRQ(ierr);
+
+      // solve DtoN with these velocities
+      ctx->problem.ctx->compute_rhs = false;
+      ctx->problem.ctx->add_rigid_motion = false;
+      ctx->problem.ctx->compute_singularity = false;
+
+      ierr = ctx->problem.solve();CHKERRQ(ierr);
+
+      ierr = NtoD_forces<Dimensions>(*ctx, y);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
 
     template<typename Shape, std::size_t Dimensions, typename Problem_type>
     struct NtoD : public Problem<Dimensions>
@@ -150,14 +182,21 @@ namespace cafes
 
       std::vector<force_type> forces_;
 
-      Vec sol;
+      Vec sol = nullptr;
       Vec stokes_sol_save;
-      Vec rhs;
-      Mat A;
+      Vec rhs = nullptr;
+      Mat A = nullptr;
       KSP ksp;
+      inexact_control *inexact_ = nullptr; //!< Relaxation of the inner tolerance
+      particle_pc_cache pc_cache_;         //!< Blocks of the particle preconditioner
+      krylov_recycling<Dimensions> *recycling_ = nullptr; //!< Subspace kept between two solves
+      PetscBool dense_ = PETSC_FALSE;       //!< Solve with the assembled resistance matrix
+      std::vector<double> resistance_;      //!< LU factors of the resistance matrix (on each process)
+      std::vector<std::size_t> resistance_pivots_;
+      std::vector<double> resistance_geometry_; //!< Geometry of the particles of the assembly
 
       using Ctx = particle_context<Dimensions, Shape, typename problem::DtoN<Shape, Dimensions, Problem_type> >;
-      Ctx *ctx;
+      Ctx *ctx = nullptr;
 
       using dpart_type = typename std::conditional<Dimensions == 2, 
                                   double, 
@@ -180,6 +219,17 @@ namespace cafes
         PetscErrorCode ierr;
         PetscFunctionBeginUser;
 
+        // the particles are set again: the resistance matrix and the
+        // blocks of the particle preconditioner are dropped
+        reset_resistance();
+        pc_cache_.clear();
+
+        // the matrix of the previous particles releases its context when
+        // the solvers using it are done with it
+        ierr = MatDestroy(&A);CHKERRQ(ierr);
+        ierr = VecDestroy(&sol);CHKERRQ(ierr);
+        ierr = VecDestroy(&rhs);CHKERRQ(ierr);
+
         ctx = new Ctx{dton_,
                       dton_.parts_,
                       dton_.surf_points_,
@@ -208,6 +258,7 @@ namespace cafes
 
         ierr = MatCreateShell(PETSC_COMM_WORLD, local_size, local_size, PETSC_DECIDE, PETSC_DECIDE, ctx, &A);CHKERRQ(ierr);
         ierr = MatShellSetOperation(A, MATOP_MULT, (void(*)(void))NtoD_matrix<Dimensions, Ctx>);CHKERRQ(ierr);
+        ierr = MatShellSetOperation(A, MATOP_DESTROY, (void(*)(void))destroy_particle_context<Ctx>);CHKERRQ(ierr);
 
         ierr = MatCreateVecs(A, &sol, &rhs);CHKERRQ(ierr);
 
@@ -255,10 +306,168 @@ namespace cafes
         ierr = KSPGetPC(ksp, &pc);CHKERRQ(ierr);
         ierr = PCSetType(pc, PCNONE);CHKERRQ(ierr);
         ierr = KSPSetFromOptions(ksp);CHKERRQ(ierr);
+        ierr = set_particle_preconditioner(ksp, dton_.parts_, dton_.problem_.ctx->dm, dton_.problem_.ctx->h, true, &pc_cache_);CHKERRQ(ierr);
+        ierr = set_inexact_inner_solves(ksp, dton_.ksp, &inexact_);CHKERRQ(ierr);
+        ierr = set_krylov_recycling(ksp, true, &recycling_);CHKERRQ(ierr);
+
+        ierr = PetscOptionsBegin(PETSC_COMM_WORLD, "NtoD_", "NtoD problem", "");CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-dense", "Solve with the resistance matrix assembled once for the geometry", "ntod.hpp", dense_, &dense_, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsEnd();CHKERRQ(ierr);
 
         PetscFunctionReturn(0);
       }
 
+      #undef __FUNCT__
+      #define __FUNCT__ "gather_rigid_"
+      //! The rigid motions (or forces and torques) of all the particles
+      //! from the entries of v stored by the processes they intersect.
+      PetscErrorCode gather_rigid_(Vec v, std::vector<double>& c)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        auto const rs = rigid_size<Dimensions>();
+        auto box = fem::get_DM_bounds<Dimensions>(dton_.problem_.ctx->dm, 0);
+        auto& h = dton_.problem_.ctx->h;
+        auto& parts = dton_.parts_;
+
+        c.assign(parts.size()*rs, 0.);
+        std::vector<int> count(parts.size(), 0);
+
+        PetscScalar const *pv;
+        ierr = VecGetArrayRead(v, &pv);CHKERRQ(ierr);
+        std::size_t num = 0;
+        for(std::size_t ipart=0; ipart<parts.size(); ++ipart)
+          if (geometry::intersect(box, parts[ipart].bounding_box(h))){
+            count[ipart] = 1;
+            for(std::size_t k=0; k<rs; ++k)
+              c[ipart*rs + k] = pv[num++];
+          }
+        ierr = VecRestoreArrayRead(v, &pv);CHKERRQ(ierr);
+
+        MPI_Allreduce(MPI_IN_PLACE, c.data(), c.size(), MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, count.data(), count.size(), MPI_INT, MPI_SUM, PETSC_COMM_WORLD);
+        for(std::size_t ipart=0; ipart<parts.size(); ++ipart)
+          if (count[ipart] > 1)
+            for(std::size_t k=0; k<rs; ++k)
+              c[ipart*rs + k] /= count[ipart];
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "scatter_rigid_"
+      //! The inverse of gather_rigid_.
+      PetscErrorCode scatter_rigid_(std::vector<double> const& c, Vec v)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        auto const rs = rigid_size<Dimensions>();
+        auto box = fem::get_DM_bounds<Dimensions>(dton_.problem_.ctx->dm, 0);
+        auto& h = dton_.problem_.ctx->h;
+        auto& parts = dton_.parts_;
+
+        PetscScalar *pv;
+        ierr = VecGetArray(v, &pv);CHKERRQ(ierr);
+        std::size_t num = 0;
+        for(std::size_t ipart=0; ipart<parts.size(); ++ipart)
+          if (geometry::intersect(box, parts[ipart].bounding_box(h)))
+            for(std::size_t k=0; k<rs; ++k)
+              pv[num++] = c[ipart*rs + k];
+        ierr = VecRestoreArray(v, &pv);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "assemble_resistance"
+      //! Assembles the resistance matrix column by column with the NtoD
+      //! operator and keeps its LU factors on each process: the next
+      //! solves on this geometry are dense solves. The matrix is
+      //! assembled again after reset_resistance or when the centers or the
+      //! shape factors of the particles have changed (see
+      //! resistance_geometry).
+      //!
+      //! The right hand sides of the DtoN problems of all the columns are
+      //! computed together by DtoN_matrix_batch, so that their fluid
+      //! solves are batched. Each DtoN solve needs the previous iterate:
+      //! they are done one column after the other.
+      PetscErrorCode assemble_resistance()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        std::size_t const n = dton_.parts_.size()*rigid_size<Dimensions>();
+        std::vector<double> e(n), col;
+        std::vector<Vec> x(n), w(n), r(n);
+        Vec y;
+        ierr = VecDuplicate(sol, &y);CHKERRQ(ierr);
+        for(std::size_t j=0; j<n; ++j){
+          std::fill(e.begin(), e.end(), 0.);
+          e[j] = 1.;
+          ierr = VecDuplicate(sol, &x[j]);CHKERRQ(ierr);
+          ierr = scatter_rigid_(e, x[j]);CHKERRQ(ierr);
+          ierr = VecDuplicate(dton_.sol, &w[j]);CHKERRQ(ierr);
+          ierr = VecSet(w[j], 0.);CHKERRQ(ierr);
+          ierr = VecDuplicate(dton_.rhs, &r[j]);CHKERRQ(ierr);
+        }
+
+        // DtoN setup_RHS of each column (see NtoD_matrix)
+        auto& dctx = *dton_.ctx;
+        dctx.compute_rhs = false;
+        dctx.add_rigid_motion = true;
+        dctx.compute_singularity = true;
+        ierr = DtoN_matrix_batch<Dimensions>(dctx, w, r, [&](std::size_t j){
+          return NtoD_set_motion<Dimensions>(*ctx, x[j]);
+        });CHKERRQ(ierr);
+
+        resistance_.assign(n*n, 0.);
+        for(std::size_t j=0; j<n; ++j){
+          ierr = NtoD_set_motion<Dimensions>(*ctx, x[j]);CHKERRQ(ierr);
+          ierr = VecScale(r[j], -1.);CHKERRQ(ierr);
+          ierr = VecCopy(r[j], dton_.rhs);CHKERRQ(ierr);
+          ierr = VecSet(dton_.sol, 0.);CHKERRQ(ierr);
+
+          dctx.compute_rhs = false;
+          dctx.add_rigid_motion = false;
+          dctx.compute_singularity = false;
+          ierr = dton_.solve();CHKERRQ(ierr);
+
+          ierr = NtoD_forces<Dimensions>(*ctx, y);CHKERRQ(ierr);
+          ierr = gather_rigid_(y, col);CHKERRQ(ierr);
+          for(std::size_t i=0; i<n; ++i)
+            resistance_[i*n + j] = col[i];
+        }
+
+        ierr = VecDestroy(&y);CHKERRQ(ierr);
+        for(std::size_t j=0; j<n; ++j){
+          ierr = VecDestroy(&x[j]);CHKERRQ(ierr);
+          ierr = VecDestroy(&w[j]);CHKERRQ(ierr);
+          ierr = VecDestroy(&r[j]);CHKERRQ(ierr);
+        }
+
+        if (!detail::lu_factor(resistance_, n, resistance_pivots_))
+          SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_MAT_LU_ZRPVT, "singular resistance matrix");
+        resistance_geometry_ = resistance_geometry();
+
+        PetscFunctionReturn(0);
+      }
+
+      //! Forgets the resistance matrix (the particles have moved).
+      void reset_resistance()
+      {
+        resistance_.clear();
+        resistance_geometry_.clear();
+      }
+
+      //! The centers, the shape factors and the orientations of the
+      //! particles.
+      std::vector<double> resistance_geometry() const
+      {
+        return particle_grid_index<Dimensions>::geometry_of(dton_.parts_);
+      }
+
       #undef __FUNCT__
       #define __FUNCT__ "solve"
       virtual PetscErrorCode solve() override
@@ -269,7 +478,26 @@ namespace cafes
         ctx->compute_rhs = false;
         ctx->compute_singularity = true;
 
-        ierr = KSPSolve(ksp, rhs, sol);CHKERRQ(ierr);
+        if (dense_){
+          if (resistance_.empty() || resistance_geometry_ != resistance_geometry()){
+            ierr = assemble_resistance();CHKERRQ(ierr);
+          }
+          std::vector<double> c;
+          ierr = gather_rigid_(rhs, c);CHKERRQ(ierr);
+          detail::lu_solve(resistance_, c.size(), resistance_pivots_, c);
+          ierr = scatter_rigid_(c, sol);CHKERRQ(ierr);
+        }
+        else{
+          if (recycling_){
+            ierr = recycling_->solve(ksp, rhs, sol, dton_.parts_, dton_.ctx->index, dton_.problem_.ctx->dm, dton_.problem_.ctx->h);CHKERRQ(ierr);
+          }
+          else{
+            ierr = KSPSolve(ksp, rhs, sol);CHKERRQ(ierr);
+          }
+          if (inexact_){
+            ierr = inexact_->restore();CHKERRQ(ierr);
+          }
+        }
 
         auto box = fem::get_DM_bounds<Dimensions>(ctx->problem.ctx->problem.ctx->dm, 0);
         auto& h = ctx->problem.ctx->problem.ctx->h;
@@ -29,9 +29,15 @@
 #ifndef PARTICLE_PROBLEM_OPTIONS_HPP_INCLUDED
 #define PARTICLE_PROBLEM_OPTIONS_HPP_INCLUDED
 
+#include <fem/smoother.hpp>
+#include <problem/initial_guess.hpp>
 #include <array>
 #include <petsc.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace cafes
 {
   namespace problem
@@ -43,6 +49,20 @@ namespace cafes
       std::array<PetscBool, Dimensions> xperiod;
       PetscBool strain_tensor = PETSC_FALSE;
       PetscBool pmm = PETSC_FALSE;
+      PetscBool pmm_pressure_mg = PETSC_FALSE;
+      PetscBool line_sweep = PETSC_FALSE;
+      PetscBool sum_factorization = PETSC_FALSE;
+      PetscInt nthreads = 0;
+      PetscBool assembled = PETSC_FALSE;
+      PetscBool assembled_baij = PETSC_FALSE;
+      fem::smoother_type mg_smoother = fem::smoother_type::cg;
+      PetscBool mg_chebyshev_estimate = PETSC_FALSE;
+      PetscBool mg_single_precision = PETSC_FALSE;
+      PetscBool fast_diagonalization = PETSC_FALSE;
+      initial_guess_type guess_type = initial_guess_type::none;
+      PetscInt guess_size = 8;
+      PetscBool guess_view = PETSC_FALSE;
+      PetscInt batch_size = 8;
 
       options(){
         mx.fill(17);
@@ -65,6 +85,15 @@ namespace cafes
         ierr = PetscOptionsBool("-yperiod", "set periodic condition in y direction", "options.hpp", xperiod[1], &xperiod[1], nullptr);CHKERRQ(ierr);
         ierr = PetscOptionsBool("-strain_tensor", "Use strain tensor term instead of the Laplacian", "options.hpp", strain_tensor, &strain_tensor, nullptr);CHKERRQ(ierr);
         ierr = PetscOptionsBool("-PMM", "MG with Pressure Mass Matrix preconditionner", "options.hpp", pmm, &pmm, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-PMM_pressure_mg", "Use MG instead of Jacobi on the Pressure Mass Matrix", "options.hpp", pmm_pressure_mg, &pmm_pressure_mg, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-line_sweep", "Use the SIMD x-line kernels for the Laplacian and mass operators", "options.hpp", line_sweep, &line_sweep, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-sum_factorization", "Use the sum-factorized kernels for the Laplacian and strain tensor operators", "options.hpp", sum_factorization, &sum_factorization, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsInt("-nthreads", "The number of threads used by the element loops (0: OpenMP default)", "options.hpp", nthreads, &nthreads, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-stokes_assembled", "Assemble the Stokes matrices instead of the matrix-free operators", "options.hpp", assembled, &assembled, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-stokes_assembled_baij", "Use the MATBAIJ format for the assembled velocity block", "options.hpp", assembled_baij, &assembled_baij, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-fast_diagonalization", "Use the sine transform fast diagonalization as preconditioner of the velocity block (needs FFTW)", "options.hpp", fast_diagonalization, &fast_diagonalization, nullptr);CHKERRQ(ierr);
+        ierr = set_mg_smoother_options();CHKERRQ(ierr);
+        ierr = set_initial_guess_options();CHKERRQ(ierr);
         ierr = PetscOptionsEnd();CHKERRQ(ierr);
 
         PetscFunctionReturn(0);
@@ -88,11 +117,53 @@ namespace cafes
         ierr = PetscOptionsBool("-zperiod", "set periodic condition in z direction", "options.hpp", xperiod[2], &xperiod[2], nullptr);CHKERRQ(ierr);
         ierr = PetscOptionsBool("-strain_tensor", "Use strain tensor term instead of the Laplacian", "options.hpp", strain_tensor, &strain_tensor, nullptr);CHKERRQ(ierr);
         ierr = PetscOptionsBool("-PMM", "MG with Pressure Mass Matrix preconditionner", "options.hpp", pmm, &pmm, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-PMM_pressure_mg", "Use MG instead of Jacobi on the Pressure Mass Matrix", "options.hpp", pmm_pressure_mg, &pmm_pressure_mg, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-line_sweep", "Use the SIMD x-line kernels for the Laplacian and mass operators", "options.hpp", line_sweep, &line_sweep, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-sum_factorization", "Use the sum-factorized kernels for the Laplacian and strain tensor operators", "options.hpp", sum_factorization, &sum_factorization, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsInt("-nthreads", "The number of threads used by the element loops (0: OpenMP default)", "options.hpp", nthreads, &nthreads, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-stokes_assembled", "Assemble the Stokes matrices instead of the matrix-free operators", "options.hpp", assembled, &assembled, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-stokes_assembled_baij", "Use the MATBAIJ format for the assembled velocity block", "options.hpp", assembled_baij, &assembled_baij, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-fast_diagonalization", "Use the sine transform fast diagonalization as preconditioner of the velocity block (needs FFTW)", "options.hpp", fast_diagonalization, &fast_diagonalization, nullptr);CHKERRQ(ierr);
+        ierr = set_mg_smoother_options();CHKERRQ(ierr);
+        ierr = set_initial_guess_options();CHKERRQ(ierr);
         ierr = PetscOptionsEnd();CHKERRQ(ierr);
 
         PetscFunctionReturn(0);
       }
 
+      #undef __FUNCT__
+      #define __FUNCT__ "set_mg_smoother_options"
+      PetscErrorCode set_mg_smoother_options(){
+        PetscErrorCode ierr;
+        const char *smoothers[] = {"cg", "chebyshev", "gs"};
+        PetscInt smoother = static_cast<PetscInt>(mg_smoother);
+        PetscFunctionBeginUser;
+
+        ierr = PetscOptionsEList("-mg_smoother", "The smoother of the matrix-free multigrid levels", "options.hpp", smoothers, 3, smoothers[smoother], &smoother, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-mg_chebyshev_estimate", "Estimate the eigenvalue bounds of the Chebyshev smoother instead of the Gershgorin bound", "options.hpp", mg_chebyshev_estimate, &mg_chebyshev_estimate, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-mg_single_precision", "Apply the operators of the velocity multigrid levels in single precision", "options.hpp", mg_single_precision, &mg_single_precision, nullptr);CHKERRQ(ierr);
+        mg_smoother = static_cast<fem::smoother_type>(smoother);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "set_initial_guess_options"
+      PetscErrorCode set_initial_guess_options(){
+        PetscErrorCode ierr;
+        const char *guesses[] = {"none", "previous", "fischer", "pod"};
+        PetscInt guess = static_cast<PetscInt>(guess_type);
+        PetscFunctionBeginUser;
+
+        ierr = PetscOptionsEList("-stokes_initial_guess", "The initial guess of the Stokes solver", "options.hpp", guesses, 4, guesses[guess], &guess, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsInt("-stokes_initial_guess_size", "The number of solutions kept for the fischer and pod initial guesses", "options.hpp", guess_size, &guess_size, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsBool("-stokes_initial_guess_view", "View the statistics of the initial guesses after each solve", "options.hpp", guess_view, &guess_view, nullptr);CHKERRQ(ierr);
+        ierr = PetscOptionsInt("-stokes_batch_size", "The maximum number of problems of a batched Stokes solve", "options.hpp", batch_size, &batch_size, nullptr);CHKERRQ(ierr);
+        guess_type = static_cast<initial_guess_type>(guess);
+
+        PetscFunctionReturn(0);
+      }
+
       #undef __FUNCT__
       #define __FUNCT__ "process_options"
       PetscErrorCode process_options(){
@@ -100,6 +171,11 @@ namespace cafes
         PetscFunctionBeginUser;
       
         ierr = process_options_(std::integral_constant<int, Dimensions>{});CHKERRQ(ierr);
+
+#ifdef _OPENMP
+        if (nthreads > 0)
+          omp_set_num_threads(nthreads);
+#endif
       
         PetscFunctionReturn(0);
       }
@@ -50,6 +50,7 @@
 #include <memory>
 #include <algorithm>
 #include <chrono>
+#include <vector>
 
 namespace cafes
 {
@@ -67,6 +68,47 @@ namespace cafes
       return std::forward<T>(c).second;
     }
 
+    namespace detail
+    {
+      template<typename Problem_type>
+      auto solve_problem_batch_(Problem_type& problem, std::vector<Vec> const& rhs_batch, std::vector<Vec>& sol_batch, int)
+      -> decltype(problem.solve_batch(rhs_batch, sol_batch))
+      {
+        return problem.solve_batch(rhs_batch, sol_batch);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "solve_problem_batch_"
+      template<typename Problem_type>
+      PetscErrorCode solve_problem_batch_(Problem_type& problem, std::vector<Vec> const& rhs_batch, std::vector<Vec>& sol_batch, long)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        for(std::size_t b=0; b<rhs_batch.size(); ++b){
+          if (b == sol_batch.size()){
+            sol_batch.push_back(nullptr);
+            ierr = VecDuplicate(problem.sol, &sol_batch[b]);CHKERRQ(ierr);
+          }
+          ierr = VecCopy(rhs_batch[b], problem.rhs);CHKERRQ(ierr);
+          ierr = problem.solve();CHKERRQ(ierr);
+          ierr = VecCopy(problem.sol, sol_batch[b]);CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+    }
+
+    //! Solves the fluid problem for each right hand side of rhs_batch with
+    //! its solve_batch (see stokes::solve_batch), or one after the other
+    //! with solve if it has none. The missing vectors of sol_batch are
+    //! created.
+    template<typename Problem_type>
+    PetscErrorCode solve_problem_batch(Problem_type& problem, std::vector<Vec> const& rhs_batch, std::vector<Vec>& sol_batch)
+    {
+      return detail::solve_problem_batch_(problem, rhs_batch, sol_batch, 0);
+    }
+
     #undef __FUNCT__
     #define __FUNCT__ "set_rhs_problem_impl"
     template<std::size_t Dimensions, typename Ctx>
@@ -75,26 +117,24 @@ namespace cafes
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
+      auto& index = ctx.index;
+      ierr = index.check(ctx.particles, x);CHKERRQ(ierr);
+
       int num = 0;
       PetscScalar const *px;
       ierr = VecGetArrayRead(x, &px);CHKERRQ(ierr);
 
-      auto box = fem::get_DM_bounds<Dimensions>(ctx.problem.ctx->dm, 0);
-      for(auto& p: ctx.particles){
-        auto pbox = p.bounding_box(ctx.problem.ctx->h);
-        if (geometry::intersect(box, pbox)){
-          auto new_box = geometry::overlap_box(box, pbox);
-          auto pts = find_fluid_points_insides(p, new_box, ctx.problem.ctx->h);
-          for(auto& ind: pts)
-          {
-            auto u = petsc_u.at_g(ind);
-            if (apply_forces)
-              for(std::size_t i=0; i<Dimensions; ++i)
-                u[i] = px[num++] + p.rho_*p.force_[i];
-            else
-              for(std::size_t i=0; i<Dimensions; ++i)
-                u[i] = px[num++];
-          }       
+      for(std::size_t ipart=0; ipart<ctx.particles.size(); ++ipart){
+        auto& p = ctx.particles[ipart];
+        for(std::size_t i=index.start[ipart]; i<index.start[ipart + 1]; ++i)
+        {
+          auto u = petsc_u.at_g_node(index.global_nodes[i]);
+          if (apply_forces)
+            for(std::size_t d=0; d<Dimensions; ++d)
+              u[d] = px[num++] + p.rho_*p.force_[d];
+          else
+            for(std::size_t d=0; d<Dimensions; ++d)
+              u[d] = px[num++];
         }
       }
 
@@ -160,26 +200,8 @@ namespace cafes
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
-      auto sol = petsc::petsc_vec<Dimensions>(ctx.problem.ctx->dm, ctx.problem.sol, 0);
-
-      ierr = sol.global_to_local(INSERT_VALUES);CHKERRQ(ierr);
-
-      std::size_t ipart=0;
-      for(auto& spts: ctx.surf_points){
-        for(std::size_t i=0; i<spts.size(); ++i){
-          auto bfunc = fem::P1_integration(get_position(spts[i]), ctx.problem.ctx->h);
-          auto ielem = fem::get_element(get_index(spts[i]));
-          
-          std::fill(g[ipart][i].begin(), g[ipart][i].end(), 0.);
-          
-          for (std::size_t j=0; j<bfunc.size(); ++j){
-            auto u = sol.at(ielem[j]);
-            for (std::size_t d=0; d<Dimensions; ++d)
-              g[ipart][i][d] += u[d]*bfunc[j];
-          }
-        }
-        ipart++;
-      }
+      ierr = ctx.surface.update(ctx.problem.ctx->dm, ctx.surf_points, ctx.problem.ctx->h);CHKERRQ(ierr);
+      ierr = ctx.surface.interpolate(ctx.problem.sol, g);CHKERRQ(ierr);
 
       if (rigid_motion)
       { 
@@ -237,25 +259,11 @@ namespace cafes
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
-      ierr = VecSet(ctx.problem.rhs, 0.);CHKERRQ(ierr);
-
-      auto sol = petsc::petsc_vec<Dimensions>(ctx.problem.ctx->dm, ctx.problem.rhs, 0, false);
-      ierr = sol.fill(0.);CHKERRQ(ierr);
-
+      std::vector<double> gammak(g.size());
       for(std::size_t ipart=0; ipart<g.size(); ++ipart){ 
-        auto& radius = ctx.particles[ipart].shape_factors_[0];
         //auto gammak = ctx.particles[ipart].perimeter/ctx.nb_surf_points[ipart];  
         // remove this line !!
-        auto gammak = ctx.particles[ipart].surface_area()/ctx.nb_surf_points[ipart];
-        for(std::size_t isurf=0; isurf<ctx.surf_points[ipart].size(); ++isurf){
-          auto bfunc = fem::P1_integration(get_position(ctx.surf_points[ipart][isurf]), ctx.problem.ctx->h);
-          auto ielem = fem::get_element(get_index(ctx.surf_points[ipart][isurf]));
-          for (std::size_t j=0; j<bfunc.size(); ++j){
-            auto u = sol.at(ielem[j]);
-            for (std::size_t d=0; d<Dimensions; ++d)
-              u[d] += g[ipart][isurf][d]*bfunc[j]*gammak;
-          }
-        }
+        gammak[ipart] = ctx.particles[ipart].surface_area()/ctx.nb_surf_points[ipart];
       }
 
       // if (ctx.compute_singularity)
@@ -263,7 +271,9 @@ namespace cafes
       //   ierr = singularity::add_singularity_to_surf<Dimensions, Ctx>(ctx, sol);CHKERRQ(ierr);
       // }
 
-      ierr = sol.local_to_global(ADD_VALUES);CHKERRQ(ierr);
+      // the velocity of rhs is S^T g and its pressure is 0
+      ierr = ctx.surface.update(ctx.problem.ctx->dm, ctx.surf_points, ctx.problem.ctx->h);CHKERRQ(ierr);
+      ierr = ctx.surface.spread(g, gammak, ctx.problem.rhs);CHKERRQ(ierr);
 
       auto petsc_rhs = petsc::petsc_vec<Dimensions>(ctx.problem.ctx->dm, ctx.problem.rhs, 0);
       ierr = SetNullDirichletOnRHS(petsc_rhs, ctx.problem.ctx->bc_);CHKERRQ(ierr);
@@ -305,37 +315,30 @@ namespace cafes
 
 
     auto const kernel_projection = [](auto const& p, auto& sol, 
-                            auto const& h, auto const& hs, 
-                            auto& box_scale, auto& mean, auto& cross)
+                            auto const& h, auto const& sub,
+                            auto& mean, auto& cross)
     {
-      auto const kernel_pos = [&](auto const& pos){
-        auto const kernel = [&](auto const& pos_scale)
+      // is is a sub-point of the cell pos inside p (see iterate_inside)
+      auto const kernel_pos = [&](auto const& pos, std::size_t is){
+        using mean_type = typename std::remove_reference<decltype(mean)>::type;
+        auto pts = pos*h + sub.points[is];
+        auto& bfunc = sub.values[is];
+        auto ielem = fem::get_element(pos);
+        mean_type tmp{};
+
+        for(std::size_t ib=0; ib<bfunc.size(); ++ib)
         {
-          using mean_type = typename std::remove_reference<decltype(mean)>::type;
-          auto pts = pos*h + pos_scale*hs;
-          if (p.contains(pts))
-          {
-            auto pts_corner = pos_scale*hs;
-            auto bfunc = fem::P1_integration(pts_corner, h);
-            auto ielem = fem::get_element(pos);
-            mean_type tmp{};
-
-            for(std::size_t ib=0; ib<bfunc.size(); ++ib)
-            {
-              auto u = sol.at(ielem[ib]);
-              for (std::size_t d=0; d<pos.dimensions; ++d)
-                tmp[d] += u[d]*bfunc[ib];
-            }
-
-            mean_type r;
-            for (std::size_t d=0; d<pos.dimensions; ++d)
-              r[d] = pts[d] - p.center_[d];
-
-            mean += tmp;
-            cross += geometry::cross_product(r, tmp);
-          }
-        };
-        algorithm::iterate(box_scale, kernel);
+          auto u = sol.at(ielem[ib]);
+          for (std::size_t d=0; d<pos.dimensions; ++d)
+            tmp[d] += u[d]*bfunc[ib];
+        }
+
+        mean_type r;
+        for (std::size_t d=0; d<pos.dimensions; ++d)
+          r[d] = pts[d] - p.center_[d];
+
+        mean += tmp;
+        cross += geometry::cross_product(r, tmp);
       };
       return kernel_pos;
     };
@@ -356,14 +359,7 @@ namespace cafes
       PetscFunctionBeginUser;
 
 
-      std::array<double, Dimensions> hs;
-      for (std::size_t d=0; d<Dimensions; ++d)
-        hs[d] = h[d]/scale;
-
-      geometry::position<std::size_t, Dimensions> p1, p2;
-      p1.fill(0);
-      p2.fill(scale);
-      geometry::box<std::size_t, Dimensions> box_scale{ p1, p2};
+      auto const& sub = fem::get_subquadrature(scale, h);
 
       for(std::size_t ipart=0; ipart<particles.size(); ++ipart){
         auto& p = particles[ipart];
@@ -372,10 +368,13 @@ namespace cafes
         auto pbox = p.bounding_box(h);
         if (geometry::intersect(box, pbox)){
           auto new_box = geometry::box_inside(box, pbox);
-          algorithm::iterate(new_box, kernel_projection(p, sol, h, hs, box_scale, mean[ipart], cross_prod[ipart]));
+          iterate_inside(p, new_box, h, sub, kernel_projection(p, sol, h, sub, mean[ipart], cross_prod[ipart]));
+        }
+        // no sub-point inside the particle on any process
+        if (num[ipart] > 0){
+          mean[ipart] /= num[ipart];
+          cross_prod[ipart] /= num[ipart];
         }
-        mean[ipart] /= num[ipart];
-        cross_prod[ipart] /= num[ipart];
       }
       PetscFunctionReturn(0);
     }
@@ -417,30 +416,28 @@ namespace cafes
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
-      auto box = fem::get_DM_bounds<Dimensions>(ctx.problem.ctx->dm, 0);
       auto& h = ctx.problem.ctx->h;
       auto sol = petsc::petsc_vec<Dimensions>(ctx.problem.ctx->dm, ctx.problem.sol, 0);
 
+      auto& index = ctx.index;
+      ierr = index.check(ctx.particles, y);CHKERRQ(ierr);
+
       int num = 0;
       PetscScalar *py;
       ierr = VecGetArray(y, &py);CHKERRQ(ierr);
 
       for(std::size_t ipart=0; ipart<ctx.particles.size(); ++ipart){
         auto& p = ctx.particles[ipart];
-        auto pbox = p.bounding_box(h);
-        if (geometry::intersect(box, pbox)){
-          auto new_box = geometry::box_inside(box, pbox);
-          auto pts = find_fluid_points_insides(p, new_box, h);
-          for(auto& ind: pts)
-          {
-            geometry::vector<double, Dimensions> r;
-            for (std::size_t d=0; d<Dimensions; ++d)
-              r[d] = ind[d]*h[d] - p.center_[d];
-            auto tmp = mean[ipart] + p.Ci_R()*geometry::cross_product(cross_prod[ipart], r);
-            auto usol = sol.at(ind);
-            for (std::size_t d=0; d<Dimensions; ++d)
-              py[num++] = usol[d] - tmp[d];
-          }
+        for(std::size_t i=index.start[ipart]; i<index.start[ipart + 1]; ++i)
+        {
+          auto& ind = index.points[i];
+          geometry::vector<double, Dimensions> r;
+          for (std::size_t d=0; d<Dimensions; ++d)
+            r[d] = ind[d]*h[d] - p.center_[d];
+          auto tmp = mean[ipart] + p.Ci_R()*geometry::cross_product(cross_prod[ipart], r);
+          auto usol = sol.at_node(index.local_nodes[i]);
+          for (std::size_t d=0; d<Dimensions; ++d)
+            py[num++] = usol[d] - tmp[d];
         }
       }
 
@@ -456,29 +453,20 @@ namespace cafes
       PetscErrorCode ierr;
       PetscFunctionBeginUser;
 
-
-      auto box = fem::get_DM_bounds<Dimensions>(ctx.problem.ctx->dm, 0);
-      auto& h = ctx.problem.ctx->h;
-
       auto sol = petsc::petsc_vec<Dimensions>(ctx.problem.ctx->dm, ctx.problem.sol, 0);
 
+      auto& index = ctx.index;
+      ierr = index.check(ctx.particles, y);CHKERRQ(ierr);
+
       int num = 0;
       PetscScalar *py;
       ierr = VecGetArray(y, &py);CHKERRQ(ierr);
 
-      for(std::size_t ipart=0; ipart<ctx.particles.size(); ++ipart){
-        auto& p = ctx.particles[ipart];
-        auto pbox = p.bounding_box(h);
-        if (geometry::intersect(box, pbox)){
-          auto new_box = geometry::box_inside(box, pbox);
-          auto pts = find_fluid_points_insides(p, new_box, h);
-          for(auto& ind: pts)
-          {
-            auto usol = sol.at(ind);
-            for (std::size_t d=0; d<Dimensions; ++d)
-              py[num++] = usol[d];
-          }
-        }
+      for(std::size_t i=0; i<index.points.size(); ++i)
+      {
+        auto usol = sol.at_node(index.local_nodes[i]);
+        for (std::size_t d=0; d<Dimensions; ++d)
+          py[num++] = usol[d];
       }
 
       ierr = VecRestoreArray(y, &py);CHKERRQ(ierr);
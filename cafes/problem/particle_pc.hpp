@@ -0,0 +1,432 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+#ifndef PARTICLE_PROBLEM_PARTICLE_PC_HPP_INCLUDED
+#define PARTICLE_PROBLEM_PARTICLE_PC_HPP_INCLUDED
+
+#include <problem/dense.hpp>
+#include <problem/rigid_motion.hpp>
+#include <fem/mesh.hpp>
+#include <particle/particle.hpp>
+#include <particle/geometry/box.hpp>
+
+#include <petsc.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //! Diagonal blocks of the particle classes probed by the particle
+    //! preconditioner of a solver. The solver owns it: the blocks are kept
+    //! for its next solves and dropped when its particles are set again
+    //! (create_Mat_and_Vec).
+    struct particle_pc_cache
+    {
+      std::map<std::vector<double>, std::vector<double>> blocks;
+
+      void clear()
+      {
+        blocks.clear();
+      }
+    };
+
+    //! The class of the particle p on the grid of step h: two particles
+    //! of the same class see the same nodes around them. It is given by
+    //! the shape factors, the exponents and the orientation of the shape,
+    //! the position of the center in its cell and h.
+    template<typename Shape, std::size_t Dimensions>
+    std::vector<double> particle_pc_key(particle<Shape> const& p, std::array<double, Dimensions> const& h)
+    {
+      std::vector<double> key(p.shape_factors_.begin(), p.shape_factors_.end());
+      auto exponents = p.exponents();
+      key.insert(key.end(), exponents.begin(), exponents.end());
+      for(std::size_t d=0; d<4; ++d)
+        key.push_back(p.q_.components_[d]);
+      for(std::size_t d=0; d<Dimensions; ++d){
+        // rounded to tell apart the centers of a lattice from the
+        // rounding errors of their positions
+        double cell = p.center_[d]/h[d];
+        double offset = std::round((cell - std::floor(cell))*1e8)*1e-8;
+        key.push_back((offset == 1.)? 0.: offset);
+      }
+      key.insert(key.end(), h.begin(), h.end());
+      return key;
+    }
+
+    //!
+    //! Preconditioner of the outer SEM, DtoN and NtoD systems built on the
+    //! rigid motions of the particles. R gives the rigid motions on the
+    //! unknowns of each particle (the identity for NtoD whose unknowns are
+    //! the rigid motions, the velocity on the fluid points inside the
+    //! particle for SEM and DtoN) and
+    //!
+    //!     P^{-1} = (I - R (R^T R)^{-1} R^T) + R G^{-1} R^T
+    //!
+    //! where G approximates R^T A R. Its diagonal blocks are the responses
+    //! of one particle of each class (same shape factors) to its rigid
+    //! motions, probed once with the outer operator and then reused for
+    //! all the particles of the class and the next solves. With the
+    //! near-field correction, the particles closer than a given gap are
+    //! probed in place and the blocks coupling them are added to G.
+    //!
+    template<std::size_t Dimensions>
+    struct particle_preconditioner
+    {
+      static constexpr std::size_t rs = rigid_size<Dimensions>();
+
+      particle_pc_cache *cache;          //!< Blocks of the classes, owned by the solver
+      bool rigid;                        //!< The unknowns are the rigid motions (NtoD)
+      std::vector<int> local;            //!< NtoD: the particle is stored on this process
+      std::vector<int> multiplicity;     //!< NtoD: number of processes storing the particle
+      std::vector<std::vector<std::array<double, Dimensions>>> radial;   //!< SEM, DtoN: points of the particles
+      std::vector<double> gram;          //!< SEM, DtoN: R^T R of each particle
+      std::vector<std::vector<double>> keys;
+      std::vector<std::array<double, Dimensions>> centers;
+      std::vector<double> radius;
+      std::vector<double> coarse;        //!< LU factors of G
+      std::vector<std::size_t> pivots;
+      PetscReal near_field = -1.;
+      PetscBool view = PETSC_FALSE;
+      PetscInt probes = 0;
+      Vec x = nullptr, y = nullptr;
+
+      std::size_t size() const
+      {
+        return keys.size()*rs;
+      }
+
+      //! c = R^T v
+      void restrict_(PetscScalar const* pv, std::vector<double>& c) const
+      {
+        c.assign(size(), 0.);
+        std::size_t num = 0;
+        for(std::size_t ipart=0; ipart<keys.size(); ++ipart){
+          if (rigid){
+            if (local[ipart])
+              for(std::size_t k=0; k<rs; ++k)
+                c[ipart*rs + k] = pv[num++]/multiplicity[ipart];
+          }
+          else
+            for(auto& r: radial[ipart]){
+              add_rigid_motion_transpose(pv + num, r, &c[ipart*rs]);
+              num += Dimensions;
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, c.data(), c.size(), MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+      }
+
+      //! v += R c
+      void prolong_(std::vector<double> const& c, PetscScalar* pv) const
+      {
+        std::size_t num = 0;
+        for(std::size_t ipart=0; ipart<keys.size(); ++ipart){
+          if (rigid){
+            if (local[ipart])
+              for(std::size_t k=0; k<rs; ++k)
+                pv[num++] += c[ipart*rs + k];
+          }
+          else
+            for(auto& r: radial[ipart]){
+              add_rigid_motion(&c[ipart*rs], r, pv + num);
+              num += Dimensions;
+            }
+        }
+      }
+
+      //! A particle without unknown (outside of the domain)
+      bool empty_(std::size_t ipart) const
+      {
+        return (rigid)? multiplicity[ipart] == 0: gram[ipart*rs*rs] == 0.;
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "particle_preconditioner::probe_"
+      //! col = R^T A R e_k for the rigid motion k of the particle ipart
+      PetscErrorCode probe_(Mat A, std::size_t ipart, std::size_t k, std::vector<double>& col)
+      {
+        PetscErrorCode ierr;
+        PetscScalar *px;
+        PetscScalar const *py;
+        PetscFunctionBeginUser;
+
+        std::vector<double> e(size(), 0.);
+        e[ipart*rs + k] = 1.;
+
+        ierr = VecSet(x, 0.);CHKERRQ(ierr);
+        ierr = VecGetArray(x, &px);CHKERRQ(ierr);
+        prolong_(e, px);
+        ierr = VecRestoreArray(x, &px);CHKERRQ(ierr);
+
+        ierr = MatMult(A, x, y);CHKERRQ(ierr);
+        probes++;
+
+        ierr = VecGetArrayRead(y, &py);CHKERRQ(ierr);
+        restrict_(py, col);
+        ierr = VecRestoreArrayRead(y, &py);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "particle_preconditioner::setup"
+      PetscErrorCode setup(Mat A)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        if (!x){
+          ierr = MatCreateVecs(A, &x, &y);CHKERRQ(ierr);
+        }
+
+        std::size_t const nparts = keys.size();
+        std::size_t const n = size();
+
+        std::vector<std::vector<std::size_t>> neighbours(nparts);
+        if (near_field >= 0)
+          for(std::size_t i=0; i<nparts; ++i)
+            for(std::size_t j=i+1; j<nparts; ++j){
+              double dist = 0.;
+              for(std::size_t d=0; d<Dimensions; ++d)
+                dist += (centers[i][d] - centers[j][d])*(centers[i][d] - centers[j][d]);
+              if (std::sqrt(dist) - radius[i] - radius[j] < near_field){
+                neighbours[i].push_back(j);
+                neighbours[j].push_back(i);
+              }
+            }
+
+        auto& blocks = cache->blocks;
+        PetscInt const probes0 = probes;
+        std::vector<double> col;
+        coarse.assign(n*n, 0.);
+
+        for(std::size_t j=0; j<nparts; ++j){
+          if (empty_(j)){
+            for(std::size_t k=0; k<rs; ++k)
+              coarse[(j*rs + k)*n + j*rs + k] = 1.;
+            continue;
+          }
+
+          auto it = blocks.find(keys[j]);
+
+          if (it != blocks.end() && neighbours[j].empty()){
+            for(std::size_t l=0; l<rs; ++l)
+              for(std::size_t k=0; k<rs; ++k)
+                coarse[(j*rs + l)*n + j*rs + k] = it->second[l*rs + k];
+            continue;
+          }
+
+          std::vector<double> block(rs*rs);
+          for(std::size_t k=0; k<rs; ++k){
+            ierr = probe_(A, j, k, col);CHKERRQ(ierr);
+            for(std::size_t l=0; l<rs; ++l){
+              coarse[(j*rs + l)*n + j*rs + k] = col[j*rs + l];
+              block[l*rs + k] = col[j*rs + l];
+            }
+            for(auto i: neighbours[j])
+              if (!empty_(i))
+                for(std::size_t l=0; l<rs; ++l)
+                  coarse[(i*rs + l)*n + j*rs + k] = col[i*rs + l];
+          }
+          if (it == blocks.end() && neighbours[j].empty())
+            blocks[keys[j]] = block;
+        }
+
+        if (!detail::lu_factor(coarse, n, pivots))
+          SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_MAT_LU_ZRPVT, "singular rigid motion block of the particle preconditioner");
+
+        if (view){
+          ierr = PetscPrintf(PETSC_COMM_WORLD, "particle preconditioner: %D particles, %D operator applications, %D cached classes\n",
+                             (PetscInt)nparts, probes - probes0, (PetscInt)blocks.size());CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "particle_pc_setup"
+    template<std::size_t Dimensions>
+    PetscErrorCode particle_pc_setup(PC pc)
+    {
+      PetscErrorCode ierr;
+      particle_preconditioner<Dimensions> *s;
+      Mat A;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+      ierr = PCGetOperators(pc, &A, nullptr);CHKERRQ(ierr);
+      ierr = s->setup(A);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "particle_pc_apply"
+    template<std::size_t Dimensions>
+    PetscErrorCode particle_pc_apply(PC pc, Vec r, Vec z)
+    {
+      PetscErrorCode ierr;
+      particle_preconditioner<Dimensions> *s;
+      PetscScalar const *pr;
+      PetscScalar *pz;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+      auto const rs = s->rs;
+
+      // the unknowns of NtoD are only rigid motions: no complement
+      if (s->rigid){
+        ierr = VecSet(z, 0.);CHKERRQ(ierr);
+      }
+      else{
+        ierr = VecCopy(r, z);CHKERRQ(ierr);
+      }
+
+      ierr = VecGetArrayRead(r, &pr);CHKERRQ(ierr);
+      ierr = VecGetArray(z, &pz);CHKERRQ(ierr);
+
+      std::vector<double> c;
+      s->restrict_(pr, c);
+
+      if (!s->rigid){
+        std::vector<double> proj(c.size(), 0.);
+        for(std::size_t ipart=0; ipart<s->keys.size(); ++ipart){
+          if (s->empty_(ipart))
+            continue;
+          std::vector<double> y(c.begin() + ipart*rs, c.begin() + (ipart + 1)*rs);
+          detail::cholesky_solve({s->gram.begin() + ipart*rs*rs, s->gram.begin() + (ipart + 1)*rs*rs}, rs, y);
+          for(std::size_t k=0; k<rs; ++k)
+            proj[ipart*rs + k] = -y[k];
+        }
+        s->prolong_(proj, pz);
+      }
+
+      detail::lu_solve(s->coarse, c.size(), s->pivots, c);
+      s->prolong_(c, pz);
+
+      ierr = VecRestoreArray(z, &pz);CHKERRQ(ierr);
+      ierr = VecRestoreArrayRead(r, &pr);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "particle_pc_destroy"
+    template<std::size_t Dimensions>
+    PetscErrorCode particle_pc_destroy(PC pc)
+    {
+      PetscErrorCode ierr;
+      particle_preconditioner<Dimensions> *s;
+      PetscFunctionBeginUser;
+
+      ierr = PCShellGetContext(pc, (void**)&s);CHKERRQ(ierr);
+      ierr = VecDestroy(&s->x);CHKERRQ(ierr);
+      ierr = VecDestroy(&s->y);CHKERRQ(ierr);
+      delete s;
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_particle_preconditioner"
+    //! Sets the particle preconditioner on the outer solver ksp when the
+    //! option -<prefix>particle_pc is given (the near-field correction
+    //! with -<prefix>particle_pc_near_field <gap>). rigid is true if the
+    //! unknowns are the rigid motions of the particles (NtoD) and false
+    //! if they are the velocities on the fluid points inside the particles
+    //! of the local box of dm (SEM, DtoN). The probed blocks are kept in
+    //! the cache of the solver.
+    template<typename Shape, std::size_t Dimensions>
+    PetscErrorCode set_particle_preconditioner(KSP ksp, std::vector<particle<Shape>> const& parts,
+                                               DM dm, std::array<double, Dimensions> const& h, bool rigid,
+                                               particle_pc_cache *cache)
+    {
+      PetscErrorCode ierr;
+      const char *prefix;
+      PetscBool use = PETSC_FALSE;
+      PC pc;
+      PetscFunctionBeginUser;
+
+      auto *s = new particle_preconditioner<Dimensions>;
+
+      ierr = KSPGetOptionsPrefix(ksp, &prefix);CHKERRQ(ierr);
+      ierr = PetscOptionsBegin(PETSC_COMM_WORLD, prefix, "Particle preconditioner", "");CHKERRQ(ierr);
+      ierr = PetscOptionsBool("-particle_pc", "Precondition with the responses of the particles to their rigid motions", "particle_pc.hpp", use, &use, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsReal("-particle_pc_near_field", "Gap below which two particles are coupled in the preconditioner", "particle_pc.hpp", s->near_field, &s->near_field, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsBool("-particle_pc_view", "Print the number of operator applications of each setup", "particle_pc.hpp", s->view, &s->view, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsEnd();CHKERRQ(ierr);
+
+      if (!use){
+        delete s;
+        PetscFunctionReturn(0);
+      }
+
+      s->cache = cache;
+      s->rigid = rigid;
+
+      auto box = fem::get_DM_bounds<Dimensions>(dm, 0);
+      for(auto& p: parts){
+        s->keys.push_back(particle_pc_key(p, h));
+
+        std::array<double, Dimensions> center;
+        for(std::size_t d=0; d<Dimensions; ++d)
+          center[d] = p.center_[d];
+        s->centers.push_back(center);
+        s->radius.push_back(*std::max_element(p.shape_factors_.begin(), p.shape_factors_.end()));
+
+        s->local.push_back(geometry::intersect(box, p.bounding_box(h)));
+      }
+
+      if (rigid){
+        s->multiplicity = s->local;
+        MPI_Allreduce(MPI_IN_PLACE, s->multiplicity.data(), s->multiplicity.size(), MPI_INT, MPI_SUM, PETSC_COMM_WORLD);
+      }
+      else{
+        std::vector<std::vector<geometry::position<int, Dimensions>>> points;
+        find_rigid_points(parts, box, h, points, s->radial);
+        s->gram = rigid_gram(s->radial);
+      }
+
+      ierr = KSPGetPC(ksp, &pc);CHKERRQ(ierr);
+      ierr = PCSetType(pc, PCSHELL);CHKERRQ(ierr);
+      ierr = PCShellSetContext(pc, s);CHKERRQ(ierr);
+      ierr = PCShellSetSetUp(pc, particle_pc_setup<Dimensions>);CHKERRQ(ierr);
+      ierr = PCShellSetApply(pc, particle_pc_apply<Dimensions>);CHKERRQ(ierr);
+      ierr = PCShellSetDestroy(pc, particle_pc_destroy<Dimensions>);CHKERRQ(ierr);
+      ierr = PCShellSetName(pc, "particle rigid motions");CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+  }
+}
+#endif
@@ -0,0 +1,439 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+#ifndef PARTICLE_PROBLEM_RECYCLING_HPP_INCLUDED
+#define PARTICLE_PROBLEM_RECYCLING_HPP_INCLUDED
+
+#include <problem/dense.hpp>
+#include <problem/initial_guess.hpp>
+#include <problem/rigid_motion.hpp>
+#include <fem/mesh.hpp>
+#include <particle/grid_index.hpp>
+#include <particle/particle.hpp>
+#include <particle/geometry/box.hpp>
+
+#include <petsc.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <vector>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //!
+    //! Outer solver of the SEM, DtoN and NtoD problems recycling a
+    //! subspace from one solve to the next one (particles that moved a
+    //! little between two time steps). It is a right preconditioned GCR
+    //! augmented by the recycled directions U as in GCRO-DR: at the
+    //! beginning of a solve C = A U is computed with the new operator and
+    //! orthonormalized, the residual is projected out of span(C) and the
+    //! new directions are kept orthogonal to it. At the end, the recycled
+    //! space is the k directions u of the search space with the smallest
+    //! |A u|/|u| (largest right singular vectors of the search directions
+    //! whose images by A are orthonormal), which are the slow modes that
+    //! Krylov needs to find again at each step.
+    //!
+    //! The vectors are stored with the layout of the unknowns: one group
+    //! of Dimensions values per fluid point inside a particle (SEM, DtoN,
+    //! given by the grid index of the particle operators) or one group of
+    //! rigid motions per particle (NtoD). When the layout changes because
+    //! the particles moved, U is remapped on each process: the values of
+    //! each point are moved with the particle (offset from the center
+    //! rounded on the grid) and the new points, or the points whose old
+    //! values were on another process, are set to 0. U stays a set of
+    //! search directions, the solve does not depend on these values.
+    //!
+    template<std::size_t Dimensions>
+    struct krylov_recycling
+    {
+      using key_type = std::array<int, Dimensions + 1>;
+
+      PetscInt size = 5;           //!< Number of recycled directions
+      PetscInt restart = 30;       //!< Number of new directions before a restart
+      PetscBool view = PETSC_FALSE;
+      bool rigid = false;          //!< The unknowns are the rigid motions (NtoD)
+
+      std::vector<Vec> U;          //!< The recycled directions
+      std::vector<key_type> keys_; //!< Layout of U: (particle, offset of the point)
+      PetscInt last_its = 0;
+      //! Why the last solve stopped, as the KSPConvergedReason of KSPSolve
+      KSPConvergedReason last_reason = KSP_CONVERGED_ITERATING;
+
+      std::size_t group_() const
+      {
+        return (rigid)? rigid_size<Dimensions>(): Dimensions;
+      }
+
+      //! The layout of the unknowns for the particles parts: the fluid
+      //! points of index or the particles of the local box of dm.
+      template<typename Shape>
+      std::vector<key_type> layout_(std::vector<particle<Shape>> const& parts, particle_grid_index<Dimensions> const& index,
+                                    DM dm, std::array<double, Dimensions> const& h) const
+      {
+        std::vector<key_type> keys;
+
+        if (rigid){
+          auto box = fem::get_DM_bounds<Dimensions>(dm, 0);
+          for(std::size_t ipart=0; ipart<parts.size(); ++ipart)
+            if (geometry::intersect(box, parts[ipart].bounding_box(h))){
+              key_type key{};
+              key[0] = ipart;
+              keys.push_back(key);
+            }
+          return keys;
+        }
+
+        keys.reserve(index.points.size());
+        for(std::size_t ipart=0; ipart<parts.size(); ++ipart)
+          for(std::size_t i=index.start[ipart]; i<index.start[ipart + 1]; ++i){
+            key_type key;
+            key[0] = ipart;
+            for(std::size_t d=0; d<Dimensions; ++d)
+              key[d + 1] = index.points[i][d] - static_cast<int>(std::round(parts[ipart].center_[d]/h[d]));
+            keys.push_back(key);
+          }
+        return keys;
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "krylov_recycling::remap_"
+      //! Moves U from the layout keys_ to the layout keys of the vector x
+      //! with the values of this process.
+      PetscErrorCode remap_(std::vector<key_type> const& keys, Vec x)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        auto const g = group_();
+
+        std::map<key_type, std::size_t> where;
+        for(std::size_t j=0; j<keys_.size(); ++j)
+          where.emplace(keys_[j], j);
+
+        // old position of each new entry
+        std::vector<std::ptrdiff_t> from(keys.size(), -1);
+        for(std::size_t j=0; j<keys.size(); ++j){
+          auto it = where.find(keys[j]);
+          if (it != where.end())
+            from[j] = it->second;
+        }
+
+        for(auto& u: U){
+          Vec v;
+          PetscScalar const *pu;
+          PetscScalar *pv;
+          ierr = VecDuplicate(x, &v);CHKERRQ(ierr);
+          ierr = VecGetArrayRead(u, &pu);CHKERRQ(ierr);
+          ierr = VecGetArray(v, &pv);CHKERRQ(ierr);
+          for(std::size_t j=0; j<keys.size(); ++j)
+            for(std::size_t l=0; l<g; ++l)
+              pv[j*g + l] = (from[j] < 0)? 0.: pu[from[j]*g + l];
+          ierr = VecRestoreArray(v, &pv);CHKERRQ(ierr);
+          ierr = VecRestoreArrayRead(u, &pu);CHKERRQ(ierr);
+          ierr = VecDestroy(&u);CHKERRQ(ierr);
+          u = v;
+        }
+        keys_ = keys;
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "krylov_recycling::select_"
+      //! Keeps in U the size directions of span(P) with the smallest
+      //! |A u|/|u| where the columns of A P are orthonormal.
+      PetscErrorCode select_(std::vector<Vec> const& P)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        std::size_t const m = P.size();
+        std::vector<double> gram(m*m), lambda, v;
+        for(std::size_t i=0; i<m; ++i){
+          ierr = VecMDot(P[i], i + 1, P.data(), &gram[i*m]);CHKERRQ(ierr);
+          for(std::size_t j=0; j<=i; ++j)
+            gram[j*m + i] = gram[i*m + j];
+        }
+        detail::symmetric_eigen(gram, m, lambda, v);
+
+        std::vector<std::size_t> order(m);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](auto a, auto b){return lambda[a] > lambda[b];});
+
+        std::vector<Vec> newU;
+        for(std::size_t i=0; i<std::min<std::size_t>(size, m); ++i){
+          Vec u;
+          std::vector<PetscScalar> y(m);
+          for(std::size_t k=0; k<m; ++k)
+            y[k] = v[k*m + order[i]];
+          ierr = VecDuplicate(P[0], &u);CHKERRQ(ierr);
+          ierr = VecSet(u, 0.);CHKERRQ(ierr);
+          ierr = VecMAXPY(u, m, y.data(), P.data());CHKERRQ(ierr);
+          newU.push_back(u);
+        }
+
+        for(auto& u: U){
+          ierr = VecDestroy(&u);CHKERRQ(ierr);
+        }
+        U = newU;
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "krylov_recycling::solve"
+      //! Solves A x = b with the operators, the preconditioner and the
+      //! tolerances of ksp. parts, index, dm and h give the current layout
+      //! of the unknowns (see layout_). The reason of the stop is set in last_reason: a
+      //! breakdown or the maximum number of iterations is an error if ksp
+      //! is set to error when it does not converge, as with KSPSolve.
+      template<typename Shape>
+      PetscErrorCode solve(KSP ksp, Vec b, Vec x, std::vector<particle<Shape>> const& parts,
+                           particle_grid_index<Dimensions> const& index,
+                           DM dm, std::array<double, Dimensions> const& h)
+      {
+        PetscErrorCode ierr;
+        Mat A;
+        PC pc;
+        PetscReal rtol, atol, rnorm, bnorm;
+        PetscInt maxits;
+        PetscBool nonzero, error_if_not_converged;
+        Vec r, z, w;
+        PetscFunctionBeginUser;
+
+        ierr = KSPSetUp(ksp);CHKERRQ(ierr);
+        ierr = KSPGetOperators(ksp, &A, nullptr);CHKERRQ(ierr);
+        ierr = KSPGetPC(ksp, &pc);CHKERRQ(ierr);
+        ierr = KSPGetTolerances(ksp, &rtol, &atol, nullptr, &maxits);CHKERRQ(ierr);
+        ierr = KSPGetInitialGuessNonzero(ksp, &nonzero);CHKERRQ(ierr);
+        ierr = KSPGetErrorIfNotConverged(ksp, &error_if_not_converged);CHKERRQ(ierr);
+
+        // the new vectors are collective: the remap is done when one
+        // layout has changed
+        auto keys = layout_(parts, index, dm, h);
+        int changed = (keys != keys_)? 1: 0;
+        MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_MAX, PETSC_COMM_WORLD);
+        if (!U.empty() && changed){
+          ierr = remap_(keys, x);CHKERRQ(ierr);
+        }
+        keys_ = keys;
+
+        ierr = VecDuplicate(x, &r);CHKERRQ(ierr);
+        if (nonzero){
+          ierr = MatMult(A, x, r);CHKERRQ(ierr);
+          ierr = VecAYPX(r, -1., b);CHKERRQ(ierr);
+        }
+        else{
+          ierr = VecSet(x, 0.);CHKERRQ(ierr);
+          ierr = VecCopy(b, r);CHKERRQ(ierr);
+        }
+        ierr = VecNorm(b, NORM_2, &bnorm);CHKERRQ(ierr);
+        PetscReal const tol = std::max(rtol*bnorm, atol);
+
+        // search directions P with A P = Q orthonormal, the recycled ones first
+        std::vector<Vec> P, Q;
+        for(auto& u: U){
+          ierr = VecDuplicate(x, &w);CHKERRQ(ierr);
+          ierr = MatMult(A, u, w);CHKERRQ(ierr);
+          P.push_back(u);
+          Q.push_back(w);
+          ierr = orthonormalize_(P, Q);CHKERRQ(ierr);
+        }
+        U.clear();
+        PetscInt nrecycled = P.size();
+
+        auto project = [&](Vec q, Vec p) -> PetscErrorCode
+        {
+          PetscErrorCode ierr;
+          PetscScalar alpha;
+          ierr = VecDot(r, q, &alpha);CHKERRQ(ierr);
+          ierr = VecAXPY(x, alpha, p);CHKERRQ(ierr);
+          ierr = VecAXPY(r, -alpha, q);CHKERRQ(ierr);
+          return 0;
+        };
+
+        for(std::size_t i=0; i<P.size(); ++i){
+          ierr = project(Q[i], P[i]);CHKERRQ(ierr);
+        }
+        ierr = VecNorm(r, NORM_2, &rnorm);CHKERRQ(ierr);
+
+        // the monitors of ksp (the inexact control among them) follow the iterations
+        PetscInt its = 0, nnew = 0;
+        bool breakdown = false;
+        ierr = KSPMonitor(ksp, its, rnorm);CHKERRQ(ierr);
+        while (rnorm > tol && its < maxits){
+          ierr = VecDuplicate(x, &z);CHKERRQ(ierr);
+          ierr = VecDuplicate(x, &w);CHKERRQ(ierr);
+          ierr = PCApply(pc, r, z);CHKERRQ(ierr);
+          ierr = MatMult(A, z, w);CHKERRQ(ierr);
+          P.push_back(z);
+          Q.push_back(w);
+          ierr = orthonormalize_(P, Q);CHKERRQ(ierr);
+          // breakdown: the new direction is in the search space
+          if (static_cast<PetscInt>(P.size()) == nrecycled + nnew){
+            breakdown = true;
+            break;
+          }
+          ierr = project(Q.back(), P.back());CHKERRQ(ierr);
+          ierr = VecNorm(r, NORM_2, &rnorm);CHKERRQ(ierr);
+          its++;
+          nnew++;
+          ierr = KSPMonitor(ksp, its, rnorm);CHKERRQ(ierr);
+
+          // restart: the search space is replaced by the recycled directions
+          if (nnew >= restart && rnorm > tol){
+            ierr = select_(P);CHKERRQ(ierr);
+            for(std::size_t i=0; i<P.size(); ++i){
+              ierr = VecDestroy(&P[i]);CHKERRQ(ierr);
+              ierr = VecDestroy(&Q[i]);CHKERRQ(ierr);
+            }
+            P.clear();
+            Q.clear();
+            for(auto& u: U){
+              ierr = VecDuplicate(x, &w);CHKERRQ(ierr);
+              ierr = MatMult(A, u, w);CHKERRQ(ierr);
+              P.push_back(u);
+              Q.push_back(w);
+              ierr = orthonormalize_(P, Q);CHKERRQ(ierr);
+            }
+            U.clear();
+            nrecycled = P.size();
+            nnew = 0;
+          }
+        }
+
+        if (!P.empty()){
+          ierr = select_(P);CHKERRQ(ierr);
+        }
+        for(std::size_t i=0; i<P.size(); ++i){
+          ierr = VecDestroy(&P[i]);CHKERRQ(ierr);
+          ierr = VecDestroy(&Q[i]);CHKERRQ(ierr);
+        }
+        ierr = VecDestroy(&r);CHKERRQ(ierr);
+
+        last_its = its;
+        if (rnorm <= tol)
+          last_reason = (rnorm <= rtol*bnorm)? KSP_CONVERGED_RTOL: KSP_CONVERGED_ATOL;
+        else if (breakdown){
+          last_reason = KSP_DIVERGED_BREAKDOWN;
+          ierr = PetscInfo2(ksp, "Recycled solve: breakdown at iteration %D, residual norm %g\n", its, (double)rnorm);CHKERRQ(ierr);
+        }
+        else{
+          last_reason = KSP_DIVERGED_ITS;
+          ierr = PetscInfo2(ksp, "Recycled solve: maximum number of iterations %D reached, residual norm %g\n", maxits, (double)rnorm);CHKERRQ(ierr);
+        }
+        if (error_if_not_converged && last_reason < 0)
+          SETERRQ1(PETSC_COMM_WORLD, PETSC_ERR_NOT_CONVERGED, "recycled solve has not converged: %s",
+                   (breakdown)? "breakdown": "maximum number of iterations");
+
+        if (view){
+          ierr = PetscPrintf(PETSC_COMM_WORLD, "recycled solve: %D iterations, residual norm %g, %D recycled directions\n",
+                             its, (double)rnorm, (PetscInt)U.size());CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "krylov_recycling::orthonormalize_"
+      //! Orthonormalizes the last vector of Q against the others (twice,
+      //! modified Gram-Schmidt) with the same operations on P so that
+      //! A P = Q still holds. The pair is removed if it is dependent.
+      PetscErrorCode orthonormalize_(std::vector<Vec>& P, std::vector<Vec>& Q)
+      {
+        PetscErrorCode ierr;
+        PetscReal norm0, norm;
+        PetscFunctionBeginUser;
+
+        Vec p = P.back(), q = Q.back();
+        ierr = VecNorm(q, NORM_2, &norm0);CHKERRQ(ierr);
+        for(int pass=0; pass<2; ++pass)
+          for(std::size_t j=0; j+1<Q.size(); ++j){
+            PetscScalar beta;
+            ierr = VecDot(q, Q[j], &beta);CHKERRQ(ierr);
+            ierr = VecAXPY(q, -beta, Q[j]);CHKERRQ(ierr);
+            ierr = VecAXPY(p, -beta, P[j]);CHKERRQ(ierr);
+          }
+        ierr = VecNorm(q, NORM_2, &norm);CHKERRQ(ierr);
+
+        if (norm <= 1e-12*norm0 || norm == 0.){
+          ierr = VecDestroy(&P.back());CHKERRQ(ierr);
+          ierr = VecDestroy(&Q.back());CHKERRQ(ierr);
+          P.pop_back();
+          Q.pop_back();
+          PetscFunctionReturn(0);
+        }
+        ierr = VecScale(q, 1./norm);CHKERRQ(ierr);
+        ierr = VecScale(p, 1./norm);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "set_krylov_recycling"
+    //! Creates the recycling solver of the outer solver ksp when the
+    //! option -<prefix>recycle is set (-<prefix>recycle_size,
+    //! -<prefix>recycle_restart and -<prefix>recycle_view). An existing
+    //! solver is kept with its recycled space.
+    template<std::size_t Dimensions>
+    PetscErrorCode set_krylov_recycling(KSP ksp, bool rigid, krylov_recycling<Dimensions> **recycling)
+    {
+      PetscErrorCode ierr;
+      const char *prefix;
+      PetscBool recycle = (*recycling)? PETSC_TRUE: PETSC_FALSE;
+      PetscFunctionBeginUser;
+
+      auto *r = (*recycling)? *recycling: new krylov_recycling<Dimensions>;
+
+      ierr = KSPGetOptionsPrefix(ksp, &prefix);CHKERRQ(ierr);
+      ierr = PetscOptionsBegin(PETSC_COMM_WORLD, prefix, "Krylov recycling", "");CHKERRQ(ierr);
+      ierr = PetscOptionsBool("-recycle", "Recycle a subspace of the outer solver from one solve to the next one", "recycling.hpp", recycle, &recycle, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsInt("-recycle_size", "The number of recycled directions", "recycling.hpp", r->size, &r->size, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsInt("-recycle_restart", "The number of new directions before a restart", "recycling.hpp", r->restart, &r->restart, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsBool("-recycle_view", "Print the iterations of each recycled solve", "recycling.hpp", r->view, &r->view, nullptr);CHKERRQ(ierr);
+      ierr = PetscOptionsEnd();CHKERRQ(ierr);
+
+      if (!recycle){
+        if (!*recycling)
+          delete r;
+        PetscFunctionReturn(0);
+      }
+
+      r->rigid = rigid;
+      r->restart = std::max<PetscInt>(r->restart, 1);
+      *recycling = r;
+
+      PetscFunctionReturn(0);
+    }
+  }
+}
+#endif
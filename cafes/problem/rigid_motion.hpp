@@ -0,0 +1,153 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef PARTICLE_PROBLEM_RIGID_MOTION_HPP_INCLUDED
+#define PARTICLE_PROBLEM_RIGID_MOTION_HPP_INCLUDED
+
+#include <particle/particle.hpp>
+#include <particle/geometry/box.hpp>
+#include <particle/geometry/position.hpp>
+#include <particle/geometry/vector.hpp>
+
+#include <petsc.h>
+#include <array>
+#include <vector>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //! Number of the rigid motions (V, w) of a particle
+    template<std::size_t Dimensions>
+    constexpr std::size_t rigid_size()
+    {
+      return (Dimensions == 2)? 3: 6;
+    }
+
+    //! v += V + w x r for the rigid motion c = (V, w) of a particle
+    inline void add_rigid_motion(double const* c, std::array<double, 2> const& r, double* v)
+    {
+      v[0] += c[0] - c[2]*r[1];
+      v[1] += c[1] + c[2]*r[0];
+    }
+
+    inline void add_rigid_motion(double const* c, std::array<double, 3> const& r, double* v)
+    {
+      v[0] += c[0] + c[4]*r[2] - c[5]*r[1];
+      v[1] += c[1] + c[5]*r[0] - c[3]*r[2];
+      v[2] += c[2] + c[3]*r[1] - c[4]*r[0];
+    }
+
+    //! c += (l, r x l): the force and the torque of the value l at r
+    inline void add_rigid_motion_transpose(double const* l, std::array<double, 2> const& r, double* c)
+    {
+      c[0] += l[0];
+      c[1] += l[1];
+      c[2] += r[0]*l[1] - r[1]*l[0];
+    }
+
+    inline void add_rigid_motion_transpose(double const* l, std::array<double, 3> const& r, double* c)
+    {
+      c[0] += l[0];
+      c[1] += l[1];
+      c[2] += l[2];
+      c[3] += r[1]*l[2] - r[2]*l[1];
+      c[4] += r[2]*l[0] - r[0]*l[2];
+      c[5] += r[0]*l[1] - r[1]*l[0];
+    }
+
+    //! Sets the angular velocity of a particle from the rigid motion c + Dimensions
+    inline void set_angular_velocity(double& w, double const* c)
+    {
+      w = c[0];
+    }
+
+    inline void set_angular_velocity(geometry::vector<double, 3>& w, double const* c)
+    {
+      for(std::size_t d=0; d<3; ++d)
+        w[d] = c[d];
+    }
+
+    //! The fluid points of box inside each particle (in the order of
+    //! the unknowns of the SEM and DtoN problems) and their position
+    //! from the center of the particle.
+    template<typename Shape, std::size_t Dimensions>
+    void find_rigid_points(std::vector<particle<Shape>> const& parts,
+                           geometry::box<int, Dimensions> const& box,
+                           std::array<double, Dimensions> const& h,
+                           std::vector<std::vector<geometry::position<int, Dimensions>>>& points,
+                           std::vector<std::vector<std::array<double, Dimensions>>>& radial)
+    {
+      points.assign(parts.size(), {});
+      radial.assign(parts.size(), {});
+
+      for(std::size_t ipart=0; ipart<parts.size(); ++ipart){
+        auto& p = parts[ipart];
+        auto pbox = p.bounding_box(h);
+        if (geometry::intersect(box, pbox)){
+          auto new_box = geometry::box_inside(box, pbox);
+          auto pts = find_fluid_points_insides(p, new_box, h);
+          for(auto& ind: pts){
+            std::array<double, Dimensions> r;
+            for(std::size_t d=0; d<Dimensions; ++d)
+              r[d] = ind[d]*h[d] - p.center_[d];
+            points[ipart].push_back(ind);
+            radial[ipart].push_back(r);
+          }
+        }
+      }
+    }
+
+    //! R^T R of each particle, R giving the rigid motions on the points
+    //! of radial. The matrices of size rigid_size are stored one after
+    //! the other and summed over the processes.
+    template<std::size_t Dimensions>
+    std::vector<double> rigid_gram(std::vector<std::vector<std::array<double, Dimensions>>> const& radial)
+    {
+      auto const rs = rigid_size<Dimensions>();
+      std::vector<double> gram(radial.size()*rs*rs, 0.);
+
+      // built column by column
+      for(std::size_t ipart=0; ipart<radial.size(); ++ipart)
+        for(auto& r: radial[ipart])
+          for(std::size_t k=0; k<rs; ++k){
+            std::vector<double> e(rs, 0.), col(rs, 0.);
+            std::array<double, Dimensions> v{};
+            e[k] = 1.;
+            add_rigid_motion(e.data(), r, v.data());
+            add_rigid_motion_transpose(v.data(), r, col.data());
+            for(std::size_t l=0; l<rs; ++l)
+              gram[(ipart*rs + l)*rs + k] += col[l];
+          }
+      MPI_Allreduce(MPI_IN_PLACE, gram.data(), gram.size(), MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+
+      return gram;
+    }
+  }
+}
+#endif
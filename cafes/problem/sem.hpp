@@ -29,6 +29,9 @@
 #ifndef PARTICLE_PROBLEM_SEM_HPP_INCLUDED
 #define PARTICLE_PROBLEM_SEM_HPP_INCLUDED
 
+#include <problem/inexact.hpp>
+#include <problem/particle_pc.hpp>
+#include <problem/recycling.hpp>
 #include <problem/particle_operator.hpp>
 #include <problem/problem.hpp>
 #include <problem/stokes.hpp>
@@ -104,16 +107,19 @@ namespace cafes
       using position_type_i = geometry::position<int, Dimensions>;
 
       using Ctx = particle_context<Dimensions, Shape, Problem_type>;
-      Ctx *ctx;
+      Ctx *ctx = nullptr;
 
       std::vector<std::vector<std::pair<position_type_i, position_type>>> surf_points_;
       std::vector<std::vector<geometry::vector<double, Dimensions>>> radial_vec_;
       std::vector<int> nb_surf_points_;
       std::vector<int> num_;
-      Vec sol;
-      Vec rhs;
-      Mat A;
+      Vec sol = nullptr;
+      Vec rhs = nullptr;
+      Mat A = nullptr;
       KSP ksp;
+      inexact_control *inexact_ = nullptr; //!< Relaxation of the inner tolerance
+      particle_pc_cache pc_cache_;         //!< Blocks of the particle preconditioner
+      krylov_recycling<Dimensions> *recycling_ = nullptr; //!< Subspace kept between two solves
       std::size_t scale_ = 4;
 
       using dpart_type = typename std::conditional<Dimensions == 2, 
@@ -137,14 +143,26 @@ namespace cafes
         auto box = fem::get_DM_bounds<Dimensions>(problem_.ctx->dm, 0);
         auto& h = problem_.ctx->h;
 
-        auto size = set_materials(parts_, surf_points_, radial_vec_,
-                                  nb_surf_points_, num_, box,
-                                  h, dpart_, scale_);
+        // the particles are set again: the blocks of the particle
+        // preconditioner probed at their previous positions are dropped
+        pc_cache_.clear();
+
+        // the matrix of the previous particles releases its context when
+        // the solvers using it are done with it
+        ierr = MatDestroy(&A);CHKERRQ(ierr);
+        ierr = VecDestroy(&sol);CHKERRQ(ierr);
+        ierr = VecDestroy(&rhs);CHKERRQ(ierr);
 
         ctx = new Ctx{problem_, parts_, surf_points_, radial_vec_, nb_surf_points_, num_, scale_, false, false};
 
+        auto size = set_materials(parts_, surf_points_, radial_vec_,
+                                  nb_surf_points_, num_, box,
+                                  h, dpart_, scale_, ctx->index);
+        ierr = ctx->index.set_layout(problem_.ctx->dm);CHKERRQ(ierr);
+
         ierr = MatCreateShell(PETSC_COMM_WORLD, size*Dimensions, size*Dimensions, PETSC_DECIDE, PETSC_DECIDE, ctx, &A);CHKERRQ(ierr);
         ierr = MatShellSetOperation(A, MATOP_MULT, (void(*)(void))sem_matrix<Dimensions, Ctx>);CHKERRQ(ierr);
+        ierr = MatShellSetOperation(A, MATOP_DESTROY, (void(*)(void))destroy_particle_context<Ctx>);CHKERRQ(ierr);
 
         ierr = MatCreateVecs(A, &sol, &rhs);CHKERRQ(ierr);
 
@@ -182,6 +200,9 @@ namespace cafes
         ierr = KSPGetPC(ksp, &pc);CHKERRQ(ierr);
         ierr = PCSetType(pc, PCNONE);CHKERRQ(ierr);
         ierr = KSPSetFromOptions(ksp);CHKERRQ(ierr);
+        ierr = set_particle_preconditioner(ksp, parts_, problem_.ctx->dm, problem_.ctx->h, false, &pc_cache_);CHKERRQ(ierr);
+        ierr = set_inexact_inner_solves(ksp, problem_.ksp, &inexact_);CHKERRQ(ierr);
+        ierr = set_krylov_recycling(ksp, false, &recycling_);CHKERRQ(ierr);
 
         PetscFunctionReturn(0);
       }
@@ -195,7 +216,15 @@ namespace cafes
 
         ctx->compute_rhs = false;
 
-        ierr = KSPSolve(ksp, rhs, sol);CHKERRQ(ierr);
+        if (recycling_){
+          ierr = recycling_->solve(ksp, rhs, sol, parts_, ctx->index, problem_.ctx->dm, problem_.ctx->h);CHKERRQ(ierr);
+        }
+        else{
+          ierr = KSPSolve(ksp, rhs, sol);CHKERRQ(ierr);
+        }
+        if (inexact_){
+          ierr = inexact_->restore();CHKERRQ(ierr);
+        }
 
         // solve the problem with the right control
         ctx->compute_rhs = true;
@@ -254,7 +283,8 @@ namespace cafes
                                            torques,
                                            num_,
                                            h,
-                                           false);CHKERRQ(ierr);
+                                           false,
+                                           &ctx->index);CHKERRQ(ierr);
 
         PetscFunctionReturn(0);
       }
@@ -32,12 +32,21 @@
 #include <problem/problem.hpp>
 #include <problem/context.hpp>
 #include <problem/options.hpp>
+#include <fem/assembly.hpp>
+#ifdef CAFES_HAVE_FFTW
+#include <fem/fast_diagonalization.hpp>
+#endif
 #include <fem/matrixFree.hpp>
+#include <fem/multigrid.hpp>
 #include <fem/rhs.hpp>
 #include <fem/mesh.hpp>
 #include <petsc.h>
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace cafes
 {
@@ -46,19 +55,21 @@ namespace cafes
 
     #undef __FUNCT__
     #define __FUNCT__ "setPMMSolver"
-    PetscErrorCode setPMMSolver(KSP ksp, DM dm){
+    //! Sets the Schur complement preconditioner with the pressure mass
+    //! matrix: MG on the velocity and, if pressure_mg, MG on the mass
+    //! matrix instead of Jacobi. The number of levels is the depth of the
+    //! geometric hierarchy of the pressure grid (see fem::get_mg_levels).
+    template<std::size_t Dimensions>
+    PetscErrorCode setPMMSolver(KSP ksp, DM dm, PetscBool pressure_mg){
       PetscErrorCode ierr;
-      PetscFunctionBeginUser;
       PC pc, pc_i;
       KSP *sub_ksp;
       PetscInt MGlevels;
       DM dav, dap;
-      DMDALocalInfo  info;
 
       PetscFunctionBeginUser;
 
       ierr = DMCompositeGetEntries(dm, &dav, &dap);CHKERRQ(ierr);
-      ierr = DMDAGetLocalInfo(dav, &info);CHKERRQ(ierr);
 
       ierr = KSPSetType(ksp, KSPGCR);CHKERRQ(ierr);
       ierr = KSPGetPC(ksp, &pc);CHKERRQ(ierr);
@@ -70,54 +81,27 @@ namespace cafes
       ierr = KSPSetUp(ksp);CHKERRQ(ierr);
 
       ierr = PCFieldSplitGetSubKSP(pc, nullptr, &sub_ksp);CHKERRQ(ierr);
+      ierr = fem::get_mg_levels<Dimensions>(dap, MGlevels);CHKERRQ(ierr);
 
       /* Set MG solver on velocity field*/
       ierr = KSPGetPC(sub_ksp[0], &pc_i);CHKERRQ(ierr);
-      // ierr = KSPSetDM(sub_ksp[0], dav);CHKERRQ(ierr);
-      // ierr = KSPSetDMActive(sub_ksp[0], PETSC_FALSE);CHKERRQ(ierr);
-
-      //ierr = KSPSetType(sub_ksp[0], KSPCG);CHKERRQ(ierr);
       ierr = KSPSetType(sub_ksp[0], KSPFGMRES);CHKERRQ(ierr);
       ierr = KSPSetTolerances(sub_ksp[0], 1e-2, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT);CHKERRQ(ierr);
       ierr = PCSetType(pc_i, PCMG);CHKERRQ(ierr);
-
-      auto i = (info.mx<info.my)? info.mx: info.my;
-      i = (info.mz == 1 || i<info.mz)? i: info.mz;
-
-      MGlevels = 1;
-      while(i > 8){
-        i >>= 1;
-        MGlevels++;
-      }
-
       ierr = PCMGSetLevels(pc_i, MGlevels, PETSC_NULL);CHKERRQ(ierr);
 
-      /* Set Jacobi preconditionner on pressure field*/
+      /* Set MG or Jacobi preconditionner on pressure field*/
       ierr = KSPSetType(sub_ksp[1], KSPPREONLY);CHKERRQ(ierr);
       ierr = KSPSetTolerances(sub_ksp[1], 1e-1, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT);CHKERRQ(ierr);
       ierr = KSPGetPC(sub_ksp[1], &pc_i);CHKERRQ(ierr);
-      ierr = PCSetType(pc_i, PCJACOBI);CHKERRQ(ierr);
-
-      // /* Set MG solver on pressure field*/
-      // ierr = KSPGetPC(sub_ksp[1], &pc_i);CHKERRQ(ierr);
-      // ierr = KSPSetDM(sub_ksp[0], dav);CHKERRQ(ierr);
-      // ierr = KSPSetDMActive(sub_ksp[0], PETSC_FALSE);CHKERRQ(ierr);
-
-      // ierr = KSPSetType(sub_ksp[1], KSPFGMRES);CHKERRQ(ierr);
-      // ierr = KSPSetTolerances(sub_ksp[1], 1e-10, 1e-14, PETSC_DEFAULT, PETSC_DEFAULT);CHKERRQ(ierr);
-      // ierr = PCSetType(pc_i, PCMG);CHKERRQ(ierr);
-
-      // ierr = DMDAGetLocalInfo(dap, &info);CHKERRQ(ierr);
-      // i = (info.mx<info.my)? info.mx: info.my;
-      // i = (info.mz == 1 || i<info.mz)? i: info.mz;
-
-      // MGlevels = 1;
-      // while(i > 8){
-      //   i >>= 1;
-      //   MGlevels++;
-      // }
+      if (pressure_mg){
+        ierr = PCSetType(pc_i, PCMG);CHKERRQ(ierr);
+        ierr = PCMGSetLevels(pc_i, MGlevels, PETSC_NULL);CHKERRQ(ierr);
+      }
+      else{
+        ierr = PCSetType(pc_i, PCJACOBI);CHKERRQ(ierr);
+      }
 
-      // ierr = PCMGSetLevels(pc_i, MGlevels, PETSC_NULL);CHKERRQ(ierr);
       PetscFunctionReturn(0);
     }
 
@@ -134,6 +118,7 @@ namespace cafes
 
       ierr = KSPGetDM(ksp, &dm);CHKERRQ(ierr);
       ctx_->dm = dm;
+      ierr = fem::set_operator(*ctx_);CHKERRQ(ierr);
 
       ierr = fem::get_DM_sizes(dm, localsize, totalsize);CHKERRQ(ierr);
 
@@ -148,6 +133,368 @@ namespace cafes
       PetscFunctionReturn(0);
     }
 
+    #undef __FUNCT__
+    #define __FUNCT__ "setup_fieldsplit_solvers"
+    //! If pc is a fieldsplit preconditioner of the Stokes problem of
+    //! stokes_ctx, sets the matrix-free multigrid or the fast
+    //! diagonalization on the velocity block and the multigrid on the
+    //! pressure mass matrix when they are asked for in the options.
+    template<std::size_t Dimensions, typename CTX>
+    PetscErrorCode setup_fieldsplit_solvers(PC pc, CTX const& stokes_ctx, options<Dimensions> const& opt)
+    {
+      PetscErrorCode ierr;
+      PetscFunctionBeginUser;
+
+      PetscBool same;
+      ierr = PetscObjectTypeCompare((PetscObject)pc, PCFIELDSPLIT, &same);CHKERRQ(ierr);
+
+      // If we use fieldsplit for the preconditionner
+      if (same) {
+        KSP *subksp;
+        DM dav, dap;
+        ierr = PCFieldSplitGetSubKSP(pc, nullptr, &subksp);CHKERRQ(ierr);
+        ierr = DMCompositeGetEntries(stokes_ctx.dm, &dav, &dap);CHKERRQ(ierr);
+
+        ierr = KSPGetPC(subksp[0], &pc);CHKERRQ(ierr);
+        ierr = KSPSetType(subksp[0], KSPCG);CHKERRQ(ierr);
+        ierr = KSPSetDM(subksp[0], dav);CHKERRQ(ierr);
+        ierr = KSPSetDMActive(subksp[0], PETSC_FALSE);CHKERRQ(ierr);
+
+        // sine transform on the walled box instead of the multigrid
+        if (opt.fast_diagonalization) {
+#ifdef CAFES_HAVE_FFTW
+          Mat A00;
+          ierr = KSPGetOperators(subksp[0], &A00, nullptr);CHKERRQ(ierr);
+          ierr = fem::set_fast_diagonalization(pc, A00, dav, stokes_ctx.h, stokes_ctx.bc_, opt.strain_tensor);CHKERRQ(ierr);
+#else
+          SETERRQ(PETSC_COMM_WORLD, PETSC_ERR_SUP, "-fast_diagonalization needs cafes built with FFTW");
+#endif
+        }
+
+        ierr = PetscObjectTypeCompare((PetscObject)pc, PCMG, &same);CHKERRQ(ierr);
+
+        // if MG is set for fieldsplit_0 on the matrix-free operators
+        if (same && !opt.assembled) {
+          PetscErrorCode(*method)(petsc::petsc_vec<Dimensions>&,
+                                  petsc::petsc_vec<Dimensions>&,
+                                  std::array<double, Dimensions> const&);
+          
+          // the velocity block of a batch of problems (see stokes_batch)
+          // has a multiple of Dimensions dof
+          bool const batched = fem::get_dof(dav) != Dimensions;
+
+          if (opt.strain_tensor && batched)
+            method = fem::batch_strain_tensor_mult;
+          else if (opt.strain_tensor && opt.sum_factorization)
+            method = fem::strain_tensor_sumfact_mult;
+          else if (opt.strain_tensor)
+            method = fem::strain_tensor_mult;
+          else if (opt.sum_factorization)
+            method = fem::laplacian_sumfact_mult;
+          else if (opt.line_sweep)
+            method = fem::laplacian_line_mult;
+          else
+            method = fem::laplacian_mult;
+
+          PetscInt MGlevels, levels;
+          ierr = PCMGGetLevels(pc, &MGlevels);CHKERRQ(ierr);
+          ierr = fem::get_mg_levels<Dimensions>(dap, levels);CHKERRQ(ierr);
+          MGlevels = (MGlevels > 1)? std::min(MGlevels, levels): levels;
+
+          CTX mg_ctx{dav, stokes_ctx.h, method, fem::diag_laplacian_mult};
+          mg_ctx.set_dirichlet_bc(stokes_ctx.bc_);
+
+          auto bc = stokes_ctx.bc_;
+          auto strain_tensor = opt.strain_tensor;
+          auto assemble_coarse = [bc, strain_tensor](DM dm, std::array<double, Dimensions> const& h, Mat* A)
+          {
+            if (strain_tensor)
+              return fem::assemble_diag_block_matrix(dm, MATAIJ, getMatElemStrainTensor(h), fem::kernel_assembly_tensor_block, &bc, A);
+            return fem::assemble_diag_block_matrix(dm, MATAIJ, getMatElemLaplacian(h), fem::kernel_assembly_diag_block, &bc, A);
+          };
+
+          ierr = fem::set_mg_hierarchy(pc, dav, MGlevels, mg_ctx, assemble_coarse,
+                                       opt.mg_smoother, opt.mg_chebyshev_estimate,
+                                       opt.mg_single_precision);CHKERRQ(ierr);
+
+          ierr = PCSetUp(pc);CHKERRQ(ierr);
+        }
+
+        ierr = KSPGetPC(subksp[1], &pc);CHKERRQ(ierr);
+        ierr = KSPSetDM(subksp[1], dap);CHKERRQ(ierr);
+        ierr = KSPSetDMActive(subksp[1], PETSC_FALSE);CHKERRQ(ierr);
+        ierr = PetscObjectTypeCompare((PetscObject)pc, PCMG, &same);CHKERRQ(ierr);
+
+        // if MG is set for fieldsplit_1 on the pressure mass matrix
+        if (same) {
+          PetscInt MGlevels, levels;
+          ierr = PCMGGetLevels(pc, &MGlevels);CHKERRQ(ierr);
+          ierr = fem::get_mg_levels<Dimensions>(dap, levels);CHKERRQ(ierr);
+          MGlevels = (MGlevels > 1)? std::min(MGlevels, levels): levels;
+
+          auto hp = stokes_ctx.h;
+          std::for_each(hp.begin(), hp.end(), [&](auto& x){x*=2;});
+          CTX mg_ctx{dap, hp, fem::mass_mult, fem::diag_mass_mult};
+
+          auto assemble_coarse = [](DM dm, std::array<double, Dimensions> const& h, Mat* A)
+          {
+            return fem::assemble_diag_block_matrix<Dimensions>(dm, MATAIJ, getMatElemMass(h), fem::kernel_assembly_diag_block, nullptr, A);
+          };
+
+          ierr = fem::set_mg_hierarchy(pc, dap, MGlevels, mg_ctx, assemble_coarse,
+                                       opt.mg_smoother, opt.mg_chebyshev_estimate);CHKERRQ(ierr);
+
+          ierr = PCSetUp(pc);CHKERRQ(ierr);
+        }
+      }
+      PetscFunctionReturn(0);
+    }
+
+    //! Convergence test of a batched solve: the default test on the norm
+    //! of the residual of the whole batch and, once it is satisfied, the
+    //! true residual of each problem against its own tolerances. The
+    //! problems are scaled by scale (see solve_batch) and bnorm are the
+    //! norms of their unscaled right hand sides.
+    template<std::size_t Dimensions>
+    struct batch_convergence{
+      DM dm;
+      PetscInt nbatch;
+      void *default_ctx = nullptr;
+      Vec t = nullptr, v = nullptr;
+      std::vector<PetscReal> bnorm;
+      std::vector<PetscScalar> scale;
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "batch_converged"
+    template<std::size_t Dimensions>
+    PetscErrorCode batch_converged(KSP ksp, PetscInt it, PetscReal rnorm, KSPConvergedReason *reason, void *ctx)
+    {
+      PetscErrorCode ierr;
+      auto *s = static_cast<batch_convergence<Dimensions>*>(ctx);
+      Vec r, sub[2];
+      PetscReal rtol, atol;
+      PetscFunctionBeginUser;
+
+      ierr = KSPConvergedDefault(ksp, it, rnorm, reason, s->default_ctx);CHKERRQ(ierr);
+      if (*reason <= 0)
+        PetscFunctionReturn(0);
+
+      if (!s->t){
+        ierr = DMCreateGlobalVector(s->dm, &s->t);CHKERRQ(ierr);
+        ierr = VecDuplicate(s->t, &s->v);CHKERRQ(ierr);
+      }
+      ierr = KSPBuildResidual(ksp, s->t, s->v, &r);CHKERRQ(ierr);
+
+      // the dof c of the node n of the problem b is (n*nbatch + b)*dof + c
+      std::vector<PetscReal> norm2(s->nbatch, 0.);
+      ierr = DMCompositeGetAccess(s->dm, r, &sub[0], &sub[1]);CHKERRQ(ierr);
+      for(std::size_t i=0; i<2; ++i){
+        PetscInt const dof = (i == 0)? Dimensions: 1;
+        PetscInt size;
+        PetscScalar const *pr;
+        ierr = VecGetLocalSize(sub[i], &size);CHKERRQ(ierr);
+        ierr = VecGetArrayRead(sub[i], &pr);CHKERRQ(ierr);
+        for(PetscInt j=0; j<size; ++j)
+          norm2[(j/dof)%s->nbatch] += pr[j]*pr[j];
+        ierr = VecRestoreArrayRead(sub[i], &pr);CHKERRQ(ierr);
+      }
+      ierr = DMCompositeRestoreAccess(s->dm, r, &sub[0], &sub[1]);CHKERRQ(ierr);
+      ierr = MPI_Allreduce(MPI_IN_PLACE, norm2.data(), s->nbatch, MPIU_REAL, MPI_SUM, PetscObjectComm((PetscObject)ksp));CHKERRQ(ierr);
+
+      ierr = KSPGetTolerances(ksp, &rtol, &atol, nullptr, nullptr);CHKERRQ(ierr);
+      for(PetscInt b=0; b<s->nbatch; ++b)
+        if (std::sqrt(norm2[b])/s->scale[b] > std::max(rtol*s->bnorm[b], atol)){
+          ierr = PetscInfo2(ksp, "Problem %D of the batch not converged at iteration %D\n", b, it);CHKERRQ(ierr);
+          *reason = KSP_CONVERGED_ITERATING;
+          break;
+        }
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "batch_convergence_destroy"
+    template<std::size_t Dimensions>
+    PetscErrorCode batch_convergence_destroy(void *ctx)
+    {
+      PetscErrorCode ierr;
+      auto *s = static_cast<batch_convergence<Dimensions>*>(ctx);
+      PetscFunctionBeginUser;
+
+      ierr = KSPConvergedDefaultDestroy(s->default_ctx);CHKERRQ(ierr);
+      ierr = VecDestroy(&s->t);CHKERRQ(ierr);
+      ierr = VecDestroy(&s->v);CHKERRQ(ierr);
+      delete s;
+
+      PetscFunctionReturn(0);
+    }
+
+    //!
+    //! nbatch Stokes problems with the same operator solved at once: the
+    //! velocities and the pressures of the problems are interleaved on
+    //! DMDAs with nbatch*Dimensions and nbatch dof and the decomposition of
+    //! the Stokes grids, so that the matrix-free products apply each
+    //! elementary matrix to the nbatch vectors in one sweep. One Krylov
+    //! solver with the prefix stokes_batch_ is used on the block diagonal
+    //! system, each problem converging with its own tolerances (see
+    //! batch_converged).
+    //!
+    template<std::size_t Dimensions>
+    struct stokes_batch
+    {
+      using Ctx = context<Dimensions>;
+      PetscInt nbatch;
+      DM dm;
+      Ctx *ctx;
+      Mat A;
+      Mat P;
+      KSP ksp;
+      Vec sol;
+      Vec rhs;
+      batch_convergence<Dimensions> *convergence; //!< destroyed with ksp
+    };
+
+    #undef __FUNCT__
+    #define __FUNCT__ "create_stokes_batch"
+    template<std::size_t Dimensions>
+    PetscErrorCode create_stokes_batch(DM dm, std::array<double, Dimensions> const& h,
+                                       fem::dirichlet_conditions<Dimensions> const& bc,
+                                       options<Dimensions> const& opt, PetscInt nbatch,
+                                       stokes_batch<Dimensions>& batch)
+    {
+      using Ctx = context<Dimensions>;
+      PetscErrorCode ierr;
+      DM dav, dap, davb, dapb;
+      PC pc;
+      PetscFunctionBeginUser;
+
+      batch.nbatch = nbatch;
+      ierr = DMCompositeGetEntries(dm, &dav, &dap);CHKERRQ(ierr);
+      ierr = DMDACreateCompatibleDMDA(dav, nbatch*Dimensions, &davb);CHKERRQ(ierr);
+      ierr = DMDACreateCompatibleDMDA(dap, nbatch, &dapb);CHKERRQ(ierr);
+      ierr = DMSetMatType(davb, MATSHELL);CHKERRQ(ierr);
+      ierr = DMSetMatType(dapb, MATSHELL);CHKERRQ(ierr);
+
+      ierr = DMCompositeCreate(PETSC_COMM_WORLD, &batch.dm);CHKERRQ(ierr);
+      ierr = DMCompositeAddDM(batch.dm, davb);CHKERRQ(ierr);
+      ierr = DMCompositeAddDM(batch.dm, dapb);CHKERRQ(ierr);
+      ierr = DMSetFromOptions(batch.dm);CHKERRQ(ierr);
+
+      ierr = DMCreateGlobalVector(batch.dm, &batch.sol);CHKERRQ(ierr);
+      ierr = VecDuplicate(batch.sol, &batch.rhs);CHKERRQ(ierr);
+
+      PetscErrorCode(*method)(petsc::petsc_vec<Dimensions>&,
+                              petsc::petsc_vec<Dimensions>&,
+                              std::array<double, Dimensions> const&);
+      if (opt.strain_tensor)
+        method = fem::batch_strain_tensor_mult;
+      else if (opt.sum_factorization)
+        method = fem::laplacian_sumfact_mult;
+      else if (opt.line_sweep)
+        method = fem::laplacian_line_mult;
+      else
+        method = fem::laplacian_mult;
+
+      batch.ctx = new Ctx{batch.dm, h, method};
+      batch.ctx->set_dirichlet_bc(bc);
+      if (opt.strain_tensor)
+        batch.ctx->apply_stokes = fem::stokes_batch_strain_tensor_mult;
+      else
+        batch.ctx->apply_stokes = fem::stokes_batch_laplacian_mult;
+      batch.A = fem::make_matrix<Ctx>(batch.ctx, fem::stokes_matrix<Ctx>);
+      ierr = MatSetDM(batch.A, batch.dm);CHKERRQ(ierr);
+      ierr = MatSetFromOptions(batch.A);CHKERRQ(ierr);
+
+      auto hp = h;
+      std::for_each(hp.begin(), hp.end(), [](auto& x){x*=2;});
+
+      Ctx *slap = new Ctx{davb, h, method, fem::diag_laplacian_mult};
+      slap->set_dirichlet_bc(bc);
+      Ctx *smass = new Ctx{dapb, hp, fem::mass_mult, fem::diag_mass_mult};
+      if (opt.line_sweep)
+        smass->apply = fem::mass_line_mult;
+
+      Mat bA[2][2];
+      bA[0][0] = fem::make_matrix<Ctx>(slap); bA[0][1] = PETSC_NULL;
+      bA[1][0] = PETSC_NULL; bA[1][1] = fem::make_matrix<Ctx>(smass);
+      ierr = MatCreateNest(PETSC_COMM_WORLD, 2, PETSC_NULL, 2, PETSC_NULL, &bA[0][0], &batch.P);CHKERRQ(ierr);
+      ierr = MatSetDM(batch.P, batch.dm);CHKERRQ(ierr);
+      ierr = MatSetFromOptions(batch.P);CHKERRQ(ierr);
+
+      ierr = DMDestroy(&davb);CHKERRQ(ierr);
+      ierr = DMDestroy(&dapb);CHKERRQ(ierr);
+
+      ierr = KSPCreate(PETSC_COMM_WORLD, &batch.ksp);CHKERRQ(ierr);
+      ierr = KSPSetDM(batch.ksp, batch.dm);CHKERRQ(ierr);
+      ierr = KSPSetDMActive(batch.ksp, PETSC_FALSE);CHKERRQ(ierr);
+      ierr = KSPSetOptionsPrefix(batch.ksp, "stokes_batch_");CHKERRQ(ierr);
+      ierr = KSPSetOperators(batch.ksp, batch.A, batch.P);CHKERRQ(ierr);
+
+      batch.convergence = new batch_convergence<Dimensions>{batch.dm, nbatch};
+      ierr = KSPConvergedDefaultCreate(&batch.convergence->default_ctx);CHKERRQ(ierr);
+      ierr = KSPSetConvergenceTest(batch.ksp, batch_converged<Dimensions>, batch.convergence,
+                                   batch_convergence_destroy<Dimensions>);CHKERRQ(ierr);
+
+      if (opt.pmm){
+        ierr = setPMMSolver<Dimensions>(batch.ksp, batch.dm, opt.pmm_pressure_mg);CHKERRQ(ierr);
+      }
+
+      ierr = KSPSetFromOptions(batch.ksp);CHKERRQ(ierr);
+      ierr = KSPSetUp(batch.ksp);CHKERRQ(ierr);
+      ierr = KSPGetPC(batch.ksp, &pc);CHKERRQ(ierr);
+      ierr = setup_fieldsplit_solvers(pc, *batch.ctx, opt);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
+    #undef __FUNCT__
+    #define __FUNCT__ "interleave_batch"
+    //! Copies the Stokes vectors v[0], ..., v[nbatch-1] on dm to the batched
+    //! vector w on batch_dm if to_batch is set, and back otherwise. The two
+    //! composite DMs have the same decomposition: the node n of the field i
+    //! of v[b] is the node n of the field i of w with the offset b*dof.
+    //! If scale is given, the problem b of w is scale[b] v[b].
+    template<std::size_t Dimensions>
+    PetscErrorCode interleave_batch(DM dm, DM batch_dm, Vec const* v, Vec w, PetscInt nbatch, bool to_batch,
+                                    PetscScalar const* scale=nullptr)
+    {
+      PetscErrorCode ierr;
+      Vec vsub[2], wsub[2];
+      PetscFunctionBeginUser;
+
+      ierr = DMCompositeGetAccess(batch_dm, w, &wsub[0], &wsub[1]);CHKERRQ(ierr);
+      for(PetscInt b=0; b<nbatch; ++b){
+        PetscScalar const s = (scale)? scale[b]: 1.;
+        ierr = DMCompositeGetAccess(dm, v[b], &vsub[0], &vsub[1]);CHKERRQ(ierr);
+
+        for(std::size_t i=0; i<2; ++i){
+          PetscInt const dof = (i == 0)? Dimensions: 1;
+          PetscInt size;
+          PetscScalar *pv, *pw;
+          ierr = VecGetLocalSize(vsub[i], &size);CHKERRQ(ierr);
+          ierr = VecGetArray(vsub[i], &pv);CHKERRQ(ierr);
+          ierr = VecGetArray(wsub[i], &pw);CHKERRQ(ierr);
+
+          for(PetscInt n=0; n<size/dof; ++n)
+            for(PetscInt c=0; c<dof; ++c){
+              if (to_batch)
+                pw[(n*nbatch + b)*dof + c] = s*pv[n*dof + c];
+              else
+                pv[n*dof + c] = pw[(n*nbatch + b)*dof + c]/s;
+            }
+
+          ierr = VecRestoreArray(vsub[i], &pv);CHKERRQ(ierr);
+          ierr = VecRestoreArray(wsub[i], &pw);CHKERRQ(ierr);
+        }
+
+        ierr = DMCompositeRestoreAccess(dm, v[b], &vsub[0], &vsub[1]);CHKERRQ(ierr);
+      }
+      ierr = DMCompositeRestoreAccess(batch_dm, w, &wsub[0], &wsub[1]);CHKERRQ(ierr);
+
+      PetscFunctionReturn(0);
+    }
+
     //!
     //! Stokes class 
     //! 
@@ -164,10 +511,16 @@ namespace cafes
       Mat A;    //!< The matrix of Stokes problem
       Mat P;    //!< The preconditioner of Stokes problem
       KSP ksp;  //!< The solver of Stokes problem
+      //! History of the solutions for the initial guesses, destroyed with
+      //! the last copy of the problem
+      std::shared_ptr<initial_guess> guess_ = std::make_shared<initial_guess>();
+      std::map<PetscInt, stokes_batch<Dimensions>> batches_; //!< Batched solvers by number of problems
 
       stokes(fem::dirichlet_conditions<Dimensions> bc, fem::rhs_conditions<Dimensions> rhsc={nullptr})
       {
         opt.process_options();
+        guess_->type = opt.guess_type;
+        guess_->size = std::max<PetscInt>(opt.guess_size, 1);
 
         DM mesh;
         fem::createMesh<Dimensions>(mesh, opt.mx, opt.xperiod);
@@ -188,8 +541,14 @@ namespace cafes
                                 petsc::petsc_vec<Dimensions>&,
                                 std::array<double, Dimensions> const&);
 
-        if (opt.strain_tensor)
+        if (opt.strain_tensor && opt.sum_factorization)
+          method = fem::strain_tensor_sumfact_mult;
+        else if (opt.strain_tensor)
           method = fem::strain_tensor_mult;
+        else if (opt.sum_factorization)
+          method = fem::laplacian_sumfact_mult;
+        else if (opt.line_sweep)
+          method = fem::laplacian_line_mult;
         else
           method = fem::laplacian_mult;
 
@@ -197,22 +556,60 @@ namespace cafes
         rhsc_ = rhsc;
         ctx = new Ctx{mesh, hu, method};
         ctx->set_dirichlet_bc(bc);
-        A = fem::make_matrix<Ctx>(ctx, fem::stokes_matrix<Ctx>);
-        MatSetDM(A, mesh);
-        MatSetFromOptions(A);
 
-        // set preconditionner of Stokes matrix
         DM dav, dap;
         DMCompositeGetEntries(mesh, &dav, &dap);
-        DMSetMatType(dav, MATSHELL);
-        DMSetMatType(dap, MATSHELL);
-
-        Ctx *slap = new Ctx{dav, hu, method, fem::diag_laplacian_mult};
-        slap->set_dirichlet_bc(bc);
-        auto A11 = fem::make_matrix<Ctx>(slap);
-
-        Ctx *smass = new Ctx{dap, hp, fem::mass_mult, fem::diag_mass_mult};
-        auto A22 = fem::make_matrix<Ctx>(smass);
+        Mat A11, A22;
+
+        if (opt.assembled){
+          // assembled matrices: A and A11 can be used with algebraic
+          // preconditioners (GAMG, hypre, ILU, ...)
+          if (opt.strain_tensor){
+            fem::assemble_stokes_matrix(mesh, getMatElemStrainTensor(hu), fem::kernel_assembly_tensor_block, hu, &bc, &A);
+            fem::assemble_diag_block_matrix(dav, (opt.assembled_baij)? MATBAIJ: MATAIJ, getMatElemStrainTensor(hu), fem::kernel_assembly_tensor_block, &bc, &A11);
+          }
+          else{
+            fem::assemble_stokes_matrix(mesh, getMatElemLaplacian(hu), fem::kernel_assembly_diag_block, hu, &bc, &A);
+            fem::assemble_diag_block_matrix(dav, (opt.assembled_baij)? MATBAIJ: MATAIJ, getMatElemLaplacian(hu), fem::kernel_assembly_diag_block, &bc, &A11);
+          }
+          fem::assemble_diag_block_matrix<Dimensions>(dap, MATAIJ, getMatElemMass(hp), fem::kernel_assembly_diag_block, nullptr, &A22);
+          MatSetDM(A, mesh);
+          MatSetFromOptions(A);
+        }
+        else{
+          // one sweep over the pressure elements for the whole Stokes operator
+          if (opt.strain_tensor && opt.sum_factorization)
+            ctx->apply_stokes = fem::stokes_strain_tensor_sumfact_mult;
+          else if (opt.strain_tensor)
+            ctx->apply_stokes = fem::stokes_strain_tensor_mult;
+          else if (opt.sum_factorization)
+            ctx->apply_stokes = fem::stokes_laplacian_sumfact_mult;
+          else if (!opt.line_sweep)
+            ctx->apply_stokes = fem::stokes_laplacian_mult;
+          A = fem::make_matrix<Ctx>(ctx, fem::stokes_matrix<Ctx>);
+          MatSetDM(A, mesh);
+          MatSetFromOptions(A);
+
+          // set preconditionner of Stokes matrix
+          DMSetMatType(dav, MATSHELL);
+          DMSetMatType(dap, MATSHELL);
+
+          Ctx *slap = new Ctx{dav, hu, method, fem::diag_laplacian_mult};
+          slap->set_dirichlet_bc(bc);
+          A11 = fem::make_matrix<Ctx>(slap);
+
+          PetscErrorCode(*mass_method)(petsc::petsc_vec<Dimensions>&,
+                                       petsc::petsc_vec<Dimensions>&,
+                                       std::array<double, Dimensions> const&);
+
+          if (opt.line_sweep)
+            mass_method = fem::mass_line_mult;
+          else
+            mass_method = fem::mass_mult;
+
+          Ctx *smass = new Ctx{dap, hp, mass_method, fem::diag_mass_mult};
+          A22 = fem::make_matrix<Ctx>(smass);
+        }
         
         Mat bA[2][2];
         bA[0][0] = A11; bA[0][1] = PETSC_NULL;
@@ -256,97 +653,18 @@ namespace cafes
         ierr = KSPSetOperators(ksp, A, P);CHKERRQ(ierr);
 
         if (opt.pmm){
-          ierr = setPMMSolver(ksp, ctx->dm);CHKERRQ(ierr);
+          ierr = setPMMSolver<Dimensions>(ksp, ctx->dm, opt.pmm_pressure_mg);CHKERRQ(ierr);
         }
 
         ierr = KSPSetFromOptions(ksp);CHKERRQ(ierr);
+        if (guess_->type != initial_guess_type::none){
+          ierr = KSPSetInitialGuessNonzero(ksp, PETSC_TRUE);CHKERRQ(ierr);
+        }
         ierr = KSPSetUp(ksp);CHKERRQ(ierr);
         ierr = KSPGetPC(ksp, &pc);CHKERRQ(ierr);
 
-        PetscBool same;
-        ierr = PetscObjectTypeCompare((PetscObject)pc, PCFIELDSPLIT, &same);
-
-        // If we use fieldsplit for the preconditionner
-        if (same) {
-          KSP *subksp;
-          DM dav, dap;
-          ierr = PCFieldSplitGetSubKSP(pc, nullptr, &subksp);CHKERRQ(ierr);
-          ierr = DMCompositeGetEntries(ctx->dm, &dav, &dap);CHKERRQ(ierr);
-
-          ierr = KSPGetPC(subksp[0], &pc);CHKERRQ(ierr);
-          ierr = KSPSetType(subksp[0], KSPCG);CHKERRQ(ierr);
-          ierr = KSPSetDM(subksp[0], dav);CHKERRQ(ierr);
-          ierr = KSPSetDMActive(subksp[0], PETSC_FALSE);CHKERRQ(ierr);
-          ierr = PetscObjectTypeCompare((PetscObject)pc, PCMG, &same);CHKERRQ(ierr);
-
-          // if MG is set for fieldsplit_0
-          if (same) {
-            PetscErrorCode(*method)(petsc::petsc_vec<Dimensions>&,
-                                    petsc::petsc_vec<Dimensions>&,
-                                    std::array<double, Dimensions> const&);
-            
-            if (opt.strain_tensor)
-              method = fem::strain_tensor_mult;
-            else
-              method = fem::laplacian_mult;
-
-            PetscInt MGlevels;
-            KSP smoother;
-            ierr = PCMGGetLevels(pc, &MGlevels);CHKERRQ(ierr);
-
-            for(std::size_t i=0; i<MGlevels; ++i){
-              auto mg_h = ctx->h;
-              std::for_each(mg_h.begin(), mg_h.end(), [&](auto& x){x*=(1<<(MGlevels-1-i));});
-
-              auto *mg_ctx = new Ctx{dav, mg_h, method, fem::diag_laplacian_mult};
-              mg_ctx->set_dirichlet_bc(ctx->bc_);
-
-              PC pcsmoother;
-              ierr = PCMGGetSmoother(pc, i, &smoother);CHKERRQ(ierr);
-
-              ierr = KSPSetComputeOperators(smoother, createLevelMatrices<Ctx>, (void *) mg_ctx);CHKERRQ(ierr);
-              //ierr = KSPSetType(smoother, KSPCG);CHKERRQ(ierr);
-              ierr = KSPSetType(smoother, KSPCG);CHKERRQ(ierr);
-              ierr = KSPGetPC(smoother, &pcsmoother);CHKERRQ(ierr);
-              ierr = PCSetType(pcsmoother, PCJACOBI);CHKERRQ(ierr);
-            }
-  
-            ierr = PCSetUp(pc);CHKERRQ(ierr);
-          }
+        ierr = setup_fieldsplit_solvers(pc, *ctx, opt);CHKERRQ(ierr);
 
-          // ierr = KSPGetPC(subksp[1], &pc);CHKERRQ(ierr);
-          // ierr = KSPSetType(subksp[1], KSPFGMRES);CHKERRQ(ierr);
-          // ierr = KSPSetDM(subksp[1], dap);CHKERRQ(ierr);
-          // ierr = KSPSetDMActive(subksp[1], PETSC_FALSE);CHKERRQ(ierr);
-          // ierr = PetscObjectTypeCompare((PetscObject)pc, PCMG, &same);CHKERRQ(ierr);
-
-          // // if MG is set for fieldsplit_1
-          // if (same) {
-          //   PetscInt MGlevels;
-          //   KSP smoother;
-          //   ierr = PCMGGetLevels(pc, &MGlevels);CHKERRQ(ierr);
-
-          //   for(std::size_t i=0; i<MGlevels; ++i){
-          //     auto mg_h{ctx->h};
-          //     std::for_each(mg_h.begin(), mg_h.end(), [&](auto& x){x*=2;});
-
-          //     std::for_each(mg_h.begin(), mg_h.end(), [&](auto& x){x*=(1<<(MGlevels-1-i));});
-
-          //     auto *mg_ctx = new Ctx{dap, mg_h, fem::mass_mult, fem::mass_mult_diag};
-          //     //mg_ctx->set_dirichlet_bc(ctx->bc_);
-
-          //     PC pcsmoother;
-          //     ierr = PCMGGetSmoother(pc, i, &smoother);CHKERRQ(ierr);
-
-          //     ierr = KSPSetComputeOperators(smoother, createLevelMatrices<Ctx>, (void *) mg_ctx);CHKERRQ(ierr);
-          //     ierr = KSPSetType(smoother, KSPFGMRES);CHKERRQ(ierr);
-          //     ierr = KSPGetPC(smoother, &pcsmoother);CHKERRQ(ierr);
-          //     ierr = PCSetType(pcsmoother, PCJACOBI);CHKERRQ(ierr);
-          //   }
-  
-          //   ierr = PCSetUp(pc);CHKERRQ(ierr);
-          // }
-        }
         PetscFunctionReturn(0);
       }
 
@@ -358,7 +676,63 @@ namespace cafes
         PC pc;
         PetscFunctionBeginUser;
 
+        if (guess_->type != initial_guess_type::none){
+          ierr = guess_->compute(A, rhs, sol);CHKERRQ(ierr);
+        }
         ierr = KSPSolve(ksp, rhs, sol);CHKERRQ(ierr);
+        ierr = guess_->update(A, rhs, sol, ksp);CHKERRQ(ierr);
+        if (opt.guess_view){
+          ierr = guess_->view();CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "solve_batch"
+      //! Solves the Stokes problem for each right hand side of rhs_batch
+      //! (with its Dirichlet values set as in setup_RHS) by batches of at
+      //! most opt.batch_size problems. The missing vectors of sol_batch are
+      //! created, the given ones are used as initial guesses if the
+      //! stokes_batch_ solver has a nonzero initial guess. Each problem is
+      //! scaled by the inverse of the norm of its right hand side in the
+      //! batch, so that the norm of the batch residual weights them
+      //! equally, and it is solved with its own tolerances.
+      PetscErrorCode solve_batch(std::vector<Vec> const& rhs_batch, std::vector<Vec>& sol_batch)
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        while (sol_batch.size() < rhs_batch.size()){
+          Vec v;
+          ierr = VecDuplicate(sol, &v);CHKERRQ(ierr);
+          ierr = VecSet(v, 0.);CHKERRQ(ierr);
+          sol_batch.push_back(v);
+        }
+
+        std::size_t const batch_size = std::max<PetscInt>(opt.batch_size, 1);
+        for(std::size_t first=0; first<rhs_batch.size(); first+=batch_size){
+          PetscInt const nbatch = std::min(batch_size, rhs_batch.size() - first);
+
+          if (batches_.find(nbatch) == batches_.end()){
+            ierr = create_stokes_batch(ctx->dm, ctx->h, ctx->bc_, opt, nbatch, batches_[nbatch]);CHKERRQ(ierr);
+          }
+          auto& batch = batches_[nbatch];
+
+          auto& bnorm = batch.convergence->bnorm;
+          auto& scale = batch.convergence->scale;
+          bnorm.resize(nbatch);
+          scale.resize(nbatch);
+          for(PetscInt b=0; b<nbatch; ++b){
+            ierr = VecNorm(rhs_batch[first + b], NORM_2, &bnorm[b]);CHKERRQ(ierr);
+            scale[b] = (bnorm[b] > 0.)? 1./bnorm[b]: 1.;
+          }
+
+          ierr = interleave_batch<Dimensions>(ctx->dm, batch.dm, rhs_batch.data() + first, batch.rhs, nbatch, true, scale.data());CHKERRQ(ierr);
+          ierr = interleave_batch<Dimensions>(ctx->dm, batch.dm, sol_batch.data() + first, batch.sol, nbatch, true, scale.data());CHKERRQ(ierr);
+          ierr = KSPSolve(batch.ksp, batch.rhs, batch.sol);CHKERRQ(ierr);
+          ierr = interleave_batch<Dimensions>(ctx->dm, batch.dm, sol_batch.data() + first, batch.sol, nbatch, false, scale.data());CHKERRQ(ierr);
+        }
 
         PetscFunctionReturn(0);
       }
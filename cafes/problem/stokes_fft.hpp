@@ -0,0 +1,143 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+
+#ifndef PARTICLE_PROBLEM_STOKES_FFT_HPP_INCLUDED
+#define PARTICLE_PROBLEM_STOKES_FFT_HPP_INCLUDED
+
+#include <problem/problem.hpp>
+#include <problem/context.hpp>
+#include <problem/options.hpp>
+#include <fem/matElem.hpp>
+#include <fem/mesh.hpp>
+#include <fem/operator.hpp>
+#include <fem/rhs.hpp>
+#include <fem/spectral.hpp>
+#include <petsc.h>
+#include <array>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //!
+    //! Stokes problem in a periodic box solved with FFT (see
+    //! fem::periodic_stokes_solver). It has the same interface as stokes
+    //! and can be used as Problem_type of SEM, DtoN and NtoD.
+    //!
+    template<std::size_t Dimensions>
+    struct stokes_fft : public Problem<Dimensions>{
+      using Ctx = context<Dimensions>;
+      fem::rhs_conditions<Dimensions> rhsc_;
+      options<Dimensions> opt{};
+
+      Ctx *ctx; //!< Context with the mesh and the steps
+      Vec sol;  //!< The solution of Stokes problem
+      Vec rhs;  //!< The RHS of Stokes problem
+      fem::periodic_stokes_solver<Dimensions> solver; //!< The FFT solver
+      KSP ksp = nullptr; //!< No Krylov solver: the FFT solve is direct
+
+      stokes_fft(fem::dirichlet_conditions<Dimensions> bc, fem::rhs_conditions<Dimensions> rhsc={nullptr})
+      {
+        opt.process_options();
+
+        DM mesh;
+        fem::createMesh<Dimensions>(mesh, opt.mx, opt.xperiod);
+
+        DMCreateGlobalVector(mesh, &sol);
+        VecDuplicate(sol, &rhs);
+        VecSet(rhs, 0.);
+
+        std::array<double, Dimensions> hu;
+        for(std::size_t i = 0; i<Dimensions; ++i){
+          // the periodic box has mx-1 pressure elements
+          hu[i] = .5*opt.lx[i]/(opt.mx[i]-1);
+        }
+
+        rhsc_ = rhsc;
+        if (opt.strain_tensor)
+          ctx = new Ctx{mesh, hu, fem::strain_tensor_mult};
+        else
+          ctx = new Ctx{mesh, hu, fem::laplacian_mult};
+        ctx->set_dirichlet_bc(bc);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "setup_RHS"
+      virtual PetscErrorCode setup_RHS() override 
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        if (rhsc_.has_condition()){
+          ierr = fem::set_rhs<Dimensions, 1>(ctx->dm, rhs, rhsc_, ctx->h);CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "setup_KSP"
+      //! Builds the FFT plans and the scatters to the FFT layout: there is
+      //! no Krylov solver.
+      virtual PetscErrorCode setup_KSP() override
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        if (opt.strain_tensor){
+          ierr = solver.setup(ctx->dm, getMatElemStrainTensor(ctx->h), getMatElemPressure(ctx->h));CHKERRQ(ierr);
+        }
+        else{
+          ierr = solver.setup(ctx->dm, getMatElemLaplacian(ctx->h), getMatElemPressure(ctx->h));CHKERRQ(ierr);
+        }
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "solve"
+      virtual PetscErrorCode solve() override
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        ierr = solver.apply(rhs, sol);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+    };
+  }
+
+  template<std::size_t Dimensions, std::size_t Ndof>
+  problem::stokes_fft<Dimensions> make_stokes_fft(fem::dirichlet_conditions<Dimensions> const& dc, fem::rhs_conditions<Ndof> const& rhs)
+  {
+    return {dc, rhs}; 
+  }
+}
+
+#endif
@@ -0,0 +1,210 @@
+// Copyright (c) 2016, Loic Gouarin <loic.gouarin@math.u-psud.fr>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, 
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+//    may be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+// OF SUCH DAMAGE.
+#ifndef PARTICLE_PROBLEM_SURFACE_OPERATOR_HPP_INCLUDED
+#define PARTICLE_PROBLEM_SURFACE_OPERATOR_HPP_INCLUDED
+
+#include <fem/assembly.hpp>
+#include <fem/mesh.hpp>
+#include <fem/quadrature.hpp>
+#include <particle/geometry/vector.hpp>
+#include <petsc/vec.hpp>
+
+#include <petsc.h>
+#include <array>
+#include <vector>
+
+namespace cafes
+{
+  namespace problem
+  {
+    //!
+    //! P1 interpolation of the velocity on the surface points of the
+    //! particles assembled once as a parallel AIJ matrix S: a row for each
+    //! component of the surface points of this process, a column for each
+    //! dof of the vectors of dm. The interpolation is S u and the spreading
+    //! of a simple layer is S^T g, PETSc handles the elements which have
+    //! nodes on other processes.
+    //!
+    //! It is assembled at its first use for the surface points set by
+    //! create_Mat_and_Vec, which builds a new context when the particles
+    //! move. S and g_ are released with the context.
+    //!
+    template<std::size_t Dimensions>
+    struct surface_operator
+    {
+      Mat S = nullptr;
+      Vec g_ = nullptr;               //!< surface values in the layout of the rows of S
+      std::vector<std::size_t> start; //!< the points of particle i are [start[i], start[i+1])
+      bool valid = false;
+
+      surface_operator() = default;
+      surface_operator(surface_operator const&) = delete;
+      surface_operator& operator=(surface_operator const&) = delete;
+
+      ~surface_operator()
+      {
+        PetscBool finalized;
+        PetscFinalized(&finalized);
+        if (!finalized)
+          destroy();
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "surface_operator::destroy"
+      PetscErrorCode destroy()
+      {
+        PetscErrorCode ierr;
+        PetscFunctionBeginUser;
+
+        ierr = MatDestroy(&S);CHKERRQ(ierr);
+        ierr = VecDestroy(&g_);CHKERRQ(ierr);
+        valid = false;
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "surface_operator::update"
+      //! Assembles S for the surface points at the first use.
+      template<typename surf_type>
+      PetscErrorCode update(DM dm, surf_type const& surf_points, std::array<double, Dimensions> const& h)
+      {
+        PetscErrorCode ierr;
+        PetscBool iscomposite;
+        int localsize, totalsize;
+        PetscInt row;
+        PetscFunctionBeginUser;
+
+        if (valid)
+          PetscFunctionReturn(0);
+
+        ierr = destroy();CHKERRQ(ierr);
+
+        start.assign(1, 0);
+        for(auto& spts: surf_points)
+          start.push_back(start.back() + spts.size());
+
+        ierr = fem::get_DM_sizes(dm, localsize, totalsize);CHKERRQ(ierr);
+
+        // a surface point is in one element
+        PetscInt const nnz = 1 << Dimensions;
+        ierr = MatCreateAIJ(PETSC_COMM_WORLD, start.back()*Dimensions, localsize, PETSC_DETERMINE, totalsize,
+                            nnz, nullptr, nnz, nullptr, &S);CHKERRQ(ierr);
+
+        fem::assembler<Dimensions> a;
+        a.A = S;
+        ISLocalToGlobalMapping *ltogs = nullptr;
+        int ndm = 0;
+        ierr = PetscObjectTypeCompare((PetscObject)dm, DMCOMPOSITE, &iscomposite);CHKERRQ(ierr);
+        if (iscomposite){
+          ierr = DMCompositeGetNumberDM(dm, &ndm);CHKERRQ(ierr);
+          ierr = DMCompositeGetISLocalToGlobalMappings(dm, &ltogs);CHKERRQ(ierr);
+          ierr = a.add_field(petsc::get_DM(dm, 0), ltogs[0]);CHKERRQ(ierr);
+        }
+        else{
+          ISLocalToGlobalMapping ltog;
+          ierr = DMGetLocalToGlobalMapping(dm, &ltog);CHKERRQ(ierr);
+          ierr = a.add_field(dm, ltog);CHKERRQ(ierr);
+        }
+
+        ierr = MatGetOwnershipRange(S, &row, nullptr);CHKERRQ(ierr);
+        for(auto& spts: surf_points)
+          for(auto& spt: spts){
+            auto bfunc = fem::P1_integration(spt.second, h);
+            auto ielem = fem::get_element(spt.first);
+            std::array<PetscInt, (1 << Dimensions)> cols;
+            for(std::size_t d=0; d<Dimensions; ++d, ++row){
+              for (std::size_t j=0; j<bfunc.size(); ++j)
+                cols[j] = a.index(0, ielem[j], d);
+              ierr = MatSetValues(S, 1, &row, bfunc.size(), cols.data(), bfunc.data(), INSERT_VALUES);CHKERRQ(ierr);
+            }
+          }
+
+        ierr = MatAssemblyBegin(S, MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+        ierr = MatAssemblyEnd(S, MAT_FINAL_ASSEMBLY);CHKERRQ(ierr);
+
+        ierr = a.restore();CHKERRQ(ierr);
+        for(int i=0; i<ndm; ++i){
+          ierr = ISLocalToGlobalMappingDestroy(&ltogs[i]);CHKERRQ(ierr);
+        }
+        if (ltogs){
+          ierr = PetscFree(ltogs);CHKERRQ(ierr);
+        }
+
+        ierr = MatCreateVecs(S, nullptr, &g_);CHKERRQ(ierr);
+        valid = true;
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "surface_operator::interpolate"
+      //! g = S u
+      PetscErrorCode interpolate(Vec u, std::vector<std::vector<geometry::vector<double, Dimensions>>>& g)
+      {
+        PetscErrorCode ierr;
+        PetscScalar const *pg;
+        PetscFunctionBeginUser;
+
+        ierr = MatMult(S, u, g_);CHKERRQ(ierr);
+
+        ierr = VecGetArrayRead(g_, &pg);CHKERRQ(ierr);
+        for(std::size_t ipart=0; ipart<g.size(); ++ipart)
+          for(std::size_t i=0; i<g[ipart].size(); ++i)
+            for(std::size_t d=0; d<Dimensions; ++d)
+              g[ipart][i][d] = pg[(start[ipart] + i)*Dimensions + d];
+        ierr = VecRestoreArrayRead(g_, &pg);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+
+      #undef __FUNCT__
+      #define __FUNCT__ "surface_operator::spread"
+      //! u = S^T (weight g) where the weight is given for each particle
+      PetscErrorCode spread(std::vector<std::vector<geometry::vector<double, Dimensions>>> const& g,
+                            std::vector<double> const& weight, Vec u)
+      {
+        PetscErrorCode ierr;
+        PetscScalar *pg;
+        PetscFunctionBeginUser;
+
+        ierr = VecGetArray(g_, &pg);CHKERRQ(ierr);
+        for(std::size_t ipart=0; ipart<g.size(); ++ipart)
+          for(std::size_t i=0; i<g[ipart].size(); ++i)
+            for(std::size_t d=0; d<Dimensions; ++d)
+              pg[(start[ipart] + i)*Dimensions + d] = g[ipart][i][d]*weight[ipart];
+        ierr = VecRestoreArray(g_, &pg);CHKERRQ(ierr);
+
+        ierr = MatMultTranspose(S, g_, u);CHKERRQ(ierr);
+
+        PetscFunctionReturn(0);
+      }
+    };
+  }
+}
+#endif
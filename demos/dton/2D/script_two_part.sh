@@ -9,6 +9,8 @@ mpiexec -n $nproc $exec \
     -stokes_ksp_rtol 1e-6 \
     -dton_ksp_rtol 1e-2 \
     -dton_ksp_type gcr \
+    -dton_inexact \
+    -dton_particle_pc \
     -dton_ksp_monitor \
     -mx 129 \
     -my 129
\ No newline at end of file
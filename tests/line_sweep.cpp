@@ -0,0 +1,121 @@
+#include <fem/operator.hpp>
+#include <fem/mesh.hpp>
+#include <problem/options.hpp>
+#include <petsc.h>
+#include <array>
+#include <iostream>
+#include <chrono>
+
+// Compare the element by element kernels with the x-line sweep kernels
+// on the velocity grid: timings, effective bandwidth and max difference.
+//
+// The bandwidth only counts the compulsory traffic of one sweep: read x,
+// read and write y. The kernels add the terms in the same order, so the
+// results must be bit identical: the target is built with -ffp-contract=off
+// and the test fails on any difference.
+
+template<std::size_t Dimensions, typename Mult>
+PetscErrorCode bench(DM dm, Vec vx, Vec vy, std::array<double, Dimensions> const& h,
+                     Mult&& mult, int nrep, char const* name)
+{
+  PetscErrorCode ierr;
+  int localsize, totalsize;
+  PetscFunctionBeginUser;
+
+  ierr = cafes::fem::get_DM_sizes(dm, localsize, totalsize);CHKERRQ(ierr);
+
+  auto x = cafes::petsc::petsc_vec<Dimensions>(dm, vx, 0);
+  auto y = cafes::petsc::petsc_vec<Dimensions>(dm, vy, 0, false);
+  ierr = x.global_to_local(INSERT_VALUES);CHKERRQ(ierr);
+  ierr = y.fill(0.);CHKERRQ(ierr);
+  ierr = y.fill_global(0.);CHKERRQ(ierr);
+
+  std::chrono::time_point<std::chrono::system_clock> start, end;
+  start = std::chrono::system_clock::now();
+  for(int i=0; i<nrep; ++i){
+    ierr = mult(x, y, h);CHKERRQ(ierr);
+  }
+  end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+
+  double gbytes = 3.*sizeof(double)*localsize*nrep*1e-9;
+  std::cout << name << ": " << elapsed_seconds.count()/nrep << "s per sweep, "
+            << gbytes/elapsed_seconds.count() << " GB/s\n";
+
+  ierr = y.local_to_global(ADD_VALUES);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+template<std::size_t Dimensions>
+PetscErrorCode run()
+{
+  PetscErrorCode ierr;
+  PetscFunctionBeginUser;
+
+  cafes::problem::options<Dimensions> opt{};
+  ierr = opt.process_options();CHKERRQ(ierr);
+
+  PetscInt nrep = 10;
+  ierr = PetscOptionsGetInt(NULL, NULL, "-nrep", &nrep, NULL);CHKERRQ(ierr);
+
+  DM mesh;
+  ierr = cafes::fem::createMesh<Dimensions>(mesh, opt.mx, opt.xperiod);CHKERRQ(ierr);
+
+  DM dav, dap;
+  ierr = DMCompositeGetEntries(mesh, &dav, &dap);CHKERRQ(ierr);
+
+  std::array<double, Dimensions> h;
+  for(std::size_t i = 0; i<Dimensions; ++i)
+    h[i] = .5*opt.lx[i]/(opt.mx[i]-1);
+
+  Vec x, y1, y2;
+  ierr = DMCreateGlobalVector(dav, &x);CHKERRQ(ierr);
+  ierr = VecDuplicate(x, &y1);CHKERRQ(ierr);
+  ierr = VecDuplicate(x, &y2);CHKERRQ(ierr);
+  ierr = VecSetRandom(x, NULL);CHKERRQ(ierr);
+
+  PetscReal diff;
+
+  ierr = bench<Dimensions>(dav, x, y1, h, cafes::fem::laplacian_mult<Dimensions>, nrep, "laplacian element");CHKERRQ(ierr);
+  ierr = bench<Dimensions>(dav, x, y2, h, cafes::fem::laplacian_line_mult<Dimensions>, nrep, "laplacian line   ");CHKERRQ(ierr);
+  ierr = VecAXPY(y2, -1., y1);CHKERRQ(ierr);
+  ierr = VecNorm(y2, NORM_INFINITY, &diff);CHKERRQ(ierr);
+  std::cout << "laplacian max difference: " << diff << "\n";
+  if (diff != 0.)
+    SETERRQ1(PETSC_COMM_WORLD, PETSC_ERR_PLIB, "The laplacian line sweep differs from the element kernel: %g", (double)diff);
+
+  ierr = bench<Dimensions>(dav, x, y1, h, cafes::fem::mass_mult<Dimensions>, nrep, "mass element     ");CHKERRQ(ierr);
+  ierr = bench<Dimensions>(dav, x, y2, h, cafes::fem::mass_line_mult<Dimensions>, nrep, "mass line        ");CHKERRQ(ierr);
+  ierr = VecAXPY(y2, -1., y1);CHKERRQ(ierr);
+  ierr = VecNorm(y2, NORM_INFINITY, &diff);CHKERRQ(ierr);
+  std::cout << "mass max difference: " << diff << "\n";
+  if (diff != 0.)
+    SETERRQ1(PETSC_COMM_WORLD, PETSC_ERR_PLIB, "The mass line sweep differs from the element kernel: %g", (double)diff);
+
+  ierr = VecDestroy(&x);CHKERRQ(ierr);
+  ierr = VecDestroy(&y1);CHKERRQ(ierr);
+  ierr = VecDestroy(&y2);CHKERRQ(ierr);
+  ierr = DMDestroy(&mesh);CHKERRQ(ierr);
+
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+    PetscErrorCode ierr;
+    PetscInt dim = 3;
+
+    ierr = PetscInitialize(&argc, &argv,  (char *)0, (char *)0);CHKERRQ(ierr);
+    ierr = PetscOptionsGetInt(NULL, NULL, "-dim", &dim, NULL);CHKERRQ(ierr);
+
+    if (dim == 2){
+      ierr = run<2>();CHKERRQ(ierr);
+    }
+    else{
+      ierr = run<3>();CHKERRQ(ierr);
+    }
+
+    ierr = PetscFinalize();CHKERRQ(ierr);
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <cafes.hpp>
+#include <petsc.h>
+
+void zeros(const PetscReal x[], PetscScalar *u){
+  *u = 0.;
+}
+
+void ones(const PetscReal x[], PetscScalar *u){
+  *u = 1.;
+}
+
+void ones_m(const PetscReal x[], PetscScalar *u){
+  *u = -1.;
+}
+
+int main(int argc, char **argv)
+{
+    PetscErrorCode ierr;
+    std::size_t const dim = 2;
+
+    ierr = PetscInitialize(&argc, &argv,  (char *)0, (char *)0);CHKERRQ(ierr);
+
+    auto bc = cafes::make_bc<dim>({ {{zeros , zeros}} 
+                                  , {{zeros , zeros}}
+                                  , {{zeros, zeros}}
+                                  , {{zeros, zeros}}
+                                  });
+    auto rhs = cafes::make_rhs<dim>({{ zeros, zeros }});
+    auto st = cafes::make_stokes<dim>(bc, rhs);
+
+    auto se1 = cafes::make_circle( {.5,.5}, .05);
+    std::vector<cafes::particle<decltype(se1)>> pt{ cafes::make_particle_with_force(se1, {0., -9.81}, 1000.)
+                                                 };
+
+    auto s = cafes::make_monolithic(pt, st);
+    ierr = s.create_Mat_and_Vec();CHKERRQ(ierr);
+    ierr = s.setup_RHS();CHKERRQ(ierr);
+    ierr = s.setup_KSP();CHKERRQ(ierr);
+    ierr = s.solve();CHKERRQ(ierr);
+
+    std::cout << s.parts_[0].velocity_[0] << " " << s.parts_[0].velocity_[1] << "\n";
+    //ierr = cafes::io::save_VTK("Resultats", "monolithic", st.sol, st.ctx->dm, st.ctx->h);CHKERRQ(ierr);
+    ierr = PetscFinalize();CHKERRQ(ierr);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include <problem/stokes.hpp>
+#include <fem/bc.hpp>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+void zeros(const PetscReal x[], PetscScalar *u){
+  *u = 0.;
+}
+
+void ones(const PetscReal x[], PetscScalar *u){
+  *u = 1.;
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "relative_difference"
+//! ||x - y||/||y|| on the velocity and on the pressure of the composite
+//! vectors x and y. The pressure is defined up to a constant in the
+//! cavity: its mean is removed. x and y are modified.
+PetscErrorCode relative_difference(DM dm, Vec x, Vec y, PetscReal diff[2])
+{
+  PetscErrorCode ierr;
+  Vec fx[2], fy[2];
+  PetscFunctionBeginUser;
+
+  ierr = DMCompositeGetAccess(dm, x, &fx[0], &fx[1]);CHKERRQ(ierr);
+  ierr = DMCompositeGetAccess(dm, y, &fy[0], &fy[1]);CHKERRQ(ierr);
+
+  for(std::size_t f=0; f<2; ++f){
+    PetscReal norm;
+    if (f == 1){
+      PetscScalar sx, sy;
+      PetscInt n;
+      ierr = VecGetSize(fx[f], &n);CHKERRQ(ierr);
+      ierr = VecSum(fx[f], &sx);CHKERRQ(ierr);
+      ierr = VecSum(fy[f], &sy);CHKERRQ(ierr);
+      ierr = VecShift(fx[f], -sx/n);CHKERRQ(ierr);
+      ierr = VecShift(fy[f], -sy/n);CHKERRQ(ierr);
+    }
+    ierr = VecNorm(fy[f], NORM_2, &norm);CHKERRQ(ierr);
+    ierr = VecAXPY(fx[f], -1., fy[f]);CHKERRQ(ierr);
+    ierr = VecNorm(fx[f], NORM_2, &diff[f]);CHKERRQ(ierr);
+    if (norm > 0)
+      diff[f] /= norm;
+  }
+
+  ierr = DMCompositeRestoreAccess(dm, x, &fx[0], &fx[1]);CHKERRQ(ierr);
+  ierr = DMCompositeRestoreAccess(dm, y, &fy[0], &fy[1]);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+// Solve a batch of cavity problems with solve_batch and each of them with
+// solve, and compare the solutions. The test fails if a relative
+// difference is above -tol (1e-4 by default): run it with tolerances of
+// stokes_ksp and stokes_batch_ksp below it.
+int main(int argc, char **argv)
+{
+    PetscErrorCode ierr;
+    PetscInt nbatch = 4;
+    PetscReal tol = 1e-4;
+    bool failed = false;
+
+    ierr = PetscInitialize(&argc, &argv,  (char *)0, (char *)0);CHKERRQ(ierr);
+    ierr = PetscOptionsGetInt(NULL, NULL, "-nbatch", &nbatch, NULL);CHKERRQ(ierr);
+    ierr = PetscOptionsGetReal(NULL, NULL, "-tol", &tol, NULL);CHKERRQ(ierr);
+
+    cafes::fem::rhs_conditions<2>       rhs{{ ones, zeros }};
+    cafes::fem::dirichlet_conditions<2> dc = { {{zeros, zeros}}
+                                             , {{zeros, zeros}}
+                                             , {{zeros, zeros}}
+                                             , {{ones , zeros}}
+                                             };
+
+    cafes::problem::stokes<2> st{dc, rhs};
+    st.setup_RHS();
+    st.setup_KSP();
+
+    // right hand sides of very different magnitudes: each problem must
+    // reach its own relative tolerance
+    std::vector<Vec> rhs_batch(nbatch), sol_batch;
+    for(PetscInt b=0; b<nbatch; ++b){
+      ierr = VecDuplicate(st.rhs, &rhs_batch[b]);CHKERRQ(ierr);
+      ierr = VecCopy(st.rhs, rhs_batch[b]);CHKERRQ(ierr);
+      ierr = VecScale(rhs_batch[b], std::pow(1e-3, b));CHKERRQ(ierr);
+    }
+
+    ierr = st.solve_batch(rhs_batch, sol_batch);CHKERRQ(ierr);
+
+    Vec r;
+    ierr = VecDuplicate(st.rhs, &r);CHKERRQ(ierr);
+    for(PetscInt b=0; b<nbatch; ++b){
+      PetscReal rnorm, bnorm, diff[2];
+      ierr = MatMult(st.A, sol_batch[b], r);CHKERRQ(ierr);
+      ierr = VecAXPY(r, -1., rhs_batch[b]);CHKERRQ(ierr);
+      ierr = VecNorm(r, NORM_2, &rnorm);CHKERRQ(ierr);
+      ierr = VecNorm(rhs_batch[b], NORM_2, &bnorm);CHKERRQ(ierr);
+
+      // the same problem alone
+      ierr = VecCopy(rhs_batch[b], st.rhs);CHKERRQ(ierr);
+      ierr = VecSet(st.sol, 0.);CHKERRQ(ierr);
+      ierr = st.solve();CHKERRQ(ierr);
+      ierr = relative_difference(st.ctx->dm, sol_batch[b], st.sol, diff);CHKERRQ(ierr);
+
+      std::cout << "problem " << b << ": relative residual " << rnorm/bnorm
+                << ", relative difference with solve: velocity " << diff[0] << ", pressure " << diff[1] << "\n";
+      failed = failed || diff[0] > tol || diff[1] > tol;
+    }
+
+    ierr = VecDestroy(&r);CHKERRQ(ierr);
+    for(PetscInt b=0; b<nbatch; ++b){
+      ierr = VecDestroy(&rhs_batch[b]);CHKERRQ(ierr);
+      ierr = VecDestroy(&sol_batch[b]);CHKERRQ(ierr);
+    }
+
+    if (failed)
+      SETERRQ1(PETSC_COMM_WORLD, PETSC_ERR_PLIB, "A batched solution differs from solve by more than %g", (double)tol);
+
+    ierr = PetscFinalize();CHKERRQ(ierr);
+
+    return 0;
+}
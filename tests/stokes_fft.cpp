@@ -0,0 +1,128 @@
+#include <problem/stokes.hpp>
+#include <problem/stokes_fft.hpp>
+#include <fem/bc.hpp>
+#include <petsc.h>
+#include <cmath>
+#include <vector>
+
+// Solve a periodic Stokes problem with the FFT solver and with the
+// iterative Stokes solver and compare both solutions. The constants are
+// in the kernel of the periodic problem: the mean of each velocity
+// component and of the pressure is removed before the comparison.
+//
+// Run with -xperiod -yperiod (the box must be periodic in each direction)
+// and a tight -stokes_ksp_rtol. The test fails if the relative difference
+// of the velocity or of the pressure is above -tol (1e-6 by default).
+
+void zeros(const PetscReal x[], PetscScalar *u){
+  *u = 0.;
+}
+
+void force(const PetscReal x[], PetscScalar *u){
+  *u = std::sin(2*M_PI*x[1]);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "remove_mean"
+PetscErrorCode remove_mean(Vec v, PetscInt dof)
+{
+  PetscErrorCode ierr;
+  PetscScalar *a;
+  PetscInt n, N;
+  PetscFunctionBeginUser;
+
+  ierr = VecGetLocalSize(v, &n);CHKERRQ(ierr);
+  ierr = VecGetSize(v, &N);CHKERRQ(ierr);
+  ierr = VecGetArray(v, &a);CHKERRQ(ierr);
+
+  std::vector<PetscScalar> mean(dof, 0.);
+  for(PetscInt i=0; i<n; ++i)
+    mean[i%dof] += a[i];
+  ierr = MPI_Allreduce(MPI_IN_PLACE, mean.data(), dof, MPIU_SCALAR, MPIU_SUM, PetscObjectComm((PetscObject)v));CHKERRQ(ierr);
+  for(PetscInt i=0; i<n; ++i)
+    a[i] -= mean[i%dof]*dof/N;
+
+  ierr = VecRestoreArray(v, &a);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+#undef __FUNCT__
+#define __FUNCT__ "relative_difference"
+//! ||x - y||/||y|| on the velocity (field 0) and on the pressure (field 1)
+//! of the composite vectors x and y; x is modified.
+PetscErrorCode relative_difference(DM dm, std::size_t dim, Vec x, Vec y, PetscReal diff[2])
+{
+  PetscErrorCode ierr;
+  Vec fx[2], fy[2];
+  PetscFunctionBeginUser;
+
+  ierr = DMCompositeGetAccess(dm, x, &fx[0], &fx[1]);CHKERRQ(ierr);
+  ierr = DMCompositeGetAccess(dm, y, &fy[0], &fy[1]);CHKERRQ(ierr);
+
+  for(std::size_t f=0; f<2; ++f){
+    PetscReal norm;
+    PetscInt const dof = (f == 0)? dim: 1;
+    ierr = remove_mean(fx[f], dof);CHKERRQ(ierr);
+    ierr = remove_mean(fy[f], dof);CHKERRQ(ierr);
+    ierr = VecNorm(fy[f], NORM_2, &norm);CHKERRQ(ierr);
+    ierr = VecAXPY(fx[f], -1., fy[f]);CHKERRQ(ierr);
+    ierr = VecNorm(fx[f], NORM_2, &diff[f]);CHKERRQ(ierr);
+    if (norm > 0)
+      diff[f] /= norm;
+  }
+
+  ierr = DMCompositeRestoreAccess(dm, x, &fx[0], &fx[1]);CHKERRQ(ierr);
+  ierr = DMCompositeRestoreAccess(dm, y, &fy[0], &fy[1]);CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+int main(int argc, char **argv)
+{
+    PetscErrorCode ierr;
+    std::size_t const dim = 2;
+    PetscReal norm_rhs, norm_res, diff[2];
+    PetscReal tol = 1e-6;
+    Vec res;
+
+    ierr = PetscInitialize(&argc, &argv,  (char *)0, (char *)0);CHKERRQ(ierr);
+    ierr = PetscOptionsGetReal(NULL, NULL, "-tol", &tol, NULL);CHKERRQ(ierr);
+
+    cafes::fem::rhs_conditions<dim>       rhs{{ force, zeros }};
+    cafes::fem::dirichlet_conditions<dim> dc = { {{zeros, zeros}}
+                                               , {{zeros, zeros}}
+                                               , {{zeros, zeros}}
+                                               , {{zeros, zeros}}
+                                               };
+
+    cafes::problem::stokes_fft<dim> sf{dc, rhs};
+    cafes::problem::stokes<dim> st{dc, rhs};
+
+    ierr = sf.setup_RHS();CHKERRQ(ierr);
+    ierr = sf.setup_KSP();CHKERRQ(ierr);
+    ierr = sf.solve();CHKERRQ(ierr);
+
+    ierr = st.setup_RHS();CHKERRQ(ierr);
+    ierr = VecDuplicate(st.rhs, &res);CHKERRQ(ierr);
+    ierr = MatMult(st.A, sf.sol, res);CHKERRQ(ierr);
+    ierr = VecAXPY(res, -1., st.rhs);CHKERRQ(ierr);
+
+    ierr = VecNorm(st.rhs, NORM_2, &norm_rhs);CHKERRQ(ierr);
+    ierr = VecNorm(res, NORM_2, &norm_res);CHKERRQ(ierr);
+    ierr = PetscPrintf(PETSC_COMM_WORLD, "relative residual of the FFT solution: %g\n", norm_res/norm_rhs);CHKERRQ(ierr);
+
+    ierr = st.setup_KSP();CHKERRQ(ierr);
+    ierr = st.solve();CHKERRQ(ierr);
+
+    ierr = relative_difference(st.ctx->dm, dim, sf.sol, st.sol, diff);CHKERRQ(ierr);
+    ierr = PetscPrintf(PETSC_COMM_WORLD, "relative difference with the iterative solution: velocity %g, pressure %g\n", diff[0], diff[1]);CHKERRQ(ierr);
+
+    ierr = VecDestroy(&res);CHKERRQ(ierr);
+    ierr = sf.solver.destroy();CHKERRQ(ierr);
+
+    if (diff[0] > tol || diff[1] > tol)
+      SETERRQ1(PETSC_COMM_WORLD, PETSC_ERR_PLIB, "The FFT solution differs from the iterative one by more than %g", (double)tol);
+
+    ierr = PetscFinalize();CHKERRQ(ierr);
+
+    return 0;
+}